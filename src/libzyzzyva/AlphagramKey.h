@@ -0,0 +1,100 @@
+//---------------------------------------------------------------------------
+// AlphagramKey.h
+//
+// A packed integer key identifying the set of letters of a word.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_ALPHAGRAM_KEY_H
+#define ZYZZYVA_ALPHAGRAM_KEY_H
+
+#include "WordKey.h"
+#include <QHash>
+
+// The letters of a word in sorted order, packed 5 bits per letter into two
+// 64-bit integers, the first holding up to 12 letters and the second the
+// rest.  Each letter A-Z is stored as 1-26, so no letter packs to zero and
+// the length of the word is implied by the key.  Two words are anagrams if
+// their keys are equal, and keys are compared and hashed without touching
+// memory outside the key.  A word that is empty, too long, or has a letter
+// outside A-Z makes an invalid key.
+class AlphagramKey
+{
+    public:
+    AlphagramKey() : high(0), low(0) { }
+    AlphagramKey(const char* letters, int length) : high(0), low(0) {
+        if ((length <= 0) || (length > MAX_LETTERS))
+            return;
+
+        // Count the letters, then pack them in sorted order
+        int counts[NUM_CODES];
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < length; ++i) {
+            int code = letters[i] - 'A' + 1;
+            if ((code < 1) || (code >= NUM_CODES))
+                return;
+            ++counts[code];
+        }
+
+        quint64 words[2] = { 0, 0 };
+        int numPacked = 0;
+        for (quint64 code = 1; code < NUM_CODES; ++code) {
+            for (int i = 0; i < counts[code]; ++i, ++numPacked) {
+                quint64& word = words[numPacked / LETTERS_PER_WORD];
+                word = (word << BITS_PER_LETTER) | code;
+            }
+        }
+        high = words[0];
+        low = words[1];
+    }
+    explicit AlphagramKey(const WordKey& word) : high(0), low(0) {
+        *this = AlphagramKey(word.getLetters(), word.getLength());
+    }
+
+    bool isValid() const { return high != 0; }
+    quint64 getHigh() const { return high; }
+    quint64 getLow() const { return low; }
+
+    bool operator==(const AlphagramKey& rhs) const {
+        return (high == rhs.high) && (low == rhs.low);
+    }
+    bool operator!=(const AlphagramKey& rhs) const { return !(*this == rhs); }
+    bool operator<(const AlphagramKey& rhs) const {
+        return (high != rhs.high) ? (high < rhs.high) : (low < rhs.low);
+    }
+
+    private:
+    static const int BITS_PER_LETTER = 5;
+    static const int LETTERS_PER_WORD = 12;
+    static const int MAX_LETTERS = 2 * LETTERS_PER_WORD;
+    static const int NUM_CODES = 27;
+
+    quint64 high;
+    quint64 low;
+};
+
+inline uint
+qHash(const AlphagramKey& key)
+{
+    quint64 hash = key.getHigh() ^ (key.getLow() * 0x9E3779B97F4A7C15ULL);
+    return uint(hash ^ (hash >> 32));
+}
+
+#endif // ZYZZYVA_ALPHAGRAM_KEY_H
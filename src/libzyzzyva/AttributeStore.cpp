@@ -0,0 +1,272 @@
+//---------------------------------------------------------------------------
+// AttributeStore.cpp
+//
+// A class for holding the numeric attributes of the words of a lexicon in
+// memory, one array per attribute.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#include "AttributeStore.h"
+#include "WordGraph.h"
+#include <QSqlQuery>
+#include <QVariant>
+
+//---------------------------------------------------------------------------
+//  matchRange
+//
+//! Clear the bits of the words whose values are outside a range.  The
+//! words are taken 32 at a time, and the values of each block are compared
+//! without branching, with a single unsigned comparison per value, so the
+//! compiler can vectorize the loop.  Blocks with no bits set are skipped.
+//
+//! @param values the values, indexed by word ID
+//! @param numValues the number of values
+//! @param minValue the minimum value
+//! @param maxValue the maximum value
+//! @param bits the bit set of words, one bit per word ID
+//---------------------------------------------------------------------------
+template <class T>
+void
+matchRange(const T* values, int numValues, int minValue, int maxValue,
+           quint32* bits)
+{
+    int numBlocks = (numValues + 31) / 32;
+    if ((maxValue < minValue) || (maxValue < 0)) {
+        for (int i = 0; i < numBlocks; ++i)
+            bits[i] = 0;
+        return;
+    }
+
+    quint32 low = qMax(minValue, 0);
+    quint32 span = quint32(maxValue) - low;
+    for (int block = 0; block < numBlocks; ++block) {
+        if (!bits[block])
+            continue;
+
+        const T* blockValues = values + (block * 32);
+        int blockSize = qMin(32, numValues - (block * 32));
+        quint32 mask = 0;
+        for (int i = 0; i < blockSize; ++i)
+            mask |= quint32((quint32(blockValues[i]) - low) <= span) << i;
+        bits[block] &= mask;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  load
+//
+//! Load the attributes of the words of a lexicon from its database.  Only
+//! words in the lexicon's graph are loaded, each at the position of its
+//! word ID.
+//
+//! @param db the database
+//! @param graph the word graph of the lexicon, which must be able to number
+//! its words
+//! @return true if successful, false otherwise
+//---------------------------------------------------------------------------
+bool
+AttributeStore::load(QSqlDatabase& db, const WordGraph* graph)
+{
+    numWords = 0;
+    if (!graph || !graph->hasWordIds() || !db.isOpen())
+        return false;
+
+    QSqlQuery query (db);
+    query.setForwardOnly(true);
+    bool ok = query.exec("SELECT word, length, num_vowels, "
+        "num_unique_letters, point_value, num_anagrams, "
+        "probability_order0, min_probability_order0, max_probability_order0, "
+        "probability_order1, min_probability_order1, max_probability_order1, "
+        "probability_order2, min_probability_order2, max_probability_order2, "
+        "playability_order, min_playability_order, max_playability_order "
+        "FROM words");
+    if (!ok)
+        return false;
+
+    int size = graph->getNumWords();
+    lengths.fill(0, size);
+    numVowels.fill(0, size);
+    numUniqueLetters.fill(0, size);
+    pointValues.fill(0, size);
+    numAnagrams.fill(0, size);
+    OrderColumns* columns[4] = { &probabilityOrders[0],
+        &probabilityOrders[1], &probabilityOrders[2], &playabilityOrders };
+    for (int i = 0; i < 4; ++i) {
+        columns[i]->order.fill(0, size);
+        columns[i]->minOrder.fill(0, size);
+        columns[i]->maxOrder.fill(0, size);
+    }
+
+    while (query.next()) {
+        int id = graph->getWordId(query.value(0).toString());
+        if (id < 0)
+            continue;
+
+        lengths[id] = qMin(query.value(1).toInt(), 0xFF);
+        numVowels[id] = qMin(query.value(2).toInt(), 0xFF);
+        numUniqueLetters[id] = qMin(query.value(3).toInt(), 0xFF);
+        pointValues[id] = qMin(query.value(4).toInt(), 0xFF);
+        numAnagrams[id] = qMin(query.value(5).toInt(), 0xFFFF);
+
+        int placeNum = 6;
+        for (int i = 0; i < 4; ++i) {
+            columns[i]->order[id] = query.value(placeNum++).toUInt();
+            columns[i]->minOrder[id] = query.value(placeNum++).toUInt();
+            columns[i]->maxOrder[id] = query.value(placeNum++).toUInt();
+        }
+    }
+
+    numWords = size;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  getAllWords
+//
+//! Get a bit set holding every word.
+//
+//! @param bits returns the bit set, one bit per word ID
+//---------------------------------------------------------------------------
+void
+AttributeStore::getAllWords(QVector<quint32>& bits) const
+{
+    bits.fill(0xFFFFFFFFU, (numWords + 31) / 32);
+    if (numWords & 31)
+        bits.last() = (1U << (numWords & 31)) - 1;
+}
+
+//---------------------------------------------------------------------------
+//  handlesCondition
+//
+//! Determine whether a search condition can be matched against the
+//! attributes held in memory.
+//
+//! @param condition the search condition
+//! @return true if the condition can be matched, false otherwise
+//---------------------------------------------------------------------------
+bool
+AttributeStore::handlesCondition(const SearchCondition& condition)
+{
+    switch (condition.type) {
+        case SearchCondition::Length:
+        case SearchCondition::NumVowels:
+        case SearchCondition::NumUniqueLetters:
+        case SearchCondition::PointValue:
+        case SearchCondition::NumAnagrams:
+        case SearchCondition::PlayabilityOrder:
+        return true;
+
+        case SearchCondition::ProbabilityOrder:
+        return (condition.intValue >= 0) && (condition.intValue <= 2);
+
+        default:
+        return false;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  matchCondition
+//
+//! Clear the bits of the words that do not match a search condition.  The
+//! condition must be one that the store handles.
+//
+//! @param condition the search condition
+//! @param bits the bit set of words, one bit per word ID
+//---------------------------------------------------------------------------
+void
+AttributeStore::matchCondition(const SearchCondition& condition,
+                               QVector<quint32>& bits) const
+{
+    int minValue = condition.minValue;
+    int maxValue = condition.maxValue;
+    quint32* data = bits.data();
+
+    switch (condition.type) {
+        case SearchCondition::Length:
+        matchRange(lengths.constData(), numWords, minValue, maxValue, data);
+        break;
+
+        case SearchCondition::NumVowels:
+        matchRange(numVowels.constData(), numWords, minValue, maxValue,
+                   data);
+        break;
+
+        case SearchCondition::NumUniqueLetters:
+        matchRange(numUniqueLetters.constData(), numWords, minValue,
+                   maxValue, data);
+        break;
+
+        case SearchCondition::PointValue:
+        matchRange(pointValues.constData(), numWords, minValue, maxValue,
+                   data);
+        break;
+
+        case SearchCondition::NumAnagrams:
+        matchRange(numAnagrams.constData(), numWords, minValue, maxValue,
+                   data);
+        break;
+
+        case SearchCondition::ProbabilityOrder:
+        matchOrder(probabilityOrders[condition.intValue], condition, bits);
+        break;
+
+        case SearchCondition::PlayabilityOrder:
+        matchOrder(playabilityOrders, condition, bits);
+        break;
+
+        default: break;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  matchOrder
+//
+//! Clear the bits of the words whose orders are outside the range of a
+//! Probability Order or Playability Order condition.  A lax condition also
+//! keeps a word if any word of equal value is within the range.
+//
+//! @param columns the orders of the words
+//! @param condition the search condition
+//! @param bits the bit set of words, one bit per word ID
+//---------------------------------------------------------------------------
+void
+AttributeStore::matchOrder(const OrderColumns& columns,
+                           const SearchCondition& condition,
+                           QVector<quint32>& bits) const
+{
+    int minValue = condition.minValue;
+    int maxValue = condition.maxValue;
+    quint32* data = bits.data();
+
+    if (condition.boolValue) {
+        if (maxValue < minValue) {
+            bits.fill(0);
+            return;
+        }
+        matchRange(columns.maxOrder.constData(), numWords, minValue,
+                   0x7FFFFFFF, data);
+        matchRange(columns.minOrder.constData(), numWords, 0, maxValue,
+                   data);
+    }
+    else {
+        matchRange(columns.order.constData(), numWords, minValue, maxValue,
+                   data);
+    }
+}
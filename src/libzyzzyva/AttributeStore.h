@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+// AttributeStore.h
+//
+// A class for holding the numeric attributes of the words of a lexicon in
+// memory, one array per attribute.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_ATTRIBUTE_STORE_H
+#define ZYZZYVA_ATTRIBUTE_STORE_H
+
+#include "SearchCondition.h"
+#include <QSqlDatabase>
+#include <QVector>
+
+class WordGraph;
+
+class AttributeStore
+{
+    public:
+    AttributeStore() : numWords(0) { }
+    ~AttributeStore() { }
+
+    bool load(QSqlDatabase& db, const WordGraph* graph);
+    int getNumWords() const { return numWords; }
+    void getAllWords(QVector<quint32>& bits) const;
+    void matchCondition(const SearchCondition& condition,
+                        QVector<quint32>& bits) const;
+
+    static bool handlesCondition(const SearchCondition& condition);
+    static bool containsWord(const QVector<quint32>& bits, int id) {
+        return bits.at(id >> 5) & (1U << (id & 31));
+    }
+
+    private:
+    // The order of each word by some value, and the range of orders shared
+    // by words of equal value
+    class OrderColumns {
+      public:
+        QVector<quint32> order;
+        QVector<quint32> minOrder;
+        QVector<quint32> maxOrder;
+    };
+
+    void matchOrder(const OrderColumns& columns,
+                    const SearchCondition& condition,
+                    QVector<quint32>& bits) const;
+
+    // Attributes of each word, indexed by word ID
+    QVector<quint8> lengths;
+    QVector<quint8> numVowels;
+    QVector<quint8> numUniqueLetters;
+    QVector<quint8> pointValues;
+    QVector<quint16> numAnagrams;
+    OrderColumns probabilityOrders[3];
+    OrderColumns playabilityOrders;
+    int numWords;
+};
+
+#endif // ZYZZYVA_ATTRIBUTE_STORE_H
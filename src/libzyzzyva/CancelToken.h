@@ -0,0 +1,45 @@
+//---------------------------------------------------------------------------
+// CancelToken.h
+//
+// A flag for cancelling work running on another thread.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_CANCEL_TOKEN_H
+#define ZYZZYVA_CANCEL_TOKEN_H
+
+#include <QAtomicInt>
+
+// Set by one thread and polled by another, which stops its work as soon as
+// it notices.  Once cancelled, a token stays cancelled.
+class CancelToken
+{
+    public:
+    CancelToken() : cancelled(0) { }
+    ~CancelToken() { }
+
+    void cancel() { cancelled.fetchAndStoreOrdered(1); }
+    bool isCancelled() const { return cancelled != 0; }
+
+    private:
+    QAtomicInt cancelled;
+};
+
+#endif // ZYZZYVA_CANCEL_TOKEN_H
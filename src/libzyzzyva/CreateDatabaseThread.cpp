@@ -250,8 +250,6 @@ CreateDatabaseThread::insertWords(QSqlDatabase& db, int& stepNum)
     QSqlQuery transactionQuery ("BEGIN TRANSACTION", db);
     QSqlQuery query (db);
 
-    QMap<QString, qint64> numAnagramsMap;
-
     for (int length = 1; length <= MAX_WORD_LEN; ++length) {
         searchSpec.conditions[0].minValue = length;
         searchSpec.conditions[0].maxValue = length;
@@ -282,46 +280,64 @@ CreateDatabaseThread::insertWords(QSqlDatabase& db, int& stepNum)
             }
 
             QString alphagram = Auxil::getAlphagram(word);
-            if (numAnagramsMap.contains(alphagram))
-                ++numAnagramsMap[alphagram];
-            else
-                numAnagramsMap[alphagram] = 1;
 
-            int isFrontHook = wordEngine->isAcceptable(
-                lexiconName, word.right(word.length() - 1)) ? 1 : 0;
-            int isBackHook = wordEngine->isAcceptable(
-                lexiconName, word.left(word.length() - 1)) ? 1 : 0;
+            // Look up all hooks at once, with back hooks last so they can
+            // share the path of the word itself
+            QStringList hookWords;
+            hookWords << word.right(word.length() - 1);
+            foreach (const QString& letter, letters)
+                hookWords << letter + word;
+            hookWords << word.left(word.length() - 1);
+            foreach (const QString& letter, letters)
+                hookWords << word + letter;
+            QBitArray hooks = wordEngine->areAcceptable(lexiconName,
+                                                        hookWords);
+
+            int numLetters = letters.size();
+            int isFrontHook = hooks.testBit(0) ? 1 : 0;
+            int isBackHook = hooks.testBit(numLetters + 1) ? 1 : 0;
 
             QString front, back;
-            foreach (const QString& letter, letters) {
-                if (wordEngine->isAcceptable(lexiconName, letter + word))
-                    front += letter;
-                if (wordEngine->isAcceptable(lexiconName, word + letter))
-                    back += letter;
+            for (int i = 0; i < numLetters; ++i) {
+                if (hooks.testBit(i + 1))
+                    front += letters.at(i);
+                if (hooks.testBit(numLetters + i + 2))
+                    back += letters.at(i);
             }
 
             // Populate words and hooks with symbols
             QString symbolStr;
             if (!lexStyles.isEmpty()) {
+                // Look up the word and its hooks in each compare lexicon at
+                // once
+                QStringList compareWords;
+                compareWords << word;
+                for (int i = 0; i < front.length(); ++i)
+                    compareWords << front[i].toUpper() + word;
+                for (int i = 0; i < back.length(); ++i)
+                    compareWords << word + back[i].toUpper();
+
+                QList<QBitArray> compareAcceptable;
                 QListIterator<LexiconStyle> it (lexStyles);
                 while (it.hasNext()) {
-                    const LexiconStyle& style = it.next();
-                    bool acceptable =
-                        wordEngine->isAcceptable(style.compareLexicon, word);
+                    compareAcceptable.append(wordEngine->areAcceptable(
+                        it.next().compareLexicon, compareWords));
+                }
+
+                for (int j = 0; j < lexStyles.size(); ++j) {
+                    const LexiconStyle& style = lexStyles.at(j);
+                    bool acceptable = compareAcceptable.at(j).testBit(0);
                     if (!(acceptable ^ style.inCompareLexicon))
                         symbolStr += style.symbol;
                 }
 
                 // Populate front hooks with symbols
-                for (int i = 0; i < front.length(); ++i) {
-                    QChar c = front[i];
-                    QString hookWord = c.toUpper() + word;
-
-                    it.toFront();
-                    while (it.hasNext()) {
-                        const LexiconStyle& style = it.next();
-                        bool acceptable = wordEngine->isAcceptable(
-                            style.compareLexicon, hookWord);
+                int compareNum = 1;
+                for (int i = 0; i < front.length(); ++i, ++compareNum) {
+                    for (int j = 0; j < lexStyles.size(); ++j) {
+                        const LexiconStyle& style = lexStyles.at(j);
+                        bool acceptable =
+                            compareAcceptable.at(j).testBit(compareNum);
 
                         if (!(acceptable ^ style.inCompareLexicon)) {
                             front.insert(i + 1, style.symbol);
@@ -331,15 +347,11 @@ CreateDatabaseThread::insertWords(QSqlDatabase& db, int& stepNum)
                 }
 
                 // Populate back hooks with symbols
-                for (int i = 0; i < back.length(); ++i) {
-                    QChar c = back[i];
-                    QString hookWord = word + c.toUpper();
-
-                    it.toFront();
-                    while (it.hasNext()) {
-                        const LexiconStyle& style = it.next();
-                        bool acceptable = wordEngine->isAcceptable(
-                            style.compareLexicon, hookWord);
+                for (int i = 0; i < back.length(); ++i, ++compareNum) {
+                    for (int j = 0; j < lexStyles.size(); ++j) {
+                        const LexiconStyle& style = lexStyles.at(j);
+                        bool acceptable =
+                            compareAcceptable.at(j).testBit(compareNum);
 
                         if (!(acceptable ^ style.inCompareLexicon)) {
                             back.insert(i + 1, style.symbol);
@@ -377,11 +389,20 @@ CreateDatabaseThread::insertWords(QSqlDatabase& db, int& stepNum)
             ++stepNum;
         }
 
-        // Update number of anagrams
+        // Update number of anagrams, counted from the anagram index of the
+        // word graph, or by alphagram if the lexicon cannot be indexed
+        QMap<QString, qint64> numAnagramsMap;
         query.prepare("UPDATE words SET num_anagrams=? WHERE word=?");
         foreach (const QString& word, words) {
-            QString alphagram = Auxil::getAlphagram(word);
-            query.bindValue(0, numAnagramsMap[alphagram]);
+            qint64 numAnagrams = wordEngine->countAnagrams(lexiconName, word);
+            if (numAnagrams < 0) {
+                if (numAnagramsMap.isEmpty()) {
+                    foreach (const QString& w, words)
+                        ++numAnagramsMap[Auxil::getAlphagram(w)];
+                }
+                numAnagrams = numAnagramsMap.value(Auxil::getAlphagram(word));
+            }
+            query.bindValue(0, numAnagrams);
             query.bindValue(1, word);
             query.exec();
 
@@ -0,0 +1,252 @@
+//---------------------------------------------------------------------------
+// DawgBuilder.cpp
+//
+// A class for building a minimal Directed Acyclic Word Graph.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#include "DawgBuilder.h"
+
+// Edge layout of the packed DAWG, as read by WordGraph
+const int ROOT_NODE = 1;
+const qint32 V_END_OF_WORD = 23;
+const qint32 M_END_OF_WORD = (1L << V_END_OF_WORD);
+const qint32 V_END_OF_NODE = 22;
+const qint32 M_END_OF_NODE = (1L << V_END_OF_NODE);
+const qint32 V_LETTER = 24;
+const qint32 M_NODE_POINTER = 0x1FFFFFL;
+
+//---------------------------------------------------------------------------
+//  DawgBuilder
+//
+//! Constructor.
+//---------------------------------------------------------------------------
+DawgBuilder::DawgBuilder()
+{
+    nodes.resize(ROOT_NODE + 1);
+    path.append(ROOT_NODE);
+}
+
+//---------------------------------------------------------------------------
+//  addWord
+//
+//! Add a word to the graph.  Words must be added in increasing order of
+//! their letters, compared as unsigned bytes, so that each node is frozen
+//! once no later word can reach it.  A word equal to the last word added is
+//! ignored.
+//
+//! @param word the word to add
+//! @return true if successful, false if the word is empty or out of order
+//---------------------------------------------------------------------------
+bool
+DawgBuilder::addWord(const QByteArray& word)
+{
+    if (word.isEmpty() || (path.isEmpty()))
+        return false;
+
+    int length = word.length();
+    int lastLength = lastWord.length();
+    int prefixLength = 0;
+    while ((prefixLength < length) && (prefixLength < lastLength) &&
+           (word.at(prefixLength) == lastWord.at(prefixLength)))
+    {
+        ++prefixLength;
+    }
+
+    if (prefixLength == length) {
+        return (prefixLength == lastLength);
+    }
+    if ((prefixLength < lastLength) &&
+        (uchar(word.at(prefixLength)) < uchar(lastWord.at(prefixLength))))
+    {
+        return false;
+    }
+
+    freezePath(prefixLength);
+    for (int i = prefixLength; i < length; ++i) {
+        Edge edge;
+        edge.letter = word.at(i);
+        edge.eow = (i == length - 1);
+        edge.child = createNode();
+        nodes[path.at(i)].append(edge);
+        path.append(edge.child);
+    }
+
+    lastWord = word;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  finish
+//
+//! Freeze the remaining nodes and pack the graph into the edge format of a
+//! DAWG file as generated by Graham Toal's dawgutils programs.  The root
+//! node's edges start at index 1, and index 0 holds the terminal node.  No
+//! more words can be added afterward.
+//
+//! @return the packed edges, or an empty vector if no words were added or
+//! the graph is too large to be packed
+//---------------------------------------------------------------------------
+QVector<qint32>
+DawgBuilder::finish()
+{
+    QVector<qint32> edges;
+    if (path.isEmpty())
+        return edges;
+
+    freezePath(0);
+    path.clear();
+    if (nodes.at(ROOT_NODE).isEmpty())
+        return edges;
+
+    // Place the edges of each node reachable from the root, root first
+    QVector<int> offsets (nodes.size(), 0);
+    QVector<int> order;
+    order.append(ROOT_NODE);
+    offsets[ROOT_NODE] = 1;
+    int numEdges = nodes.at(ROOT_NODE).size();
+    for (int i = 0; i < order.size(); ++i) {
+        const QVector<Edge>& nodeEdges = nodes.at(order.at(i));
+        for (int j = 0; j < nodeEdges.size(); ++j) {
+            int child = nodeEdges.at(j).child;
+            if (child && !offsets.at(child)) {
+                offsets[child] = numEdges + 1;
+                numEdges += nodes.at(child).size();
+                order.append(child);
+            }
+        }
+    }
+
+    if (numEdges > M_NODE_POINTER)
+        return edges;
+
+    edges.resize(numEdges + 1);
+    edges[0] = 0;
+    for (int i = 0; i < order.size(); ++i) {
+        const QVector<Edge>& nodeEdges = nodes.at(order.at(i));
+        int offset = offsets.at(order.at(i));
+        int numNodeEdges = nodeEdges.size();
+        for (int j = 0; j < numNodeEdges; ++j) {
+            const Edge& edge = nodeEdges.at(j);
+            quint32 packed = quint32(uchar(edge.letter)) << V_LETTER;
+            if (edge.eow)
+                packed |= M_END_OF_WORD;
+            if (j == numNodeEdges - 1)
+                packed |= M_END_OF_NODE;
+            packed |= offsets.at(edge.child);
+            edges[offset + j] = qint32(packed);
+        }
+    }
+
+    return edges;
+}
+
+//---------------------------------------------------------------------------
+//  createNode
+//
+//! Create a node with no edges, reusing the number of a freed node if there
+//! is one.
+//
+//! @return the number of the new node
+//---------------------------------------------------------------------------
+int
+DawgBuilder::createNode()
+{
+    if (!freeNodes.isEmpty()) {
+        int node = freeNodes.last();
+        freeNodes.pop_back();
+        return node;
+    }
+
+    nodes.append(QVector<Edge>());
+    return nodes.size() - 1;
+}
+
+//---------------------------------------------------------------------------
+//  freezePath
+//
+//! Freeze the nodes along the last word added below a depth, replacing each
+//! with an identical frozen node if there is one.
+//
+//! @param depth the number of letters of the last word to leave unfrozen
+//---------------------------------------------------------------------------
+void
+DawgBuilder::freezePath(int depth)
+{
+    for (int i = path.size() - 1; i > depth; --i) {
+        QVector<Edge>& parentEdges = nodes[path.at(i - 1)];
+        parentEdges.last().child = freezeNode(path.at(i));
+    }
+    path.resize(depth + 1);
+}
+
+//---------------------------------------------------------------------------
+//  freezeNode
+//
+//! Freeze a node whose children are all frozen.  If an identical node is
+//! already frozen, free this node and use that one instead.
+//
+//! @param node the node to freeze
+//! @return the frozen node, or 0 if the node has no edges
+//---------------------------------------------------------------------------
+int
+DawgBuilder::freezeNode(int node)
+{
+    if (nodes.at(node).isEmpty()) {
+        freeNodes.append(node);
+        return 0;
+    }
+
+    QByteArray signature = getSignature(node);
+    int frozenNode = frozenNodes.value(signature, 0);
+    if (frozenNode) {
+        nodes[node].clear();
+        freeNodes.append(node);
+        return frozenNode;
+    }
+
+    frozenNodes.insert(signature, node);
+    return node;
+}
+
+//---------------------------------------------------------------------------
+//  getSignature
+//
+//! Describe the edges of a node, for comparing it with frozen nodes.
+//
+//! @param node the node
+//! @return the letter, end-of-word flag and child of each edge
+//---------------------------------------------------------------------------
+QByteArray
+DawgBuilder::getSignature(int node) const
+{
+    const QVector<Edge>& nodeEdges = nodes.at(node);
+    QByteArray signature;
+    signature.reserve(nodeEdges.size() * 5);
+    for (int i = 0; i < nodeEdges.size(); ++i) {
+        const Edge& edge = nodeEdges.at(i);
+        int child = edge.child;
+        signature.append(edge.letter);
+        signature.append(char((child >> 16) | (edge.eow ? 0x80 : 0)));
+        signature.append(char(child >> 8));
+        signature.append(char(child));
+    }
+    return signature;
+}
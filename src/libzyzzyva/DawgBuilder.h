@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------
+// DawgBuilder.h
+//
+// A class for building a minimal Directed Acyclic Word Graph.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_DAWG_BUILDER_H
+#define ZYZZYVA_DAWG_BUILDER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+class DawgBuilder
+{
+    public:
+    DawgBuilder();
+    ~DawgBuilder() { }
+
+    bool addWord(const QByteArray& word);
+    QVector<qint32> finish();
+
+    private:
+    class Edge {
+      public:
+        char letter;
+        bool eow;
+        int child;
+    };
+
+    int createNode();
+    void freezePath(int depth);
+    int freezeNode(int node);
+    QByteArray getSignature(int node) const;
+
+    // Nodes by number, with node 0 standing for the terminal node
+    QVector<QVector<Edge> > nodes;
+    QVector<int> freeNodes;
+
+    // Frozen nodes by the letters, end-of-word flags and children of their
+    // edges, so each distinct node is only kept once
+    QHash<QByteArray, int> frozenNodes;
+
+    // Nodes along the last word added that may still gain edges, starting
+    // with the root
+    QVector<int> path;
+    QByteArray lastWord;
+};
+
+#endif // ZYZZYVA_DAWG_BUILDER_H
@@ -449,10 +449,12 @@ JudgeDialog::judgeWord()
     QStringList words = text.split(QChar(' '));
     QStringList acceptableWords;
     QStringList unacceptableWords;
+    QBitArray acceptableBits = engine->areAcceptable(lexicon, words);
     QStringList::iterator it;
     QString wordStr;
-    for (it = words.begin(); it != words.end(); ++it) {
-        bool wordAcceptable = engine->isAcceptable(lexicon, *it);
+    int wordNum = 0;
+    for (it = words.begin(); it != words.end(); ++it, ++wordNum) {
+        bool wordAcceptable = acceptableBits.testBit(wordNum);
 
         if (wordAcceptable)
             acceptableWords.append(*it);
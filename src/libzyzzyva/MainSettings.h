@@ -84,6 +84,10 @@ class MainSettings
     static bool getSearchSelectInput() { return instance->searchSelectInput; }
     static void setSearchSelectInput(bool b) {
         instance->searchSelectInput = b; }
+    static bool getSearchUseInfixIndex() {
+        return instance->searchUseInfixIndex; }
+    static void setSearchUseInfixIndex(bool b) {
+        instance->searchUseInfixIndex = b; }
     static QString getQuizLetterOrder() { return instance->quizLetterOrder; }
     static void setQuizLetterOrder(const QString& str) {
         instance->quizLetterOrder = str; }
@@ -263,6 +267,7 @@ class MainSettings
     bool useTileTheme;
     QString tileTheme;
     bool searchSelectInput;
+    bool searchUseInfixIndex;
     QString quizLetterOrder;
     QColor quizBackgroundColor;
     bool quizUseFlashcardMode;
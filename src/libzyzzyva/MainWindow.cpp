@@ -2081,6 +2081,15 @@ MainWindow::importLexicon(const QString& lexicon)
     else
         ok = importText(lexicon, importFile);
 
+    // Index the lexicon for substring searches if requested.  A failure
+    // only leaves those searches to the database.
+    if (ok && MainSettings::getSearchUseInfixIndex()) {
+        setSplashMessage("Indexing " + lexicon + " lexicon...");
+        QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+        wordEngine->buildInfixIndex(lexicon);
+        QApplication::restoreOverrideCursor();
+    }
+
     importStems(lexicon);
 
     return ok;
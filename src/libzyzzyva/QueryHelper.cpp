@@ -0,0 +1,172 @@
+//---------------------------------------------------------------------------
+// QueryHelper.cpp
+//
+// A class for running queries against a database connection, with cached
+// prepared statements and temporary tables for word lists.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#include "QueryHelper.h"
+
+// Number of prepared statements kept for each connection
+const int MAX_PREPARED_QUERIES = 64;
+
+//---------------------------------------------------------------------------
+//  prepare
+//
+//! Get a prepared statement for an SQL string.  The statement is prepared
+//! the first time the string is seen, and reused after that, so the string
+//! should bind its values instead of containing them.  The statement
+//! belongs to the helper and must not be deleted, and it is only valid
+//! until the next call to prepare or loadWordList.
+//
+//! @param sql the SQL string
+//! @return the prepared statement, or 0 if the string cannot be prepared
+//---------------------------------------------------------------------------
+QSqlQuery*
+QueryHelper::prepare(const QString& sql)
+{
+    QSqlQuery* query = queries.value(sql);
+    if (query) {
+        query->finish();
+        return query;
+    }
+
+    if (queries.size() >= MAX_PREPARED_QUERIES) {
+        qDeleteAll(queries);
+        queries.clear();
+    }
+
+    query = new QSqlQuery(*db);
+    query->setForwardOnly(true);
+    if (!query->prepare(sql)) {
+        delete query;
+        return 0;
+    }
+
+    queries.insert(sql, query);
+    return query;
+}
+
+//---------------------------------------------------------------------------
+//  exec
+//
+//! Bind values to a prepared statement in order, and execute it.
+//
+//! @param query the prepared statement
+//! @param values the values to bind
+//! @return true if successful, false otherwise
+//---------------------------------------------------------------------------
+bool
+QueryHelper::exec(QSqlQuery* query, const QVariantList& values)
+{
+    if (!query)
+        return false;
+
+    for (int i = 0; i < values.size(); ++i)
+        query->bindValue(i, values.at(i));
+    return query->exec();
+}
+
+//---------------------------------------------------------------------------
+//  loadWordList
+//
+//! Load a list of words into a temporary table with a single word column,
+//! replacing any words loaded into it before.  Queries can join against the
+//! table instead of listing the words in the SQL string.  The table lasts
+//! as long as the connection.
+//
+//! @param listNum the number of the table, so that a query can use more
+//! than one list at once
+//! @param words the list of words
+//! @param upperCase whether to convert the words to upper case
+//! @return the name of the table, or an empty string if the words cannot be
+//! loaded
+//---------------------------------------------------------------------------
+QString
+QueryHelper::loadWordList(int listNum, const QStringList& words,
+                          bool upperCase)
+{
+    QString name = "word_list" + QString::number(listNum);
+    QString table = "temp." + name;
+
+    // Statements reading from the table would keep it locked
+    finishAll();
+
+    if (!wordLists.contains(listNum)) {
+        QSqlQuery query (*db);
+        if (!query.exec("CREATE TEMP TABLE IF NOT EXISTS " + name +
+                        " (word text PRIMARY KEY)"))
+        {
+            return QString();
+        }
+        wordLists.insert(listNum);
+    }
+
+    if (!exec(prepare("DELETE FROM " + table), QVariantList()))
+        return QString();
+
+    QSqlQuery* insertQuery =
+        prepare("INSERT OR IGNORE INTO " + table + " (word) VALUES (?)");
+    if (!insertQuery)
+        return QString();
+
+    bool transaction = db->transaction();
+    QStringListIterator it (words);
+    while (it.hasNext()) {
+        const QString& word = it.next();
+        insertQuery->bindValue(0, upperCase ? word.toUpper() : word);
+        insertQuery->exec();
+    }
+    if (transaction)
+        db->commit();
+
+    return table;
+}
+
+//---------------------------------------------------------------------------
+//  finishAll
+//
+//! Finish every prepared statement, releasing the results and locks they
+//! hold while keeping them prepared.
+//---------------------------------------------------------------------------
+void
+QueryHelper::finishAll()
+{
+    QHashIterator<QString, QSqlQuery*> it (queries);
+    while (it.hasNext()) {
+        it.next();
+        it.value()->finish();
+    }
+}
+
+//---------------------------------------------------------------------------
+//  clear
+//
+//! Delete every prepared statement.  Must be called before the connection
+//! is removed.
+//---------------------------------------------------------------------------
+void
+QueryHelper::clear()
+{
+    qDeleteAll(queries);
+    queries.clear();
+    wordLists.clear();
+}
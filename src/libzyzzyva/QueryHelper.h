@@ -0,0 +1,56 @@
+//---------------------------------------------------------------------------
+// QueryHelper.h
+//
+// A class for running queries against a database connection, with cached
+// prepared statements and temporary tables for word lists.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_QUERY_HELPER_H
+#define ZYZZYVA_QUERY_HELPER_H
+
+#include <QHash>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+class QueryHelper
+{
+    public:
+    QueryHelper(QSqlDatabase* d) : db(d) { }
+    ~QueryHelper() { clear(); }
+
+    QSqlQuery* prepare(const QString& sql);
+    bool exec(QSqlQuery* query, const QVariantList& values);
+    QString loadWordList(int listNum, const QStringList& words,
+                         bool upperCase = false);
+    void finishAll();
+    void clear();
+
+    private:
+    QSqlDatabase* db;
+    QHash<QString, QSqlQuery*> queries;
+    QSet<int> wordLists;
+};
+
+#endif // ZYZZYVA_QUERY_HELPER_H
@@ -54,7 +54,7 @@ const QString SQL_CREATE_QUESTIONS_TABLE_CURRENT =
 //---------------------------------------------------------------------------
 QuizStatsDatabase::QuizStatsDatabase(const QString& lexicon,
     const QString& quizType)
-    : db(0)
+    : db(0), queries(0)
 {
     QString dirName = Auxil::getQuizDir() + "/data/" + lexicon;
     QDir dir (dirName);
@@ -75,6 +75,7 @@ QuizStatsDatabase::QuizStatsDatabase(const QString& lexicon,
     if (!db->open())
         return;
 
+    queries = new QueryHelper(db);
     updateSchema();
 }
 
@@ -85,6 +86,7 @@ QuizStatsDatabase::QuizStatsDatabase(const QString& lexicon,
 //---------------------------------------------------------------------------
 QuizStatsDatabase::~QuizStatsDatabase()
 {
+    delete queries;
     if (db) {
         if (db->isOpen())
             db->close();
@@ -304,18 +306,13 @@ QuizStatsDatabase::addToCardbox(const QString& question, bool estimateCardbox,
 void
 QuizStatsDatabase::removeFromCardbox(const QStringList& questions)
 {
-    QStringList qlist;
-    QStringListIterator it (questions);
-    while (it.hasNext()) {
-        qlist.append("'" + it.next() + "'");
-    }
-    QString queryStr = "UPDATE questions SET cardbox=NULL, "
-        "next_scheduled=NULL WHERE question IN (" +
-        qlist.join(", ") + ")";
+    QString questionClause = getQuestionClause(questions);
+    if (questionClause.isEmpty())
+        return;
 
-    QSqlQuery query (*db);
-    query.prepare(queryStr);
-    query.exec();
+    queries->exec(queries->prepare("UPDATE questions SET cardbox=NULL, "
+        "next_scheduled=NULL WHERE " + questionClause),
+        QVariantList());
 }
 
 //---------------------------------------------------------------------------
@@ -363,34 +360,31 @@ QuizStatsDatabase::setCardbox(const QString& question, int cardbox)
 int
 QuizStatsDatabase::rescheduleCardbox(const QStringList& questions)
 {
+    if (!queries)
+        return 0;
+
     QString queryStr = "SELECT question, cardbox, next_scheduled "
         "FROM questions WHERE cardbox NOT NULL";
 
     if (!questions.isEmpty()) {
-        queryStr += " AND question IN (";
-        QStringListIterator it (questions);
-        bool firstItem = true;
-        while (it.hasNext()) {
-            QString question = it.next();
-            if (!firstItem)
-                queryStr += ", ";
-            queryStr += "'" + question + "'";
-            firstItem = false;
-        }
-        queryStr += ")";
+        QString questionClause = getQuestionClause(questions);
+        if (questionClause.isEmpty())
+            return 0;
+        queryStr += " AND " + questionClause;
     }
 
-    QSqlQuery query (*db);
-    query.prepare(queryStr);
-    query.exec();
+    QSqlQuery* query = queries->prepare(queryStr);
+    if (!queries->exec(query, QVariantList()))
+        return 0;
 
     QList<QString> selectedQuestions;
     QList<int> selectedCardboxes;
 
-    while (query.next()) {
-        selectedQuestions.append(query.value(0).toString());
-        selectedCardboxes.append(query.value(1).toInt());
+    while (query->next()) {
+        selectedQuestions.append(query->value(0).toString());
+        selectedCardboxes.append(query->value(1).toInt());
     }
+    query->finish();
 
     QSqlQuery updateQuery (*db);
     updateQuery.prepare("UPDATE questions SET next_scheduled=? "
@@ -431,43 +425,40 @@ int
 QuizStatsDatabase::shiftCardboxByBacklog(const QStringList& questions,
     int desiredBacklog)
 {
+    if (!queries)
+        return 0;
+
     QString queryStr = "SELECT question, next_scheduled "
         "FROM questions WHERE cardbox NOT NULL";
 
     if (!questions.isEmpty()) {
-        queryStr += " AND question IN (";
-        QStringListIterator it (questions);
-        bool firstItem = true;
-        while (it.hasNext()) {
-            QString question = it.next();
-            if (!firstItem)
-                queryStr += ", ";
-            queryStr += "'" + question + "'";
-            firstItem = false;
-        }
-        queryStr += ")";
+        QString questionClause = getQuestionClause(questions);
+        if (questionClause.isEmpty())
+            return 0;
+        queryStr += " AND " + questionClause;
     }
 
     queryStr += " ORDER BY next_scheduled";
 
-    QSqlQuery query (*db);
-    query.prepare(queryStr);
-    query.exec();
+    QSqlQuery* query = queries->prepare(queryStr);
+    if (!queries->exec(query, QVariantList()))
+        return 0;
 
     QList<QString> selectedQuestions;
     QList<int> selectedNextScheduled;
 
     int index = 1;
     int pegNextScheduled = 0;
-    while (query.next()) {
-        QString question = query.value(0).toString();
-        int nextScheduled = query.value(1).toInt();
+    while (query->next()) {
+        QString question = query->value(0).toString();
+        int nextScheduled = query->value(1).toInt();
         selectedQuestions.append(question);
         selectedNextScheduled.append(nextScheduled);
         if (index <= desiredBacklog)
             pegNextScheduled = nextScheduled;
         ++index;
     }
+    query->finish();
 
     unsigned int now = QDateTime::currentDateTime().toTime_t();
     int shiftSeconds = now - pegNextScheduled;
@@ -509,15 +500,10 @@ QuizStatsDatabase::shiftCardboxByDays(const QStringList& questions,
 {
     QString questionClause;
     if (!questions.isEmpty()) {
-        questionClause = " AND question IN (";
-        bool firstItem = true;
-        foreach (const QString& question, questions) {
-            if (!firstItem)
-                questionClause += ", ";
-            questionClause += "'" + question + "'";
-            firstItem = false;
-        }
-        questionClause += ")";
+        questionClause = getQuestionClause(questions);
+        if (questionClause.isEmpty())
+            return 0;
+        questionClause.prepend(" AND ");
     }
 
     int shiftSeconds = 86400 * numDays;
@@ -816,6 +802,29 @@ QuizStatsDatabase::calculateNextScheduled(int cardbox)
     return nextScheduled;
 }
 
+//---------------------------------------------------------------------------
+//  getQuestionClause
+//
+//! Load a list of questions into a temporary table, and get a predicate
+//! limiting a query to those questions.
+//
+//! @param questions the list of questions
+//! @return the predicate, or an empty string if the questions cannot be
+//! loaded
+//---------------------------------------------------------------------------
+QString
+QuizStatsDatabase::getQuestionClause(const QStringList& questions)
+{
+    if (!queries)
+        return QString();
+
+    QString table = queries->loadWordList(0, questions);
+    if (table.isEmpty())
+        return QString();
+
+    return "question IN (SELECT word FROM " + table + ")";
+}
+
 //---------------------------------------------------------------------------
 //  setQuestionData
 //
@@ -25,6 +25,7 @@
 #ifndef ZYZZYVA_QUIZ_DATABASE_H
 #define ZYZZYVA_QUIZ_DATABASE_H
 
+#include "QueryHelper.h"
 #include "Rand.h"
 #include <QMap>
 #include <QSqlDatabase>
@@ -77,12 +78,14 @@ class QuizStatsDatabase
 
     private:
     int calculateNextScheduled(int cardbox);
+    QString getQuestionClause(const QStringList& questions);
     void setQuestionData(const QString& question, const QuestionData& data,
                          bool updateCardbox);
 
     private:
     QString dbConnectionName;
     QSqlDatabase* db;
+    QueryHelper* queries;
     Rand rng;
 
     QString undoQuestion;
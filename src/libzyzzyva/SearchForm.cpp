@@ -26,6 +26,7 @@
 #include "LexiconSelectWidget.h"
 #include "MainSettings.h"
 #include "SearchSpecForm.h"
+#include "SearchThread.h"
 #include "WordEngine.h"
 #include "WordTableModel.h"
 #include "WordTableView.h"
@@ -44,6 +45,10 @@ using namespace Defs;
 
 const QString TITLE_PREFIX = "Search";
 
+// Milliseconds to collect words found by a search before adding them to the
+// results, so the results are not sorted again for every batch
+const int PENDING_WORDS_INTERVAL = 100;
+
 //---------------------------------------------------------------------------
 //  SearchForm
 //
@@ -54,7 +59,10 @@ const QString TITLE_PREFIX = "Search";
 //! @param f widget flags
 //---------------------------------------------------------------------------
 SearchForm::SearchForm(WordEngine* e, QWidget* parent, Qt::WFlags f)
-    : ActionForm(SearchFormType, parent, f), wordEngine(e)
+    : ActionForm(SearchFormType, parent, f), wordEngine(e), searchThread(0),
+      hasAnagramCondition(false), hasSubanagramCondition(false),
+      hasProbabilityCondition(false), hasPlayabilityCondition(false),
+      probNumBlanks(0)
 {
     QHBoxLayout* mainHlay = new QHBoxLayout(this);
     mainHlay->setMargin(MARGIN);
@@ -88,7 +96,7 @@ SearchForm::SearchForm(WordEngine* e, QWidget* parent, Qt::WFlags f)
 
     searchButton = new ZPushButton("&Search");
     searchButton->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
-    connect(searchButton, SIGNAL(clicked()), SLOT(search()));
+    connect(searchButton, SIGNAL(clicked()), SLOT(searchButtonClicked()));
     buttonHlay->addWidget(searchButton);
 
     resultView = new WordTableView(wordEngine);
@@ -99,12 +107,39 @@ SearchForm::SearchForm(WordEngine* e, QWidget* parent, Qt::WFlags f)
             resultView, SLOT(resizeItemsToContents()));
     resultView->setModel(resultModel);
 
+    pendingTimer.setSingleShot(true);
+    pendingTimer.setInterval(PENDING_WORDS_INTERVAL);
+    connect(&pendingTimer, SIGNAL(timeout()), SLOT(addPendingWords()));
+
     lexiconActivated(lexiconWidget->getCurrentLexicon());
 
     specChanged();
     QTimer::singleShot(0, this, SLOT(selectInputArea()));
 }
 
+//---------------------------------------------------------------------------
+//  ~SearchForm
+//
+//! Destructor.  Cancel any search still running, and wait for its thread
+//! and the threads of searches cancelled earlier to finish.
+//---------------------------------------------------------------------------
+SearchForm::~SearchForm()
+{
+    if (searchThread) {
+        disconnect(searchThread, 0, this, 0);
+        searchThread->cancel();
+        searchThread->wait();
+        QApplication::restoreOverrideCursor();
+    }
+
+    QListIterator<QPointer<SearchThread> > it (cancelledThreads);
+    while (it.hasNext()) {
+        SearchThread* cancelledThread = it.next();
+        if (cancelledThread)
+            cancelledThread->wait();
+    }
+}
+
 //---------------------------------------------------------------------------
 //  getIcon
 //
@@ -198,7 +233,8 @@ SearchForm::selectInputArea()
 //  search
 //
 //! Search for the word or pattern in the edit area, and display the results
-//! in the list box.
+//! in the list box as they are found.  The search runs on a worker thread,
+//! and any search already running is cancelled.
 //---------------------------------------------------------------------------
 void
 SearchForm::search()
@@ -207,132 +243,247 @@ SearchForm::search()
     if (spec.conditions.empty())
         return;
 
-    QString lexicon = lexiconWidget->getCurrentLexicon();
+    cancelSearch();
 
-    searchButton->setEnabled(false);
+    searchLexicon = lexiconWidget->getCurrentLexicon();
     resultModel->removeRows(0, resultModel->rowCount());
-    resultModel->setLexicon(lexicon);
+    resultModel->setLexicon(searchLexicon);
+
+    // Check for Anagram or Subanagram conditions, and only group by
+    // alphagrams if one of them is present
+    hasAnagramCondition = false;
+    hasSubanagramCondition = false;
+    hasProbabilityCondition = false;
+    hasPlayabilityCondition = false;
+    probNumBlanks = MainSettings::getProbabilityNumBlanks();
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
+        SearchCondition::SearchType type = condition.type;
+        if (!condition.negated &&
+            ((type == SearchCondition::AnagramMatch) ||
+            (type == SearchCondition::SubanagramMatch) ||
+            (type == SearchCondition::NumAnagrams)))
+        {
+            hasAnagramCondition = true;
+            if (type == SearchCondition::SubanagramMatch)
+                hasSubanagramCondition = true;
+        }
+
+        else if ((type == SearchCondition::ProbabilityOrder) ||
+            (type == SearchCondition::LimitByProbabilityOrder))
+        {
+            // Set number of blanks based on the first probability search
+            // condition
+            if (!hasProbabilityCondition)
+                probNumBlanks = condition.intValue;
+            hasProbabilityCondition = true;
+        }
+
+        else if ((type == SearchCondition::PlayabilityOrder) ||
+            (type == SearchCondition::LimitByPlayabilityOrder))
+        {
+            hasPlayabilityCondition = true;
+        }
+    }
+    resultModel->setProbabilityNumBlanks(probNumBlanks);
 
     statusString = "Searching...";
     emit statusChanged(statusString);
-    qApp->processEvents();
-
-    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-
-    QStringList wordList =
-        wordEngine->search(lexicon, specForm->getSearchSpec(), false);
-
-    if (!wordList.empty()) {
-
-        // Check for Anagram or Subanagram conditions, and only group by
-        // alphagrams if one of them is present
-        bool hasAnagramCondition = false;
-        bool hasSubanagramCondition = false;
-        bool hasProbabilityCondition = false;
-        bool hasPlayabilityCondition = false;
-        int probNumBlanks = MainSettings::getProbabilityNumBlanks();
-        QListIterator<SearchCondition> it (spec.conditions);
-        while (it.hasNext()) {
-            const SearchCondition& condition = it.next();
-            SearchCondition::SearchType type = condition.type;
-            if (!condition.negated &&
-                ((type == SearchCondition::AnagramMatch) ||
-                (type == SearchCondition::SubanagramMatch) ||
-                (type == SearchCondition::NumAnagrams)))
-            {
-                hasAnagramCondition = true;
-                if (type == SearchCondition::SubanagramMatch)
-                    hasSubanagramCondition = true;
-            }
+    emit saveEnabledChanged(false);
+
+    searchButton->setText("&Cancel");
+    QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
+
+    searchThread = wordEngine->createSearchThread(searchLexicon, spec, false);
+    connect(searchThread, SIGNAL(wordsFound(const QStringList&)),
+            SLOT(searchWordsFound(const QStringList&)));
+    connect(searchThread, SIGNAL(done(bool)), SLOT(searchDone(bool)));
+    connect(searchThread, SIGNAL(finished()),
+            searchThread, SLOT(deleteLater()));
+    searchThread->start();
+}
 
-            else if ((type == SearchCondition::ProbabilityOrder) ||
-                (type == SearchCondition::LimitByProbabilityOrder))
-            {
-                // Set number of blanks based on the first probability search
-                // condition
-                if (!hasProbabilityCondition)
-                    probNumBlanks = condition.intValue;
-                hasProbabilityCondition = true;
-            }
+//---------------------------------------------------------------------------
+//  cancelSearch
+//
+//! Cancel the search running on the worker thread, if any.  The words found
+//! so far are kept in the results.
+//---------------------------------------------------------------------------
+void
+SearchForm::cancelSearch()
+{
+    if (!searchThread)
+        return;
 
-            else if ((type == SearchCondition::PlayabilityOrder) ||
-                (type == SearchCondition::LimitByPlayabilityOrder))
-            {
-                hasPlayabilityCondition = true;
-            }
-        }
+    // Ignore anything the thread sends from now on.  The thread deletes
+    // itself once it notices it has been cancelled and finishes, and is
+    // tracked until then so the form can wait for it.
+    disconnect(searchThread, 0, this, 0);
+    searchThread->cancel();
+    cancelledThreads.removeAll(QPointer<SearchThread>());
+    cancelledThreads.append(searchThread);
+    searchThread = 0;
+
+    addPendingWords();
+    int numWords = resultModel->rowCount();
+    statusString = "Search cancelled after finding " +
+        QString::number(numWords) + " word" + (numWords == 1 ? "" : "s");
+    emit statusChanged(statusString);
+    finishSearch();
+}
 
-        // Create a list of WordItem objects from the words
-        QList<WordTableModel::WordItem> wordItems;
-        foreach (const QString& word, wordList) {
-            QString wildcard;
-            if (hasAnagramCondition) {
-                // Get wildcard characters
-                QList<QChar> wildcardChars;
-                for (int i = 0; i < word.length(); ++i) {
-                    QChar c = word[i];
-                    if (c.isLower())
-                        wildcardChars.append(c);
-                }
-                if (!wildcardChars.isEmpty()) {
-                    qSort(wildcardChars.begin(), wildcardChars.end(),
-                          Auxil::localeAwareLessThanQChar);
-                    foreach (const QChar& c, wildcardChars)
-                        wildcard.append(c.toUpper());
-                }
-            }
+//---------------------------------------------------------------------------
+//  searchButtonClicked
+//
+//! Called when the Search button is clicked.  Start a search, or cancel the
+//! search that is running.
+//---------------------------------------------------------------------------
+void
+SearchForm::searchButtonClicked()
+{
+    if (searchThread)
+        cancelSearch();
+    else
+        search();
+}
 
-            QString displayWord = word;
-            QString wordUpper = word.toUpper();
+//---------------------------------------------------------------------------
+//  searchWordsFound
+//
+//! Called when the search thread finds a batch of words.  The words are
+//! added to the results a little later, along with any other batches found
+//! in the meantime.
+//
+//! @param words the words found
+//---------------------------------------------------------------------------
+void
+SearchForm::searchWordsFound(const QStringList& words)
+{
+    if (!searchThread || (sender() != searchThread))
+        return;
 
-            // Convert to all caps if necessary
-            if (!MainSettings::getWordListLowerCaseWildcards())
-                displayWord = wordUpper;
+    pendingWords += words;
+    if (!pendingTimer.isActive())
+        pendingTimer.start();
+}
 
-            WordTableModel::WordItem wordItem
-                (displayWord, WordTableModel::WordNormal, wildcard);
+//---------------------------------------------------------------------------
+//  searchDone
+//
+//! Called when the search thread finishes its search.
+//
+//! @param success whether the search finished without being cancelled
+//---------------------------------------------------------------------------
+void
+SearchForm::searchDone(bool)
+{
+    if (!searchThread || (sender() != searchThread))
+        return;
 
-            // Set probability/playability order for correct sorting
-            if (hasProbabilityCondition) {
-                int probOrder = wordEngine->getProbabilityOrder(
-                    lexicon, wordUpper, probNumBlanks);
-                wordItem.setProbabilityOrder(probOrder);
+    searchThread = 0;
+    addPendingWords();
+    updateResultTotal(resultModel->rowCount());
+    finishSearch();
+}
+
+//---------------------------------------------------------------------------
+//  addPendingWords
+//
+//! Add the words found by the search and not yet displayed to the results.
+//---------------------------------------------------------------------------
+void
+SearchForm::addPendingWords()
+{
+    pendingTimer.stop();
+    if (pendingWords.isEmpty())
+        return;
+
+    // Create a list of WordItem objects from the words
+    QList<WordTableModel::WordItem> wordItems;
+    foreach (const QString& word, pendingWords) {
+        QString wildcard;
+        if (hasAnagramCondition) {
+            // Get wildcard characters
+            QList<QChar> wildcardChars;
+            for (int i = 0; i < word.length(); ++i) {
+                QChar c = word[i];
+                if (c.isLower())
+                    wildcardChars.append(c);
             }
-            else if (hasPlayabilityCondition) {
-                qint64 playValue = wordEngine->getPlayabilityValue(
-                    lexicon, wordUpper);
-                int playOrder = wordEngine->getPlayabilityOrder(
-                    lexicon, wordUpper);
-                wordItem.setPlayabilityValue(playValue);
-                wordItem.setPlayabilityOrder(playOrder);
+            if (!wildcardChars.isEmpty()) {
+                qSort(wildcardChars.begin(), wildcardChars.end(),
+                      Auxil::localeAwareLessThanQChar);
+                foreach (const QChar& c, wildcardChars)
+                    wildcard.append(c.toUpper());
             }
+        }
+
+        QString displayWord = word;
+        QString wordUpper = word.toUpper();
+
+        // Convert to all caps if necessary
+        if (!MainSettings::getWordListLowerCaseWildcards())
+            displayWord = wordUpper;
+
+        WordTableModel::WordItem wordItem
+            (displayWord, WordTableModel::WordNormal, wildcard);
 
-            wordItems.append(wordItem);
+        // Set probability/playability order for correct sorting
+        if (hasProbabilityCondition) {
+            int probOrder = wordEngine->getProbabilityOrder(
+                searchLexicon, wordUpper, probNumBlanks);
+            wordItem.setProbabilityOrder(probOrder);
+        }
+        else if (hasPlayabilityCondition) {
+            qint64 playValue = wordEngine->getPlayabilityValue(
+                searchLexicon, wordUpper);
+            int playOrder = wordEngine->getPlayabilityOrder(
+                searchLexicon, wordUpper);
+            wordItem.setPlayabilityValue(playValue);
+            wordItem.setPlayabilityOrder(playOrder);
         }
 
-        // FIXME: Probably not the right way to get alphabetical sorting instead
-        // of alphagram sorting
-        bool origGroupByAnagrams = MainSettings::getWordListGroupByAnagrams();
-        if (!hasAnagramCondition)
-            MainSettings::setWordListGroupByAnagrams(false);
-        if (hasSubanagramCondition)
-            MainSettings::setWordListSortByReverseLength(true);
-        if (hasProbabilityCondition)
-            MainSettings::setWordListSortByProbabilityOrder(true);
-        else if (hasPlayabilityCondition)
-            MainSettings::setWordListSortByPlayabilityOrder(true);
-        resultModel->setProbabilityNumBlanks(probNumBlanks);
-        resultModel->addWords(wordItems);
-        MainSettings::setWordListSortByPlayabilityOrder(false);
-        MainSettings::setWordListSortByProbabilityOrder(false);
-        if (hasSubanagramCondition)
-            MainSettings::setWordListSortByReverseLength(false);
-        if (!hasAnagramCondition)
-            MainSettings::setWordListGroupByAnagrams(origGroupByAnagrams);
+        wordItems.append(wordItem);
+    }
+    pendingWords.clear();
+
+    // FIXME: Probably not the right way to get alphabetical sorting instead
+    // of alphagram sorting
+    bool origGroupByAnagrams = MainSettings::getWordListGroupByAnagrams();
+    if (!hasAnagramCondition)
+        MainSettings::setWordListGroupByAnagrams(false);
+    if (hasSubanagramCondition)
+        MainSettings::setWordListSortByReverseLength(true);
+    if (hasProbabilityCondition)
+        MainSettings::setWordListSortByProbabilityOrder(true);
+    else if (hasPlayabilityCondition)
+        MainSettings::setWordListSortByPlayabilityOrder(true);
+    resultModel->addWords(wordItems);
+    MainSettings::setWordListSortByPlayabilityOrder(false);
+    MainSettings::setWordListSortByProbabilityOrder(false);
+    if (hasSubanagramCondition)
+        MainSettings::setWordListSortByReverseLength(false);
+    if (!hasAnagramCondition)
+        MainSettings::setWordListGroupByAnagrams(origGroupByAnagrams);
+
+    if (searchThread) {
+        int numWords = resultModel->rowCount();
+        statusString = "Searching... found " + QString::number(numWords) +
+            " word" + (numWords == 1 ? "" : "s") + " so far";
+        emit statusChanged(statusString);
     }
+}
 
-    updateResultTotal(wordList.size());
-    emit saveEnabledChanged(!wordList.empty());
+//---------------------------------------------------------------------------
+//  finishSearch
+//
+//! Restore the form once a search is finished or cancelled.
+//---------------------------------------------------------------------------
+void
+SearchForm::finishSearch()
+{
+    emit saveEnabledChanged(resultModel->rowCount() > 0);
 
     QWidget* focusWidget = QApplication::focusWidget();
     QLineEdit* lineEdit = dynamic_cast<QLineEdit*>(focusWidget);
@@ -343,7 +494,8 @@ SearchForm::search()
         selectInputArea();
     }
 
-    searchButton->setEnabled(true);
+    searchButton->setText("&Search");
+    specChanged();
     QApplication::restoreOverrideCursor();
 }
 
@@ -356,7 +508,7 @@ SearchForm::search()
 void
 SearchForm::specChanged()
 {
-    searchButton->setEnabled(specForm->isValid());
+    searchButton->setEnabled(searchThread || specForm->isValid());
 }
 
 //---------------------------------------------------------------------------
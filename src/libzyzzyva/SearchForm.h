@@ -29,9 +29,14 @@
 #include <QCheckBox>
 #include <QComboBox>
 #include <QLabel>
+#include <QList>
+#include <QPointer>
+#include <QStringList>
+#include <QTimer>
 
 class LexiconSelectWidget;
 class SearchSpecForm;
+class SearchThread;
 class WordEngine;
 class WordTableModel;
 class WordTableView;
@@ -42,6 +47,7 @@ class SearchForm : public ActionForm
     Q_OBJECT
     public:
     SearchForm(WordEngine* e, QWidget* parent = 0, Qt::WFlags f = 0);
+    ~SearchForm();
     QIcon getIcon() const;
     QString getTitle() const;
     QString getStatusString() const;
@@ -56,11 +62,20 @@ class SearchForm : public ActionForm
 
     public slots:
     void search();
+    void cancelSearch();
     void updateResultTotal(int num);
     void lexiconActivated(const QString& lexicon);
     void specChanged();
 
+    private slots:
+    void searchButtonClicked();
+    void searchWordsFound(const QStringList& words);
+    void searchDone(bool success);
+    void addPendingWords();
+
     private:
+    void finishSearch();
+
     WordEngine*     wordEngine;
     LexiconSelectWidget* lexiconWidget;
     SearchSpecForm* specForm;
@@ -69,6 +84,22 @@ class SearchForm : public ActionForm
     ZPushButton*    searchButton;
     QString         statusString;
     QString         detailsString;
+
+    // The search running on a worker thread, if any, with what the words it
+    // finds need to be shown, and the words waiting to be added to the
+    // results
+    SearchThread*   searchThread;
+    QString         searchLexicon;
+    bool            hasAnagramCondition;
+    bool            hasSubanagramCondition;
+    bool            hasProbabilityCondition;
+    bool            hasPlayabilityCondition;
+    int             probNumBlanks;
+    QStringList     pendingWords;
+    QTimer          pendingTimer;
+
+    // Cancelled searches whose threads have not finished and been deleted
+    QList<QPointer<SearchThread> > cancelledThreads;
 };
 
 #endif // ZYZZYVA_SEARCH_FORM_H
@@ -25,6 +25,7 @@
 #include "SearchSpec.h"
 #include "Auxil.h"
 #include "Defs.h"
+#include <QStringList>
 
 using namespace Defs;
 
@@ -78,6 +79,71 @@ SearchSpec::asXml() const
         document.toString();
 }
 
+//---------------------------------------------------------------------------
+//  asCanonicalString
+//
+//! Return a string holding every value of the search spec, such that two
+//! specs with equal strings give the same results.  Pattern, Anagram and
+//! Subanagram conditions keep their order, since the first of them decides
+//! which letters of each word are shown in lower case.  Other conditions
+//! are sorted unless the spec limits words by order, since limits apply to
+//! the words matched by the conditions before them.  Specs with different
+//! strings may still give the same results, and specs differing only in the
+//! order of their conditions should be optimized before comparing, so that
+//! any implied conditions are also the same.
+//
+//! @return the canonical string
+//---------------------------------------------------------------------------
+QString
+SearchSpec::asCanonicalString() const
+{
+    QStringList conditionStrings;
+    QStringList matchStrings;
+    QStringList otherStrings;
+    bool limited = false;
+    QListIterator<SearchCondition> it (conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
+        if ((condition.type == SearchCondition::LimitByProbabilityOrder) ||
+            (condition.type == SearchCondition::LimitByPlayabilityOrder))
+        {
+            limited = true;
+        }
+
+        // Prefix the string value with its length, so that no string value
+        // can look like the end of one condition and the start of another
+        QString conditionString = QString("%1,%2,%3,%4,%5,%6,%7:%8")
+            .arg(int(condition.type)).arg(int(condition.negated))
+            .arg(condition.minValue).arg(condition.maxValue)
+            .arg(condition.intValue).arg(int(condition.boolValue))
+            .arg(condition.stringValue.length())
+            .arg(condition.stringValue);
+        conditionStrings.append(conditionString);
+
+        switch (condition.type) {
+            case SearchCondition::PatternMatch:
+            case SearchCondition::AnagramMatch:
+            case SearchCondition::SubanagramMatch:
+            matchStrings.append(conditionString);
+            break;
+
+            default:
+            otherStrings.append(conditionString);
+            break;
+        }
+    }
+
+    // Put the match conditions first in their original order, followed by
+    // the other conditions in sorted order
+    if (!limited) {
+        otherStrings.sort();
+        conditionStrings = matchStrings + otherStrings;
+    }
+
+    return (conjunction ? QString("and;") : QString("or;")) +
+        conditionStrings.join(";");
+}
+
 //---------------------------------------------------------------------------
 //  asDomElement
 //
@@ -39,6 +39,7 @@ class SearchSpec
 
     QString asString() const;
     QString asXml() const;
+    QString asCanonicalString() const;
     QDomElement asDomElement() const;
     bool fromDomElement(const QDomElement& element);
     void optimize(const QString& lexicon);
@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------------
+// SearchThread.cpp
+//
+// A class for searching for words on a worker thread.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#include "SearchThread.h"
+#include "WordEngine.h"
+
+//---------------------------------------------------------------------------
+//  run
+//
+//! Run the search, then release the database connections the search opened
+//! for this thread.
+//---------------------------------------------------------------------------
+void
+SearchThread::run()
+{
+    wordEngine->search(lexicon, spec, allCaps, this);
+    wordEngine->releaseThreadDatabases();
+    emit done(!cancelToken.isCancelled());
+}
+
+//---------------------------------------------------------------------------
+//  addWords
+//
+//! Called by the word engine from the search thread with each batch of
+//! words found.  Pass the words on to receivers of the wordsFound signal,
+//! unless the search has been cancelled.
+//
+//! @param words the words found
+//---------------------------------------------------------------------------
+void
+SearchThread::addWords(const QStringList& words)
+{
+    if (words.isEmpty() || cancelToken.isCancelled())
+        return;
+
+    numWords += words.size();
+    emit wordsFound(words);
+}
+
+//---------------------------------------------------------------------------
+//  cancel
+//
+//! Cancel the search.  The search stops soon after, and no more words are
+//! passed on once this is called.
+//---------------------------------------------------------------------------
+void
+SearchThread::cancel()
+{
+    cancelToken.cancel();
+}
@@ -0,0 +1,69 @@
+//---------------------------------------------------------------------------
+// SearchThread.h
+//
+// A class for searching for words on a worker thread.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_SEARCH_THREAD_H
+#define ZYZZYVA_SEARCH_THREAD_H
+
+#include "CancelToken.h"
+#include "SearchSpec.h"
+#include <QStringList>
+#include <QThread>
+
+class WordEngine;
+
+class SearchThread : public QThread
+{
+    Q_OBJECT
+    public:
+    SearchThread(WordEngine* e, const QString& lex, const SearchSpec& s,
+                 bool caps, QObject* parent = 0)
+        : QThread(parent), wordEngine(e), lexicon(lex), spec(s),
+          allCaps(caps), numWords(0) { }
+    ~SearchThread() { }
+
+    const CancelToken* getCancelToken() const { return &cancelToken; }
+    bool getCancelled() const { return cancelToken.isCancelled(); }
+    int getNumWords() const { return numWords; }
+    void addWords(const QStringList& words);
+
+    public slots:
+    void cancel();
+
+    signals:
+    void wordsFound(const QStringList& words);
+    void done(bool success);
+
+    protected:
+    void run();
+
+    private:
+    WordEngine* wordEngine;
+    QString lexicon;
+    SearchSpec spec;
+    bool allCaps;
+    CancelToken cancelToken;
+    int numWords;
+};
+
+#endif // ZYZZYVA_SEARCH_THREAD_H
@@ -213,6 +213,10 @@ SettingsDialog::SettingsDialog(QWidget* parent, Qt::WFlags f)
     searchSelectInputCbox = new QCheckBox("Highlight input after search");
     searchPrefVlay->addWidget(searchSelectInputCbox);
 
+    searchUseInfixIndexCbox = new QCheckBox("Index lexicons for faster "
+        "substring searches when loading them (uses more memory)");
+    searchPrefVlay->addWidget(searchUseInfixIndexCbox);
+
     searchPrefVlay->addStretch(2);
 
     // Quiz Prefs
@@ -768,6 +772,8 @@ SettingsDialog::refreshSettings()
 
     // Search
     searchSelectInputCbox->setChecked(MainSettings::getSearchSelectInput());
+    searchUseInfixIndexCbox->setChecked(
+        MainSettings::getSearchUseInfixIndex());
 
     // Quiz letter order
     int letterOrderIndex =
@@ -902,6 +908,8 @@ SettingsDialog::writeSettings()
     MainSettings::setUseTileTheme(themeCbox->isChecked());
     MainSettings::setTileTheme(themeCombo->currentText());
     MainSettings::setSearchSelectInput(searchSelectInputCbox->isChecked());
+    MainSettings::setSearchUseInfixIndex(
+        searchUseInfixIndexCbox->isChecked());
     MainSettings::setQuizLetterOrder(letterOrderCombo->currentText());
     MainSettings::setQuizBackgroundColor(quizBackgroundColor);
     MainSettings::setQuizUseFlashcardMode(
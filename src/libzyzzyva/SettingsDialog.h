@@ -104,6 +104,7 @@ class SettingsDialog : public QDialog
     QComboBox*   themeCombo;
     QComboBox*   letterOrderCombo;
     QCheckBox*   searchSelectInputCbox;
+    QCheckBox*   searchUseInfixIndexCbox;
     QLineEdit*   quizBackgroundColorLine;
     QCheckBox*   quizUseFlashcardModeCbox;
     QCheckBox*   quizShowNumResponsesCbox;
@@ -26,13 +26,18 @@
 #include "LetterBag.h"
 #include "Auxil.h"
 #include "Defs.h"
+#include "SearchThread.h"
 #include <QApplication>
 #include <QFile>
+#include <QMutexLocker>
 #include <QRegExp>
+#include <QSet>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
 #include <QVariant>
 #include <QVector>
+#include <cmath>
 
 using namespace Defs;
 
@@ -44,20 +49,323 @@ const QString WordEngine::DEF_DISPLAY_SEP = " / ";
 
 const int LIMIT_RANGE_MAX = 999999;
 
+// Number of words whose information is cached for each lexicon
+const int WORD_CACHE_SIZE = 65536;
+
+// Number of bytes of search results cached for each lexicon
+const int SEARCH_CACHE_BYTES = 16 * 1024 * 1024;
+
+// Number of words passed to a search thread at once, and number of rows
+// read or words checked between checks of whether a search is cancelled
+const int SEARCH_BATCH_SIZE = 1000;
+const int CANCEL_CHECK_INTERVAL = 256;
+
+// Relative costs used by the search planner, roughly in microseconds: a
+// node visited by a graph traversal, a word checked against the graph, a
+// block of 32 words scanned in the attribute store, a word looked up in the
+// attribute store, a database query, a row read or loaded by a database
+// query, a word checked against post conditions, and a result word created
+const double GRAPH_VISIT_COST = 0.3;
+const double GRAPH_CHECK_COST = 1.0;
+const double ATTRIBUTE_BLOCK_COST = 0.1;
+const double ATTRIBUTE_LOOKUP_COST = 0.5;
+const double DATABASE_QUERY_COST = 1000.0;
+const double DATABASE_ROW_COST = 3.0;
+const double POST_CONDITION_COST = 5.0;
+const double RESULT_WORD_COST = 0.5;
+
 //---------------------------------------------------------------------------
 //  clearCache
 //
-//! Clear the word information cache for a lexicon.
+//! Clear the word information cache and the attribute store for a lexicon,
+//! and the search results cached for every lexicon.  All of them persist
+//! across searches, so they are only cleared when the lexicon's words or
+//! database change.  Searches of one lexicon can depend on another through
+//! In Lexicon conditions, so no cached search results are kept.
 //
 //! @param lexicon the name of the lexicon
 //---------------------------------------------------------------------------
 void
 WordEngine::clearCache(const QString& lexicon) const
 {
+    clearSearchCaches();
     if (!lexiconData.contains(lexicon))
         return;
 
-    lexiconData[lexicon]->wordCache.clear();
+    QMutexLocker locker (&mutex);
+    LexiconData* lexData = lexiconData[lexicon];
+    lexData->wordCache.clear();
+    delete lexData->attributes;
+    lexData->attributes = 0;
+    lexData->attributesFailed = false;
+}
+
+//---------------------------------------------------------------------------
+//  clearSearchCaches
+//
+//! Clear the search results cached for every lexicon.  The hit and miss
+//! counts are kept.
+//---------------------------------------------------------------------------
+void
+WordEngine::clearSearchCaches() const
+{
+    QMutexLocker locker (&mutex);
+    QMapIterator<QString, LexiconData*> it (lexiconData);
+    while (it.hasNext()) {
+        it.next();
+        it.value()->searchCache.clear();
+    }
+}
+
+//---------------------------------------------------------------------------
+//  getCacheHits
+//
+//! Get the number of word information lookups for a lexicon that were
+//! answered from the cache.
+//
+//! @param lexicon the name of the lexicon
+//! @return the number of cache hits
+//---------------------------------------------------------------------------
+qint64
+WordEngine::getCacheHits(const QString& lexicon) const
+{
+    QMutexLocker locker (&mutex);
+    if (!lexiconData.contains(lexicon))
+        return 0;
+
+    return lexiconData[lexicon]->wordCache.hits;
+}
+
+//---------------------------------------------------------------------------
+//  getCacheMisses
+//
+//! Get the number of word information lookups for a lexicon that were not
+//! answered from the cache.
+//
+//! @param lexicon the name of the lexicon
+//! @return the number of cache misses
+//---------------------------------------------------------------------------
+qint64
+WordEngine::getCacheMisses(const QString& lexicon) const
+{
+    QMutexLocker locker (&mutex);
+    if (!lexiconData.contains(lexicon))
+        return 0;
+
+    return lexiconData[lexicon]->wordCache.misses;
+}
+
+//---------------------------------------------------------------------------
+//  getSearchCacheHits
+//
+//! Get the number of searches of a lexicon that were answered from the
+//! search cache.
+//
+//! @param lexicon the name of the lexicon
+//! @return the number of cache hits
+//---------------------------------------------------------------------------
+qint64
+WordEngine::getSearchCacheHits(const QString& lexicon) const
+{
+    QMutexLocker locker (&mutex);
+    if (!lexiconData.contains(lexicon))
+        return 0;
+
+    return lexiconData[lexicon]->searchCache.hits;
+}
+
+//---------------------------------------------------------------------------
+//  getSearchCacheMisses
+//
+//! Get the number of searches of a lexicon that were not answered from the
+//! search cache.
+//
+//! @param lexicon the name of the lexicon
+//! @return the number of cache misses
+//---------------------------------------------------------------------------
+qint64
+WordEngine::getSearchCacheMisses(const QString& lexicon) const
+{
+    QMutexLocker locker (&mutex);
+    if (!lexiconData.contains(lexicon))
+        return 0;
+
+    return lexiconData[lexicon]->searchCache.misses;
+}
+
+//---------------------------------------------------------------------------
+//  getSearchCacheBytes
+//
+//! Get the approximate number of bytes used by the search results cached
+//! for a lexicon.
+//
+//! @param lexicon the name of the lexicon
+//! @return the number of bytes
+//---------------------------------------------------------------------------
+int
+WordEngine::getSearchCacheBytes(const QString& lexicon) const
+{
+    QMutexLocker locker (&mutex);
+    if (!lexiconData.contains(lexicon))
+        return 0;
+
+    return lexiconData[lexicon]->searchCache.getNumBytes();
+}
+
+//---------------------------------------------------------------------------
+//  SearchCache::SearchCache
+//
+//! Constructor.
+//---------------------------------------------------------------------------
+WordEngine::SearchCache::SearchCache()
+    : hits(0), misses(0)
+{
+    cache.setMaxCost(SEARCH_CACHE_BYTES);
+}
+
+//---------------------------------------------------------------------------
+//  SearchCache::find
+//
+//! Find the results of a search in the cache, marking them as recently
+//! used.
+//
+//! @param key the canonical string of the optimized search spec
+//! @param words returns the words found by the search
+//! @return true if the results are cached, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordEngine::SearchCache::find(const QString& key, QStringList& words)
+{
+    const QStringList* cached = cache.object(key);
+    if (!cached) {
+        ++misses;
+        return false;
+    }
+
+    ++hits;
+    words = *cached;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  SearchCache::insert
+//
+//! Add the results of a search to the cache.  Each result is charged for the
+//! characters of its key and words plus a fixed overhead per string, and
+//! least recently used results are evicted until the cache fits its size.
+//! Results larger than the whole cache are not kept.
+//
+//! @param key the canonical string of the optimized search spec
+//! @param words the words found by the search
+//---------------------------------------------------------------------------
+void
+WordEngine::SearchCache::insert(const QString& key, const QStringList& words)
+{
+    const int STRING_OVERHEAD = 32;
+    qint64 numBytes = STRING_OVERHEAD + (key.length() * sizeof(QChar));
+    QStringListIterator it (words);
+    while (it.hasNext())
+        numBytes += STRING_OVERHEAD + (it.next().length() * sizeof(QChar));
+
+    if (numBytes > cache.maxCost())
+        return;
+
+    cache.insert(key, new QStringList(words), int(numBytes));
+}
+
+//---------------------------------------------------------------------------
+//  WordCache::clear
+//
+//! Remove all words from the cache.  The hit and miss counts are kept.
+//---------------------------------------------------------------------------
+void
+WordEngine::WordCache::clear()
+{
+    entries.clear();
+    entryIds.clear();
+    referenced.clear();
+    entrySlots.clear();
+    hand = 0;
+}
+
+//---------------------------------------------------------------------------
+//  WordCache::find
+//
+//! Find the information about a word in the cache, marking the word as
+//! recently used.
+//
+//! @param id the ID of the word
+//! @return the information, or 0 if the word is not cached
+//---------------------------------------------------------------------------
+const WordEngine::WordInfo*
+WordEngine::WordCache::find(int id)
+{
+    if (!contains(id)) {
+        ++misses;
+        return 0;
+    }
+
+    ++hits;
+    int slot = entrySlots.at(id);
+    referenced[slot] = true;
+    return &entries.at(slot);
+}
+
+//---------------------------------------------------------------------------
+//  WordCache::insert
+//
+//! Add information about a word to the cache.  Once the cache is full, the
+//! clock hand sweeps the entries, sparing those used since it last passed
+//! them, and the first entry not used is replaced.
+//
+//! @param id the ID of the word
+//! @param info the information about the word
+//---------------------------------------------------------------------------
+void
+WordEngine::WordCache::insert(int id, const WordInfo& info)
+{
+    if (id < 0)
+        return;
+
+    if (id >= entrySlots.size()) {
+        int oldSize = entrySlots.size();
+        entrySlots.resize(id + 1);
+        for (int i = oldSize; i <= id; ++i)
+            entrySlots[i] = -1;
+    }
+
+    int slot = entrySlots.at(id);
+    if (slot < 0) {
+        if (entries.size() < WORD_CACHE_SIZE) {
+            slot = entries.size();
+            entries.append(info);
+            entryIds.append(id);
+            referenced.append(false);
+        }
+        else {
+            while (referenced.at(hand)) {
+                referenced[hand] = false;
+                hand = (hand + 1) % entries.size();
+            }
+            slot = hand;
+            hand = (hand + 1) % entries.size();
+            entrySlots[entryIds.at(slot)] = -1;
+            entryIds[slot] = id;
+            referenced[slot] = false;
+        }
+        entrySlots[id] = slot;
+    }
+    entries[slot] = info;
+}
+
+//---------------------------------------------------------------------------
+//  ~WordEngine
+//
+//! Destructor.  Stop any search still running on a search thread.
+//---------------------------------------------------------------------------
+WordEngine::~WordEngine()
+{
+    stopSearchThreads();
 }
 
 //---------------------------------------------------------------------------
@@ -77,6 +385,8 @@ WordEngine::connectToDatabase(const QString& lexicon, const QString& filename,
     if (!lexiconData.contains(lexicon))
         return false;
 
+    stopSearchThreads();
+
     Rand rng;
     rng.srand(QDateTime::currentDateTime().toTime_t(), Auxil::getPid());
     unsigned int r = rng.rand();
@@ -98,7 +408,9 @@ WordEngine::connectToDatabase(const QString& lexicon, const QString& filename,
 
     LexiconData* data = lexiconData[lexicon];
     data->db = db;
+    data->queries = new QueryHelper(db);
     data->dbConnectionName = dbConnectionName;
+    clearCache(lexicon);
     return true;
 }
 
@@ -121,10 +433,25 @@ WordEngine::disconnectFromDatabase(const QString& lexicon)
     if (!db || !db->isOpen() || dbConnectionName.isEmpty())
         return true;
 
+    // Close the connections cloned for other threads along with the
+    // lexicon's own, once no search thread can be using them
+    stopSearchThreads();
+    QMap<QThread*, ThreadDatabase>& threadDatabases =
+        lexiconData[lexicon]->threadDatabases;
+    foreach (const ThreadDatabase& threadDb, threadDatabases) {
+        delete threadDb.queries;
+        delete threadDb.db;
+        QSqlDatabase::removeDatabase(threadDb.connectionName);
+    }
+    threadDatabases.clear();
+
+    delete lexiconData[lexicon]->queries;
+    lexiconData[lexicon]->queries = 0;
     delete db;
     lexiconData[lexicon]->db = 0;
     QSqlDatabase::removeDatabase(dbConnectionName);
     lexiconData[lexicon]->dbConnectionName.clear();
+    clearCache(lexicon);
     return true;
 }
 
@@ -142,6 +469,85 @@ WordEngine::databaseIsConnected(const QString& lexicon) const
     return (lexiconData.contains(lexicon) && lexiconData[lexicon]->db);
 }
 
+//---------------------------------------------------------------------------
+//  getThreadDatabase
+//
+//! Get the database connection of a lexicon for use by the calling thread.
+//! The engine's own thread uses the lexicon's connection.  Other threads
+//! each get their own connection to the same database, opened the first
+//! time they need it and kept until they release it with
+//! releaseThreadDatabases.
+//
+//! @param lexicon the name of the lexicon
+//! @return the connection, with a null database if the lexicon has no open
+//! database or it cannot be opened again
+//---------------------------------------------------------------------------
+WordEngine::ThreadDatabase
+WordEngine::getThreadDatabase(const QString& lexicon) const
+{
+    ThreadDatabase threadDb;
+    LexiconData* lexData = lexiconData.value(lexicon);
+    if (!lexData || !lexData->db || !lexData->db->isOpen())
+        return threadDb;
+
+    QThread* currentThread = QThread::currentThread();
+    if (currentThread == thread()) {
+        threadDb.db = lexData->db;
+        threadDb.queries = lexData->queries;
+        return threadDb;
+    }
+
+    QMutexLocker locker (&mutex);
+    if (lexData->threadDatabases.contains(currentThread))
+        return lexData->threadDatabases.value(currentThread);
+
+    QString connectionName = lexData->dbConnectionName + "_thread_" +
+        QString::number(quintptr(currentThread), 16);
+    QSqlDatabase* db = new QSqlDatabase(
+        QSqlDatabase::cloneDatabase(*lexData->db, connectionName));
+    if (!db->open()) {
+        delete db;
+        QSqlDatabase::removeDatabase(connectionName);
+        return threadDb;
+    }
+
+    threadDb.db = db;
+    threadDb.queries = new QueryHelper(db);
+    threadDb.connectionName = connectionName;
+    lexData->threadDatabases.insert(currentThread, threadDb);
+    return threadDb;
+}
+
+//---------------------------------------------------------------------------
+//  releaseThreadDatabases
+//
+//! Close the database connections opened for the calling thread.  Must be
+//! called by any thread other than the engine's own that searches a
+//! lexicon with a database, before the thread finishes.
+//---------------------------------------------------------------------------
+void
+WordEngine::releaseThreadDatabases() const
+{
+    QThread* currentThread = QThread::currentThread();
+    if (currentThread == thread())
+        return;
+
+    QMutexLocker locker (&mutex);
+    QMapIterator<QString, LexiconData*> it (lexiconData);
+    while (it.hasNext()) {
+        it.next();
+        LexiconData* lexData = it.value();
+        if (!lexData->threadDatabases.contains(currentThread))
+            continue;
+
+        ThreadDatabase threadDb =
+            lexData->threadDatabases.take(currentThread);
+        delete threadDb.queries;
+        delete threadDb.db;
+        QSqlDatabase::removeDatabase(threadDb.connectionName);
+    }
+}
+
 //---------------------------------------------------------------------------
 //  importTextFile
 //
@@ -158,9 +564,14 @@ int
 WordEngine::importTextFile(const QString& lexicon, const QString& filename,
                            bool loadDefinitions, QString* errString)
 {
-    // Delete old word graph if it exists
-    if (lexiconData.contains(lexicon))
+    stopSearchThreads();
+
+    // Delete old word graph if it exists, along with the cached word
+    // information indexed by its word IDs
+    if (lexiconData.contains(lexicon)) {
         delete lexiconData[lexicon]->graph;
+        clearCache(lexicon);
+    }
     else
         lexiconData[lexicon] = new LexiconData;
 
@@ -178,6 +589,8 @@ WordEngine::importTextFile(const QString& lexicon, const QString& filename,
     }
 
     int imported = 0;
+    QStringList words;
+    QSet<QString> seenWords;
     char* buffer = new char[MAX_INPUT_LINE_LEN];
     while (file.readLine(buffer, MAX_INPUT_LINE_LEN) > 0) {
         QString line (buffer);
@@ -186,12 +599,11 @@ WordEngine::importTextFile(const QString& lexicon, const QString& filename,
             continue;
         QString word = line.section(' ', 0, 0).toUpper();
 
-        if (!graph->containsWord(word)) {
-            QString alpha = Auxil::getAlphagram(word);
-            ++lexiconData[lexicon]->numAnagramsMap[alpha];
+        if (!seenWords.contains(word)) {
+            seenWords.insert(word);
+            words.append(word);
         }
 
-        graph->addWord(word);
         if (loadDefinitions) {
             QString definition = line.section(' ', 1);
             addDefinition(lexicon, word, definition);
@@ -200,6 +612,15 @@ WordEngine::importTextFile(const QString& lexicon, const QString& filename,
     }
 
     delete[] buffer;
+
+    // Pack the words into a DAWG so they are searched like a DAWG lexicon,
+    // falling back to the old-style graph if they cannot be packed
+    if (!graph->importWords(words)) {
+        foreach (const QString& word, words)
+            graph->addWord(word);
+    }
+
+    collectStats(lexicon);
     return imported;
 }
 
@@ -220,6 +641,8 @@ WordEngine::importDawgFile(const QString& lexicon, const QString& filename,
                            bool reverse, QString* errString, quint16*
                            expectedChecksum)
 {
+    stopSearchThreads();
+
     if (!lexiconData.contains(lexicon)) {
         lexiconData[lexicon] = new LexiconData;
         lexiconData[lexicon]->graph = new WordGraph;
@@ -228,9 +651,33 @@ WordEngine::importDawgFile(const QString& lexicon, const QString& filename,
     WordGraph* graph = lexiconData[lexicon]->graph;
     bool ok = graph->importDawgFile(filename, reverse, errString,
                                     expectedChecksum);
+    if (!reverse) {
+        clearCache(lexicon);
+        collectStats(lexicon);
+    }
     return ok;
 }
 
+//---------------------------------------------------------------------------
+//  buildInfixIndex
+//
+//! Build the infix index of a lexicon's word graph, so that Pattern matches
+//! of the form *core* are searched from the core instead of through every
+//! word.  Must be called after the lexicon is imported.
+//
+//! @param lexicon the name of the lexicon
+//! @return true if successful, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordEngine::buildInfixIndex(const QString& lexicon)
+{
+    if (!lexiconData.contains(lexicon))
+        return false;
+
+    stopSearchThreads();
+    return lexiconData[lexicon]->graph->buildInfixIndex();
+}
+
 //---------------------------------------------------------------------------
 //  importStems
 //
@@ -251,6 +698,8 @@ WordEngine::importStems(const QString& lexicon, const QString& filename,
     if (!lexiconData.contains(lexicon))
         return 0;
 
+    stopSearchThreads();
+
     QFile file (filename);
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         if (errString) {
@@ -263,7 +712,7 @@ WordEngine::importStems(const QString& lexicon, const QString& filename,
     // XXX: At some point, may want to consider allowing words of varying
     // lengths to be in the same file?
     QStringList words;
-    QSet<QString> alphagrams;
+    QSet<WordKey> alphagrams;
     int imported = 0;
     int length = 0;
     char* buffer = new char[MAX_INPUT_LINE_LEN];
@@ -281,7 +730,7 @@ WordEngine::importStems(const QString& lexicon, const QString& filename,
             continue;
 
         words << word;
-        alphagrams.insert(Auxil::getAlphagram(word));
+        alphagrams.insert(WordKey(word).getAlphagram());
         ++imported;
     }
     delete[] buffer;
@@ -290,15 +739,114 @@ WordEngine::importStems(const QString& lexicon, const QString& filename,
     LexiconData* data = lexiconData[lexicon];
     data->stems[length] += words;
     data->stemAlphagrams[length].unite(alphagrams);
+
+    // Stems change the words matched by the Type I Sevens and Eights groups
+    clearSearchCaches();
     return imported;
 }
 
+//---------------------------------------------------------------------------
+//  getAttributeStore
+//
+//! Get the attribute store of a lexicon, loading it from the database the
+//! first time it is needed.  The store is indexed by word ID, so it is only
+//! available if the lexicon's word graph can number its words.
+//
+//! @param lexicon the name of the lexicon
+//! @return the attribute store, or 0 if it is not available
+//---------------------------------------------------------------------------
+const AttributeStore*
+WordEngine::getAttributeStore(const QString& lexicon) const
+{
+    const LexiconData* lexData = lexiconData.value(lexicon);
+    if (!lexData)
+        return 0;
+
+    QMutexLocker locker (&mutex);
+    if (lexData->attributes || lexData->attributesFailed)
+        return lexData->attributes;
+
+    const WordGraph* graph = lexData->graph;
+    QSqlDatabase* db = getThreadDatabase(lexicon).db;
+    if (!graph || !graph->hasWordIds() || !db)
+        return 0;
+
+    AttributeStore* attributes = new AttributeStore;
+    if (!attributes->load(*db, graph)) {
+        delete attributes;
+        lexData->attributesFailed = true;
+        return 0;
+    }
+
+    lexData->attributes = attributes;
+    return attributes;
+}
+
+//---------------------------------------------------------------------------
+//  attributeSearch
+//
+//! Scan the attribute store for words matching the conditions in a search
+//! spec that the store handles.  If a word list is provided, also ensure
+//! that result words are in that list.
+//
+//! @param lexicon the name of the lexicon
+//! @param optimizedSpec the search spec
+//! @param wordList optional list of words that results must be in
+//! @return a list of words matching the search spec
+//---------------------------------------------------------------------------
+QStringList
+WordEngine::attributeSearch(const QString& lexicon, const SearchSpec&
+                            optimizedSpec, const QStringList* wordList) const
+{
+    const AttributeStore* attributes = getAttributeStore(lexicon);
+    if (!attributes)
+        return QStringList();
+
+    QVector<quint32> bits;
+    attributes->getAllWords(bits);
+    QListIterator<SearchCondition> cit (optimizedSpec.conditions);
+    while (cit.hasNext()) {
+        const SearchCondition& condition = cit.next();
+        if (AttributeStore::handlesCondition(condition))
+            attributes->matchCondition(condition, bits);
+    }
+
+    // Keep the words of the list that are in the bit set, or list every
+    // word in the bit set by word ID
+    const WordGraph* graph = lexiconData[lexicon]->graph;
+    QStringList resultList;
+    if (wordList) {
+        QStringListIterator it (*wordList);
+        while (it.hasNext()) {
+            const QString& word = it.next();
+            int id = graph->getWordId(word.toUpper());
+            if ((id >= 0) && AttributeStore::containsWord(bits, id))
+                resultList.append(word);
+        }
+    }
+    else {
+        for (int block = 0; block < bits.size(); ++block) {
+            quint32 blockBits = bits.at(block);
+            for (int i = 0; blockBits; ++i, blockBits >>= 1) {
+                if (!(blockBits & 1))
+                    continue;
+                WordKey word = graph->getWordById((block * 32) + i);
+                if (word.isValid())
+                    resultList.append(word.toString());
+            }
+        }
+    }
+
+    return resultList;
+}
+
 //---------------------------------------------------------------------------
 //  databaseSearch
 //
 //! Search the database for words matching the conditions in a search spec.
 //! If a word list is provided, also ensure that result words are in that
-//! list.
+//! list.  Every condition is matched, so the spec should only hold
+//! conditions planned for the database.
 //
 //! @param lexicon the name of the lexicon
 //! @param optimizedSpec the search spec
@@ -307,21 +855,24 @@ WordEngine::importStems(const QString& lexicon, const QString& filename,
 //---------------------------------------------------------------------------
 QStringList
 WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
-                           optimizedSpec, const QStringList* wordList) const
+                           optimizedSpec, const QStringList* wordList,
+                           const CancelToken* cancelToken) const
 {
-    if (!lexiconData.contains(lexicon) || !lexiconData[lexicon]->db)
+    QueryHelper* queries = getThreadDatabase(lexicon).queries;
+    if (!queries)
         return QStringList();
 
-    // Build SQL query string
+    // Build SQL query string.  Values are bound rather than pasted into the
+    // string, and word lists are loaded into temporary tables, so that
+    // searches of the same kind share a prepared statement.
     QSet<QString> tables;
     QString whereStr;
+    QVariantList bindValues;
+    int numWordLists = 0;
     bool foundCondition = false;
     QListIterator<SearchCondition> cit (optimizedSpec.conditions);
     while (cit.hasNext()) {
         SearchCondition condition = cit.next();
-        if (getConditionPhase(condition) != DatabasePhase)
-            continue;
-
         if (foundCondition)
             whereStr += " AND";
         foundCondition = true;
@@ -335,7 +886,8 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
                 whereStr += " words.word";
                 if (condition.negated)
                     whereStr += " NOT";
-                whereStr += " LIKE '" + str + "'";
+                whereStr += " LIKE ?";
+                bindValues.append(str);
             }
             break;
 
@@ -351,9 +903,6 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
                 // ### replace * with % and ? with _ for more flexible search
                 // tricky to get right
 
-                str.replace("'", "''");
-                str.replace(";", "\\;");
-
                 QString notStr;
                 QString conjStr = " OR";
                 if (condition.negated) {
@@ -362,16 +911,21 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
                 }
 
                 QString whereSecondStr;
+                QString secondStr;
                 if (condition.type == SearchCondition::PartOfSpeech) {
                     whereSecondStr = conjStr +
                         " words.definition" + notStr +
-                        " LIKE '\%[" + str + "]\%' ESCAPE '\\'";
+                        " LIKE ? ESCAPE '\\'";
+                    secondStr = "%[" + str + "]%";
                     str = "[" + str + " ";
                 }
 
                 whereStr +=
                     " words.definition" + notStr +
-                    " LIKE '\%" + str + "\%' ESCAPE '\\'" + whereSecondStr;
+                    " LIKE ? ESCAPE '\\'" + whereSecondStr;
+                bindValues.append("%" + str + "%");
+                if (!secondStr.isEmpty())
+                    bindValues.append(secondStr);
             }
             break;
 
@@ -389,22 +943,21 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
 
                 // Lax boundaries
                 if (condition.boolValue) {
-                    whereStr += QString(" words.max_%1>=").arg(col) +
-                        QString::number(condition.minValue) +
-                        QString(" AND words.min_%1<=").arg(col) +
-                        QString::number(condition.maxValue);
+                    whereStr += QString(" words.max_%1>=?").arg(col) +
+                        QString(" AND words.min_%1<=?").arg(col);
+                    bindValues.append(condition.minValue);
+                    bindValues.append(condition.maxValue);
                 }
                 // Strict boundaries
                 else {
                     whereStr += QString(" words.%1").arg(col);
+                    bindValues.append(condition.minValue);
                     if (condition.minValue == condition.maxValue) {
-                        whereStr += "=" + QString::number(condition.minValue);
+                        whereStr += "=?";
                     }
                     else {
-                        whereStr += ">=" +
-                            QString::number(condition.minValue) +
-                            QString(" AND words.%1<=").arg(col) +
-                            QString::number(condition.maxValue);
+                        whereStr += QString(">=? AND words.%1<=?").arg(col);
+                        bindValues.append(condition.maxValue);
                     }
                 }
             }
@@ -429,13 +982,13 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
                     column = "words.num_anagrams";
 
                 whereStr += " " + column;
+                bindValues.append(condition.minValue);
                 if (condition.minValue == condition.maxValue) {
-                    whereStr += "=" + QString::number(condition.minValue);
+                    whereStr += "=?";
                 }
                 else {
-                    whereStr += ">=" + QString::number(condition.minValue) +
-                        " AND " + column + "<=" +
-                        QString::number(condition.maxValue);
+                    whereStr += ">=? AND " + column + "<=?";
+                    bindValues.append(condition.maxValue);
                 }
             }
             break;
@@ -457,12 +1010,13 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
                     whereStr += " word";
                     if (condition.negated)
                         whereStr += " NOT";
-                    whereStr += " LIKE '%";
+                    whereStr += " LIKE ?";
+                    QString likeStr = "%";
                     int count = condition.negated ? 1 : it.value();
                     for (int j = 0; j < count; ++j) {
-                        whereStr += QString(c) + "%";
+                        likeStr += QString(c) + "%";
                     }
-                    whereStr += "'";
+                    bindValues.append(likeStr);
                 }
             }
             break;
@@ -502,21 +1056,14 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
 
             case SearchCondition::InWordList: {
                 tables.insert("words");
+                QString table = queries->loadWordList(numWordLists++,
+                    condition.stringValue.split(QChar(' ')));
+                if (table.isEmpty())
+                    return QStringList();
                 whereStr += " words.word";
                 if (condition.negated)
                     whereStr += " NOT";
-                whereStr += " IN (";
-                QStringList words = condition.stringValue.split(QChar(' '));
-                QStringListIterator it (words);
-                bool firstWord = true;
-                while (it.hasNext()) {
-                    QString word = it.next();
-                    if (!firstWord)
-                        whereStr += ",";
-                    firstWord = false;
-                    whereStr += "'" + word + "'";
-                }
-                whereStr += ")";
+                whereStr += " IN (SELECT word FROM " + table + ")";
             }
             break;
 
@@ -531,19 +1078,16 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
     QMap<QString, QString> upperToLower;
     if (wordList) {
         tables.insert("words");
-        whereStr += " AND words.word IN (";
         QStringListIterator it (*wordList);
-        bool firstWord = true;
         while (it.hasNext()) {
             QString word = it.next();
-            QString wordUpper = word.toUpper();
-            upperToLower[wordUpper] = word;
-            if (!firstWord)
-                whereStr += ",";
-            firstWord = false;
-            whereStr += "'" + wordUpper + "'";
+            upperToLower[word.toUpper()] = word;
         }
-        whereStr += ")";
+        QString table =
+            queries->loadWordList(numWordLists++, *wordList, true);
+        if (table.isEmpty())
+            return QStringList();
+        whereStr += " AND words.word IN (SELECT word FROM " + table + ")";
     }
 
     QStringList tablesList = tables.toList();
@@ -560,15 +1104,24 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
 
     // Query the database
     QStringList resultList;
-    QSqlDatabase* db = lexiconData[lexicon]->db;
-    QSqlQuery query (queryStr, *db);
-    while (query.next()) {
-        QString word = query.value(0).toString();
+    QSqlQuery* query = queries->prepare(queryStr);
+    if (!queries->exec(query, bindValues))
+        return resultList;
+    for (int numRows = 0; query->next(); ++numRows) {
+        if (cancelToken && !(numRows % CANCEL_CHECK_INTERVAL) &&
+            cancelToken->isCancelled())
+        {
+            resultList.clear();
+            break;
+        }
+
+        QString word = query->value(0).toString();
         if (!upperToLower.isEmpty() && upperToLower.contains(word)) {
             word = upperToLower[word];
         }
         resultList.append(word);
     }
+    query->finish();
 
     return resultList;
 }
@@ -585,18 +1138,61 @@ WordEngine::databaseSearch(const QString& lexicon, const SearchSpec&
 //---------------------------------------------------------------------------
 QStringList
 WordEngine::applyPostConditions(const QString& lexicon,
-    const SearchSpec& optimizedSpec, const QStringList& wordList) const
+    const SearchSpec& optimizedSpec, const QStringList& wordList,
+    const CancelToken* cancelToken) const
 {
     QStringList returnList = wordList;
 
+    // Check conditions that look up each word or a hook of it in a lexicon,
+    // looking up the whole list at once
+    QListIterator<SearchCondition> pit (optimizedSpec.conditions);
+    while (pit.hasNext() && !returnList.isEmpty()) {
+        const SearchCondition& condition = pit.next();
+        QString lookupLexicon = lexicon;
+        QStringList lookupWords;
+        switch (condition.type) {
+            case SearchCondition::Prefix:
+            foreach (const QString& word, returnList)
+                lookupWords.append(condition.stringValue + word.toUpper());
+            break;
+
+            case SearchCondition::Suffix:
+            foreach (const QString& word, returnList)
+                lookupWords.append(word.toUpper() + condition.stringValue);
+            break;
+
+            case SearchCondition::InLexicon:
+            lookupLexicon = condition.stringValue;
+            foreach (const QString& word, returnList)
+                lookupWords.append(word.toUpper());
+            break;
+
+            default: continue;
+        }
+
+        QBitArray acceptable = areAcceptable(lookupLexicon, lookupWords);
+        QStringList matchingList;
+        for (int i = 0; i < returnList.size(); ++i) {
+            if (acceptable.testBit(i) ^ condition.negated)
+                matchingList.append(returnList.at(i));
+        }
+        returnList = matchingList;
+    }
+
     // Check special postconditions
-    QStringList::iterator wit;
-    for (wit = returnList.begin(); wit != returnList.end();) {
-        if (matchesPostConditions(lexicon, *wit, optimizedSpec.conditions))
-            ++wit;
-        else
-            wit = returnList.erase(wit);
+    QStringList matchingList;
+    for (int i = 0; i < returnList.size(); ++i) {
+        if (cancelToken && !(i % CANCEL_CHECK_INTERVAL) &&
+            cancelToken->isCancelled())
+        {
+            return QStringList();
+        }
+
+        const QString& word = returnList.at(i);
+        if (matchesPostConditions(lexicon, word, optimizedSpec.conditions))
+            matchingList.append(word);
     }
+    returnList = matchingList;
     if (returnList.isEmpty())
         return returnList;
 
@@ -713,34 +1309,29 @@ WordEngine::applyPostConditions(const QString& lexicon,
 
             // Sort the words according to playability order
             else if (playValueMap.isEmpty()) {
-                LexiconData* lexData = lexiconData.value(lexicon);
-                if (!lexData)
-                    return returnList;
-
-                QSqlDatabase* db = lexData->db;
-                if (!db || !db->isOpen())
+                QueryHelper* queries = getThreadDatabase(lexicon).queries;
+                if (!queries)
                     return returnList;
 
                 QMap<QString, QString> origCase;
-                QString qstr = "SELECT word, playability FROM words "
-                    "WHERE word IN (";
                 QStringListIterator it (returnList);
-                for (int i = 0; it.hasNext(); ++i) {
+                while (it.hasNext()) {
                     const QString& word = it.next();
                     origCase[word.toUpper()] = word;
-                    if (i)
-                        qstr += ", ";
-                    qstr += "'" + word.toUpper() + "'";
                 }
-                qstr += ")";
 
-                QSqlQuery query (*db);
-                query.prepare(qstr);
-                query.exec();
+                QString table = queries->loadWordList(0, returnList, true);
+                if (table.isEmpty())
+                    return returnList;
+                QSqlQuery* query = queries->prepare(
+                    "SELECT word, playability FROM words "
+                    "WHERE word IN (SELECT word FROM " + table + ")");
+                if (!queries->exec(query, QVariantList()))
+                    return returnList;
 
-                while (query.next()) {
-                    QString word = origCase[query.value(0).toString()];
-                    qint64 playability = query.value(1).toLongLong();
+                while (query->next()) {
+                    QString word = origCase[query->value(0).toString()];
+                    qint64 playability = query->value(1).toLongLong();
                     QString radix;
                     QString wordUpper = word.toUpper();
                     radix.sprintf("%018lld", 999999999999999999LL - playability);
@@ -748,6 +1339,7 @@ WordEngine::applyPostConditions(const QString& lexicon,
                     radix += wordUpper;
                     playValueMap.insert(radix, word);
                 }
+                query->finish();
             }
 
             QMap<QString, QString>& valueMap = probCondition ?
@@ -817,67 +1409,116 @@ WordEngine::isAcceptable(const QString& lexicon, const QString& word) const
     return lexiconData[lexicon]->graph->containsWord(word);
 }
 
+//---------------------------------------------------------------------------
+//  areAcceptable
+//
+//! Determine which of a list of words are acceptable in a lexicon.  Words
+//! sharing a prefix with the word before them are looked up fastest.
+//
+//! @param lexicon the name of the lexicon
+//! @param words the words to look up
+//! @return a bit array with a bit set for each acceptable word
+//---------------------------------------------------------------------------
+QBitArray
+WordEngine::areAcceptable(const QString& lexicon, const QStringList& words)
+    const
+{
+    if (!lexiconData.contains(lexicon))
+        return QBitArray(words.size());
+
+    return lexiconData[lexicon]->graph->containsWords(words);
+}
+
 //---------------------------------------------------------------------------
 //  search
 //
-//! Search for acceptable words matching a search specification.
+//! Search for acceptable words matching a search specification.  A search
+//! run by a search thread can be cancelled through the thread, and passes
+//! the words it finds to the thread in batches: as the last step of the
+//! search finds them if the step narrows a list found by earlier steps, and
+//! otherwise once they are all found.
 //
 //! @param lexicon the name of the lexicon
 //! @param spec the search specification
 //! @param allCaps whether to ensure the words in the list are all caps
-//! @return a list of acceptable words
+//! @param searchThread the search thread running the search, if any
+//! @return a list of acceptable words, or an empty list if the search is
+//! cancelled
 //---------------------------------------------------------------------------
 QStringList
 WordEngine::search(const QString& lexicon, const SearchSpec& spec, bool
-                   allCaps) const
+                   allCaps, SearchThread* searchThread) const
 {
     if (!lexiconData.contains(lexicon))
         return QStringList();
 
+    const CancelToken* cancelToken =
+        searchThread ? searchThread->getCancelToken() : 0;
     SearchSpec optimizedSpec = spec;
     optimizedSpec.optimize(lexicon);
 
-    // Discover which kinds of search conditions are present
-    QMap<ConditionPhase, int> phaseCounts;
-    int lengthConditions = 0;
-    QListIterator<SearchCondition> cit (optimizedSpec.conditions);
-    while (cit.hasNext()) {
-        SearchCondition condition = cit.next();
-        ConditionPhase phase = getConditionPhase(condition);
-        ++phaseCounts[phase];
-        if (condition.type == SearchCondition::Length)
-            ++lengthConditions;
-    }
-
-    // Do not search the database based on Length conditions that were only
-    // added by SearchSpec::optimize to optimize word graph searches
-    if ((phaseCounts.contains(WordGraphPhase)) && lengthConditions &&
-        (lengthConditions == phaseCounts.value(DatabasePhase)))
-    {
-        --phaseCounts[DatabasePhase];
-    }
-
-    // Search the word graph if necessary
+    // Use the results of an earlier search with the same optimized spec if
+    // they are cached.  Results are cached before any case conversion.
+    QString cacheKey = optimizedSpec.asCanonicalString();
+    SearchCache& searchCache = lexiconData[lexicon]->searchCache;
     QStringList resultList;
-    if (phaseCounts.value(WordGraphPhase) ||
-        !phaseCounts.value(DatabasePhase))
+    bool cached = false;
     {
-        resultList = wordGraphSearch(lexicon, optimizedSpec);
-        if (resultList.isEmpty())
-            return resultList;
+        QMutexLocker locker (&mutex);
+        cached = searchCache.find(cacheKey, resultList);
     }
 
-    // Search the database if necessary, passing word graph results
-    if (phaseCounts.value(DatabasePhase)) {
-        resultList = databaseSearch(lexicon, optimizedSpec,
-            phaseCounts.contains(WordGraphPhase) ? &resultList : 0);
-        if (resultList.isEmpty())
-            return resultList;
+    bool reported = false;
+    if (!cached) {
+
+        // Run each step of the cheapest plan, passing the words found by
+        // each step to the next
+        SearchPlan plan = planSearch(lexicon, optimizedSpec);
+        for (int i = 0; i < plan.steps.size(); ++i) {
+            const PlanStep& step = plan.steps.at(i);
+            if (!searchThread || !i || (i < plan.steps.size() - 1) ||
+                !stepNarrowsInBatches(step))
+            {
+                resultList = runPlanStep(lexicon, step, i ? &resultList : 0,
+                                         cancelToken);
+            }
+
+            // Narrow the list a batch at a time, passing each batch of
+            // words on as soon as it is checked
+            else {
+                QStringList wordList = resultList;
+                resultList.clear();
+                for (int j = 0; j < wordList.size(); j += SEARCH_BATCH_SIZE) {
+                    if (cancelToken->isCancelled())
+                        break;
+                    QStringList batch = wordList.mid(j, SEARCH_BATCH_SIZE);
+                    batch = runPlanStep(lexicon, step, &batch, cancelToken);
+                    reportWords(searchThread, batch, allCaps);
+                    resultList += batch;
+                }
+                reported = true;
+            }
+
+            if (cancelToken && cancelToken->isCancelled())
+                return QStringList();
+            if (resultList.isEmpty())
+                break;
+        }
+
+        QMutexLocker locker (&mutex);
+        searchCache.insert(cacheKey, resultList);
     }
 
-    // Check post conditions if necessary
-    if (phaseCounts.value(PostConditionPhase)) {
-        resultList = applyPostConditions(lexicon, optimizedSpec, resultList);
+    if (resultList.isEmpty())
+        return resultList;
+
+    if (searchThread && !reported) {
+        for (int i = 0; i < resultList.size(); i += SEARCH_BATCH_SIZE) {
+            if (cancelToken->isCancelled())
+                return QStringList();
+            reportWords(searchThread, resultList.mid(i, SEARCH_BATCH_SIZE),
+                        allCaps);
+        }
     }
 
     // Convert to all caps if necessary
@@ -887,12 +1528,145 @@ WordEngine::search(const QString& lexicon, const SearchSpec& spec, bool
             *it = (*it).toUpper();
     }
 
-    if (!resultList.isEmpty()) {
-        clearCache(lexicon);
-        addToCache(lexicon, resultList);
+    addToCache(lexicon, resultList);
+    return resultList;
+}
+
+//---------------------------------------------------------------------------
+//  createSearchThread
+//
+//! Create a thread that searches for acceptable words matching a search
+//! specification without blocking the caller.  The thread passes the words
+//! it finds on in batches through its wordsFound signal, and signals done
+//! when the search is finished or cancelled.  The thread is not started, so
+//! that its signals can be connected first, and it belongs to the caller.
+//! The engine cancels and waits for the thread before changing or removing
+//! any lexicon, and when it is destroyed.
+//
+//! @param lexicon the name of the lexicon
+//! @param spec the search specification
+//! @param allCaps whether to ensure the words found are all caps
+//! @return the search thread
+//---------------------------------------------------------------------------
+SearchThread*
+WordEngine::createSearchThread(const QString& lexicon, const SearchSpec&
+                               spec, bool allCaps)
+{
+    searchThreads.removeAll(QPointer<SearchThread>());
+    SearchThread* searchThread =
+        new SearchThread(this, lexicon, spec, allCaps);
+    searchThreads.append(searchThread);
+    return searchThread;
+}
+
+//---------------------------------------------------------------------------
+//  stopSearchThreads
+//
+//! Cancel every search thread created by the engine that is still running,
+//! and wait for them to finish, so that no search is using a lexicon while
+//! it is changed or removed.  Must be called from the engine's own thread.
+//---------------------------------------------------------------------------
+void
+WordEngine::stopSearchThreads()
+{
+    QListIterator<QPointer<SearchThread> > it (searchThreads);
+    while (it.hasNext()) {
+        SearchThread* searchThread = it.next();
+        if (!searchThread)
+            continue;
+        searchThread->cancel();
+        searchThread->wait();
     }
+    searchThreads.removeAll(QPointer<SearchThread>());
+}
 
-    return resultList;
+//---------------------------------------------------------------------------
+//  runPlanStep
+//
+//! Match the conditions of a step of a search plan.
+//
+//! @param lexicon the name of the lexicon
+//! @param step the step
+//! @param wordList the list of words found by the steps before, or 0 if
+//! this is the first step
+//! @param cancelToken a token checked during long steps
+//! @return a list of words matching the conditions of the step
+//---------------------------------------------------------------------------
+QStringList
+WordEngine::runPlanStep(const QString& lexicon, const PlanStep& step,
+                        const QStringList* wordList,
+                        const CancelToken* cancelToken) const
+{
+    switch (step.phase) {
+        case WordGraphPhase:
+        return wordList
+            ? lexiconData[lexicon]->graph->filterWords(step.spec, *wordList)
+            : wordGraphSearch(lexicon, step.spec, cancelToken);
+
+        case AttributePhase:
+        return attributeSearch(lexicon, step.spec, wordList);
+
+        case DatabasePhase:
+        return databaseSearch(lexicon, step.spec, wordList, cancelToken);
+
+        case PostConditionPhase:
+        return wordList ? applyPostConditions(lexicon, step.spec, *wordList,
+                                              cancelToken)
+                        : QStringList();
+
+        default:
+        return QStringList();
+    }
+}
+
+//---------------------------------------------------------------------------
+//  stepNarrowsInBatches
+//
+//! Determine whether a step of a search plan can narrow a list of words a
+//! piece at a time, with the same results as narrowing the whole list.
+//! Limits by order keep a range of the whole list, so they cannot.
+//
+//! @param step the step
+//! @return true if the step can narrow a list in batches
+//---------------------------------------------------------------------------
+bool
+WordEngine::stepNarrowsInBatches(const PlanStep& step)
+{
+    QListIterator<SearchCondition> it (step.spec.conditions);
+    while (it.hasNext()) {
+        SearchCondition::SearchType type = it.next().type;
+        if ((type == SearchCondition::LimitByProbabilityOrder) ||
+            (type == SearchCondition::LimitByPlayabilityOrder))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  reportWords
+//
+//! Pass a batch of words found by a search on to the search thread running
+//! it.
+//
+//! @param searchThread the search thread
+//! @param words the words found
+//! @param allCaps whether to convert the words to all caps first
+//---------------------------------------------------------------------------
+void
+WordEngine::reportWords(SearchThread* searchThread, const QStringList& words,
+                        bool allCaps)
+{
+    if (!allCaps) {
+        searchThread->addWords(words);
+        return;
+    }
+
+    QStringList upperWords;
+    foreach (const QString& word, words)
+        upperWords.append(word.toUpper());
+    searchThread->addWords(upperWords);
 }
 
 //---------------------------------------------------------------------------
@@ -902,16 +1676,19 @@ WordEngine::search(const QString& lexicon, const SearchSpec& spec, bool
 //
 //! @param lexicon the name of the lexicon
 //! @param optimizedSpec the search spec
-//! @return a list of words
+//! @param cancelToken a token checked during the search, which stops the
+//! search if it is cancelled
+//! @return a list of words, or an empty list if the search is cancelled
 //---------------------------------------------------------------------------
 QStringList
 WordEngine::wordGraphSearch(const QString& lexicon, const SearchSpec&
-                            optimizedSpec) const
+                            optimizedSpec, const CancelToken* cancelToken)
+    const
 {
     if (!lexiconData.contains(lexicon))
         return QStringList();
 
-    return lexiconData[lexicon]->graph->search(optimizedSpec);
+    return lexiconData[lexicon]->graph->search(optimizedSpec, cancelToken);
 }
 
 //---------------------------------------------------------------------------
@@ -926,9 +1703,17 @@ WordEngine::wordGraphSearch(const QString& lexicon, const SearchSpec&
 QStringList
 WordEngine::alphagrams(const QStringList& strList) const
 {
-    // Insert into a set to remove duplicates
+    // Insert into a set to remove duplicates, creating the alphagram to be
+    // displayed only once for each distinct set of letters
+    QSet<WordKey> alphaKeys;
     QSet<QString> alphaSet;
     foreach (const QString& str, strList) {
+        WordKey key = WordKey(str).getAlphagram();
+        if (key.isValid()) {
+            if (alphaKeys.contains(key))
+                continue;
+            alphaKeys.insert(key);
+        }
         alphaSet.insert(Auxil::getAlphagram(str));
     }
 
@@ -958,14 +1743,29 @@ WordEngine::getWordInfo(const QString& lexicon, const QString& word) const
     if (!lexiconData.contains(lexicon))
         return WordInfo();
 
-    if (lexiconData[lexicon]->wordCache.contains(word)) {
-        //qDebug("Cache HIT: |%s|", word.toUtf8().data());
-        return lexiconData[lexicon]->wordCache[word];
+    // Words are only cached by ID, so look up the word directly if the
+    // graph cannot number its words.  A word without an ID is not in the
+    // lexicon, so the database has no information about it.
+    const LexiconData* lexData = lexiconData[lexicon];
+    if (!lexData->graph || !lexData->graph->hasWordIds()) {
+        QList<WordInfo> infos = queryWordInfo(lexicon, QStringList(word));
+        return infos.isEmpty() ? WordInfo() : infos.first();
+    }
+
+    int id = lexData->graph->getWordId(word.toUpper());
+    if (id < 0)
+        return WordInfo();
+
+    {
+        QMutexLocker locker (&mutex);
+        const WordInfo* info = lexData->wordCache.find(id);
+        if (info)
+            return *info;
     }
-    //qDebug("Cache MISS: |%s|", word.toUtf8().data());
 
     addToCache(lexicon, QStringList(word));
-    return lexiconData[lexicon]->wordCache.value(word);
+    QMutexLocker locker (&mutex);
+    return lexData->wordCache.value(id);
 }
 
 //---------------------------------------------------------------------------
@@ -982,8 +1782,8 @@ WordEngine::getNumWords(const QString& lexicon) const
     if (!lexiconData.contains(lexicon))
         return 0;
 
-    QSqlDatabase* db = lexiconData[lexicon]->db;
-    if (db && db->isOpen()) {
+    QSqlDatabase* db = getThreadDatabase(lexicon).db;
+    if (db) {
         QString qstr = "SELECT count(*) FROM words";
         QSqlQuery query (qstr, *db);
         if (query.next())
@@ -995,6 +1795,26 @@ WordEngine::getNumWords(const QString& lexicon) const
     return 0;
 }
 
+//---------------------------------------------------------------------------
+//  countAnagrams
+//
+//! Count the acceptable anagrams of a word from the anagram index of the
+//! word graph, without using the database.
+//
+//! @param lexicon the name of the lexicon
+//! @param word the word
+//! @return the number of acceptable anagrams, counting the word itself, or
+//! -1 if they cannot be counted from the index
+//---------------------------------------------------------------------------
+int
+WordEngine::countAnagrams(const QString& lexicon, const QString& word) const
+{
+    if (!lexiconData.contains(lexicon))
+        return -1;
+
+    return lexiconData[lexicon]->graph->countAnagrams(word);
+}
+
 //---------------------------------------------------------------------------
 //  getLexiconFile
 //
@@ -1093,6 +1913,61 @@ WordEngine::getDefinition(const QString& lexicon, const QString& word,
     }
 }
 
+//---------------------------------------------------------------------------
+//  getHookLetters
+//
+//! Get the hooks of a word from the word graph, by visiting the words
+//! matching a pattern with one wildcard at the front or back of the word.
+//! Only the hook letters are kept, so no list of words is created.
+//
+//! @param lexicon the name of the lexicon
+//! @param pattern the pattern matching the word and its hooks
+//! @param front whether the hooks are at the front of the word
+//! @return a string containing lower case letters representing the hooks,
+//! sorted
+//---------------------------------------------------------------------------
+QString
+WordEngine::getHookLetters(const QString& lexicon, const QString& pattern,
+                           bool front) const
+{
+    if (!lexiconData.contains(lexicon))
+        return QString();
+
+    SearchSpec spec;
+    SearchCondition condition;
+    condition.type = SearchCondition::PatternMatch;
+    condition.stringValue = pattern;
+    spec.conditions.append(condition);
+
+    HookLetterVisitor visitor (front);
+    lexiconData[lexicon]->graph->visitWords(spec, &visitor);
+    qSort(visitor.letters.begin(), visitor.letters.end(),
+          Auxil::localeAwareLessThanQChar);
+
+    QString ret;
+    QListIterator<QChar> it (visitor.letters);
+    while (it.hasNext())
+        ret += it.next();
+    return ret;
+}
+
+//---------------------------------------------------------------------------
+//  HookLetterVisitor::visitWord
+//
+//! Keep the hook letter of a word found by a graph search.
+//
+//! @param word the letters of the word
+//! @param length the length of the word
+//! @return true, to continue the search
+//---------------------------------------------------------------------------
+bool
+WordEngine::HookLetterVisitor::visitWord(const char* word, int length)
+{
+    letters.append(QChar::fromLatin1(word[front ? 0 : length - 1])
+                   .toLower());
+    return true;
+}
+
 //---------------------------------------------------------------------------
 //  getFrontHookLetters
 //
@@ -1107,35 +1982,11 @@ QString
 WordEngine::getFrontHookLetters(const QString& lexicon, const QString& word)
     const
 {
-    QString ret;
-
     WordInfo info = getWordInfo(lexicon, word);
-    if (info.isValid()) {
-        ret = info.frontHooks;
-    }
-
-    else {
-        SearchSpec spec;
-        SearchCondition condition;
-        condition.type = SearchCondition::PatternMatch;
-        condition.stringValue = "?" + word;
-        spec.conditions.append(condition);
-
-        // Get and sort first letters of each word
-        QStringList words = search(lexicon, spec, true);
-        QList<QChar> letters;
-        foreach (const QString& str, words) {
-            letters.append(str.at(0).toLower());
-        }
-        qSort(letters.begin(), letters.end(),
-              Auxil::localeAwareLessThanQChar);
+    if (info.isValid())
+        return info.frontHooks;
 
-        QListIterator<QChar> it (letters);
-        while (it.hasNext())
-            ret += it.next();
-    }
-
-    return ret;
+    return getHookLetters(lexicon, "?" + word, true);
 }
 
 //---------------------------------------------------------------------------
@@ -1151,41 +2002,19 @@ WordEngine::getFrontHookLetters(const QString& lexicon, const QString& word)
 QString
 WordEngine::getBackHookLetters(const QString& lexicon, const QString& word) const
 {
-    QString ret;
-
     WordInfo info = getWordInfo(lexicon, word);
-    if (info.isValid()) {
-        ret = info.backHooks;
-    }
-
-    else {
-        SearchSpec spec;
-        SearchCondition condition;
-        condition.type = SearchCondition::PatternMatch;
-        condition.stringValue = word + "?";
-        spec.conditions.append(condition);
-
-        // Get and sort last letters of each word
-        QStringList words = search(lexicon, spec, true);
-        QList<QChar> letters;
-        foreach (const QString& str, words) {
-            letters.append(str.at(str.length() - 1).toLower());
-        }
-        qSort(letters.begin(), letters.end(),
-              Auxil::localeAwareLessThanQChar);
+    if (info.isValid())
+        return info.backHooks;
 
-        QListIterator<QChar> it (letters);
-        while (it.hasNext())
-            ret += it.next();
-    }
-
-    return ret;
+    return getHookLetters(lexicon, word + "?", false);
 }
 
 //---------------------------------------------------------------------------
 //  addToCache
 //
-//! Add information about a list of words to the cache.
+//! Add information about a list of words to the cache.  Each word's
+//! information is found by the word's ID, so words are only cached if the
+//! lexicon's graph can number its words.
 //
 //! @param lexicon the name of the lexicon
 //! @param words the list of words
@@ -1197,9 +2026,57 @@ WordEngine::addToCache(const QString& lexicon, const QStringList& words) const
         return;
 
     LexiconData* lexData = lexiconData[lexicon];
-    QSqlDatabase* db = lexData->db;
-    if (!db || !db->isOpen())
+    const WordGraph* graph = lexData->graph;
+    if (!graph || !graph->hasWordIds() || !lexData->db ||
+        !lexData->db->isOpen())
+    {
         return;
+    }
+
+    // Throw out words that are already in the cache or not in the lexicon.
+    // Words beyond the size of the cache would only evict the words before
+    // them, so they are left to be looked up when they are used.
+    QStringList needWords;
+    {
+        QMutexLocker locker (&mutex);
+        foreach (const QString& word, words) {
+            if (needWords.size() == WORD_CACHE_SIZE)
+                break;
+            int id = graph->getWordId(word.toUpper());
+            if ((id < 0) || lexData->wordCache.contains(id))
+                continue;
+            needWords.append(word);
+        }
+    }
+    if (needWords.isEmpty())
+        return;
+
+    QList<WordInfo> infos = queryWordInfo(lexicon, needWords);
+    QMutexLocker locker (&mutex);
+    foreach (const WordInfo& info, infos)
+        lexData->wordCache.insert(graph->getWordId(info.word), info);
+}
+
+//---------------------------------------------------------------------------
+//  queryWordInfo
+//
+//! Get information about a list of words from the database.
+//
+//! @param lexicon the name of the lexicon
+//! @param words the list of words
+//! @return information about each word found in the database
+//---------------------------------------------------------------------------
+QList<WordEngine::WordInfo>
+WordEngine::queryWordInfo(const QString& lexicon, const QStringList& words)
+    const
+{
+    QList<WordInfo> infos;
+    if (words.isEmpty() || !lexiconData.contains(lexicon))
+        return infos;
+
+    QueryHelper* queries = getThreadDatabase(lexicon).queries;
+    if (!queries)
+        return infos;
 
     QString qstr = "SELECT word, num_vowels, "
         "num_unique_letters, num_anagrams, point_value, "
@@ -1211,65 +2088,57 @@ WordEngine::addToCache(const QString& lexicon, const QStringList& words) const
         "probability_order2, min_probability_order2, max_probability_order2 "
         "FROM words WHERE words.word";
 
-    // Throw out words that are already in the cache
-    QStringList needWords;
-    foreach (const QString& word, words) {
-        if (lexData->wordCache.contains(word))
-            continue;
-        needWords.append(word);
-    }
-
     // Construct the where clause from the word list
-    if (needWords.count() == 1) {
-        qstr += "='" + needWords.first() + "'";
+    QVariantList bindValues;
+    if (words.count() == 1) {
+        qstr += "=?";
+        bindValues.append(words.first().toUpper());
     }
     else {
-        qstr += " IN (";
-        QStringListIterator it (needWords);
-        for (int i = 0; it.hasNext(); ++i) {
-            if (i)
-                qstr += ", ";
-            qstr += "'" + it.next().toUpper() + "'";
-        }
-        qstr += ")";
+        QString table = queries->loadWordList(0, words, true);
+        if (table.isEmpty())
+            return infos;
+        qstr += " IN (SELECT word FROM " + table + ")";
     }
 
-    QSqlQuery query (*db);
-    query.prepare(qstr);
-    query.exec();
+    QSqlQuery* query = queries->prepare(qstr);
+    if (!queries->exec(query, bindValues))
+        return infos;
 
-    while (query.next()) {
+    while (query->next()) {
         int placeNum = 0;
         WordInfo info;
-        info.word                 = query.value(placeNum++).toString();
-        info.numVowels            = query.value(placeNum++).toInt();
-        info.numUniqueLetters     = query.value(placeNum++).toInt();
-        info.numAnagrams          = query.value(placeNum++).toInt();
-        info.pointValue           = query.value(placeNum++).toInt();
-        info.frontHooks           = query.value(placeNum++).toString();
-        info.backHooks            = query.value(placeNum++).toString();
-        info.isFrontHook          = query.value(placeNum++).toBool();
-        info.isBackHook           = query.value(placeNum++).toBool();
-        info.lexiconSymbols       = query.value(placeNum++).toString();
-        info.definition           = query.value(placeNum++).toString();
-        info.playability          = query.value(placeNum++).toLongLong();
+        info.word                 = query->value(placeNum++).toString();
+        info.numVowels            = query->value(placeNum++).toInt();
+        info.numUniqueLetters     = query->value(placeNum++).toInt();
+        info.numAnagrams          = query->value(placeNum++).toInt();
+        info.pointValue           = query->value(placeNum++).toInt();
+        info.frontHooks           = query->value(placeNum++).toString();
+        info.backHooks            = query->value(placeNum++).toString();
+        info.isFrontHook          = query->value(placeNum++).toBool();
+        info.isBackHook           = query->value(placeNum++).toBool();
+        info.lexiconSymbols       = query->value(placeNum++).toString();
+        info.definition           = query->value(placeNum++).toString();
+        info.playability          = query->value(placeNum++).toLongLong();
 
         ValueOrder playOrder;
-        playOrder.valueOrder    = query.value(placeNum++).toInt();
-        playOrder.minValueOrder = query.value(placeNum++).toInt();
-        playOrder.maxValueOrder = query.value(placeNum++).toInt();
+        playOrder.valueOrder    = query->value(placeNum++).toInt();
+        playOrder.minValueOrder = query->value(placeNum++).toInt();
+        playOrder.maxValueOrder = query->value(placeNum++).toInt();
         info.playabilityOrder = playOrder;
 
         for (int numBlanks = 0; numBlanks <= 2; ++numBlanks) {
             ValueOrder probOrder;
-            probOrder.valueOrder    = query.value(placeNum++).toInt();
-            probOrder.minValueOrder = query.value(placeNum++).toInt();
-            probOrder.maxValueOrder = query.value(placeNum++).toInt();
+            probOrder.valueOrder    = query->value(placeNum++).toInt();
+            probOrder.minValueOrder = query->value(placeNum++).toInt();
+            probOrder.maxValueOrder = query->value(placeNum++).toInt();
             info.blankProbabilityOrder[numBlanks] = probOrder;
         }
 
-        lexiconData[lexicon]->wordCache[info.word] = info;
+        infos.append(info);
     }
+    query->finish();
+    return infos;
 }
 
 //---------------------------------------------------------------------------
@@ -1277,7 +2146,9 @@ WordEngine::addToCache(const QString& lexicon, const QStringList& words) const
 //
 //! Test whether a word matches certain conditions.  Not all conditions in the
 //! list are tested.  Only the conditions that cannot be easily tested in
-//! WordGraph::search are tested here.
+//! WordGraph::search are tested here, except for Prefix, Suffix and In
+//! Lexicon conditions, which are tested for a whole list at once by
+//! applyPostConditions.
 //
 //! @param lexicon the name of the lexicon
 //! @param word the word to be tested
@@ -1295,23 +2166,8 @@ WordEngine::matchesPostConditions(const QString& lexicon, const QString& word,
     QListIterator<SearchCondition> it (conditions);
     while (it.hasNext()) {
         const SearchCondition& condition = it.next();
-        if (getConditionPhase(condition) != PostConditionPhase)
-            continue;
-
         switch (condition.type) {
 
-            case SearchCondition::Prefix:
-            if ((!isAcceptable(lexicon, condition.stringValue + wordUpper))
-                ^ condition.negated)
-                return false;
-            break;
-
-            case SearchCondition::Suffix:
-            if ((!isAcceptable(lexicon, wordUpper + condition.stringValue))
-                ^ condition.negated)
-                return false;
-            break;
-
             case SearchCondition::BelongToGroup: {
                 SearchSet searchSet =
                     Auxil::stringToSearchSet(condition.stringValue);
@@ -1323,12 +2179,6 @@ WordEngine::matchesPostConditions(const QString& lexicon, const QString& word,
             }
             break;
 
-            case SearchCondition::InLexicon:
-            if ((!isAcceptable(condition.stringValue, wordUpper))
-                ^ condition.negated)
-                return false;
-            break;
-
             default: break;
         }
     }
@@ -1400,16 +2250,13 @@ WordEngine::isSetMember(const QString& lexicon, const QString& word,
             if (!lexiconData[lexicon]->stemAlphagrams.contains(word.length() - 1))
                 return false;
 
-            QString agram = Auxil::getAlphagram(word);
-            const QSet<QString>& alphaSet =
+            WordKey agram = WordKey(word).getAlphagram();
+            const QSet<WordKey>& alphaSet =
                 lexiconData[lexicon]->stemAlphagrams[word.length() - 1];
 
-            for (int i = 0; i < int(agram.length()); ++i) {
-                if (alphaSet.contains(agram.left(i) +
-                                      agram.right(agram.length() - i - 1)))
-                {
+            for (int i = 0; i < agram.getLength(); ++i) {
+                if (alphaSet.contains(agram.withoutLetter(i)))
                     return true;
-                }
             }
             return false;
         }
@@ -1424,17 +2271,17 @@ WordEngine::isSetMember(const QString& lexicon, const QString& word,
             // Compare the letters of the word with the letters of each
             // alphagram, ensuring that no more than two letters in the word
             // are missing from the alphagram.
-            QString agram = Auxil::getAlphagram(word);
-            const QSet<QString>& alphaSet =
+            WordKey agram = WordKey(word).getAlphagram();
+            const QSet<WordKey>& alphaSet =
                 lexiconData[lexicon]->stemAlphagrams[word.length() - 2];
 
-            QSetIterator<QString> it (alphaSet);
+            QSetIterator<WordKey> it (alphaSet);
             while (it.hasNext()) {
-                QString setAlphagram = it.next();
+                const WordKey& setAlphagram = it.next();
                 int missing = 0;
                 int saIndex = 0;
-                for (int i = 0; (i < int(agram.length())) &&
-                                (saIndex < setAlphagram.length()); ++i)
+                for (int i = 0; (i < agram.getLength()) &&
+                                (saIndex < setAlphagram.getLength()); ++i)
                 {
                     if (agram.at(i) == setAlphagram.at(saIndex))
                         ++saIndex;
@@ -1508,16 +2355,13 @@ WordEngine::isSetMember(const QString& lexicon, const QString& word,
             if (!lexiconData[lexicon]->stemAlphagrams.contains(word.length() - 1))
                 return false;
 
-            QString agram = Auxil::getAlphagram(word);
-            const QSet<QString>& alphaSet =
+            WordKey agram = WordKey(word).getAlphagram();
+            const QSet<WordKey>& alphaSet =
                 lexiconData[lexicon]->stemAlphagrams[word.length() - 1];
 
-            for (int i = 0; i < int(agram.length()); ++i) {
-                if (alphaSet.contains(agram.left(i) +
-                                      agram.right(agram.length() - i - 1)))
-                {
+            for (int i = 0; i < agram.getLength(); ++i) {
+                if (alphaSet.contains(agram.withoutLetter(i)))
                     return true;
-                }
             }
             return false;
         }
@@ -1542,13 +2386,13 @@ WordEngine::getNumAnagrams(const QString& lexicon, const QString& word) const
         return 0;
 
     WordInfo info = getWordInfo(lexicon, word);
-    if (info.isValid()) {
+    if (info.isValid())
         return info.numAnagrams;
-    }
-    else {
-        QString alpha = Auxil::getAlphagram(word);
-        return lexiconData[lexicon]->numAnagramsMap.value(alpha);
-    }
+
+    // Without a database, count the anagrams from the word graph
+    const WordGraph* graph = lexiconData[lexicon]->graph;
+    int id = graph ? graph->getWordId(word.toUpper()) : -1;
+    return (id < 0) ? 0 : graph->getNumAnagrams(id);
 }
 
 //---------------------------------------------------------------------------
@@ -1895,12 +2739,11 @@ WordEngine::nonGraphSearch(const QString& lexicon, const SearchSpec& spec) const
             continue;
 
         QStringList words = condition.stringValue.split(QChar(' '));
+        QBitArray acceptable = areAcceptable(lexicon, words);
         QSet<QString> wordSet;
-        QStringListIterator wit (words);
-        while (wit.hasNext()) {
-            QString word = wit.next();
-            if (isAcceptable(lexicon, word))
-                wordSet.insert(word);
+        for (int i = 0; i < words.size(); ++i) {
+            if (acceptable.testBit(i))
+                wordSet.insert(words.at(i));
         }
 
         // Combine search result set with words already found
@@ -2019,43 +2862,83 @@ WordEngine::addDefinition(const QString& lexicon, const QString& word,
 //! Determine the search phase during which a search condition should be
 //! considered.
 //
+//! @param lexicon the name of the lexicon
 //! @param condition the search condition
 //! @return the appropriate search phase
 //---------------------------------------------------------------------------
 WordEngine::ConditionPhase
-WordEngine::getConditionPhase(const SearchCondition& condition) const
+WordEngine::getConditionPhase(const QString& lexicon, const SearchCondition&
+                              condition) const
 {
     switch (condition.type) {
+        // Totals of the letters of a word are checked by the word graph
+        // while the word is being matched
         case SearchCondition::AnagramMatch:
         case SearchCondition::SubanagramMatch:
         case SearchCondition::ConsistOf:
+        case SearchCondition::NumVowels:
+        case SearchCondition::NumUniqueLetters:
+        case SearchCondition::PointValue:
         return WordGraphPhase;
 
+        // Numeric attributes are scanned in memory if the lexicon's
+        // attribute store can be loaded
         case SearchCondition::Length:
+        case SearchCondition::PlayabilityOrder:
+        if (getAttributeStore(lexicon))
+            return AttributePhase;
+        return DatabasePhase;
+
         case SearchCondition::InWordList:
-        case SearchCondition::NumVowels:
         case SearchCondition::IncludeLetters:
-        case SearchCondition::ProbabilityOrder:
-        case SearchCondition::PlayabilityOrder:
-        case SearchCondition::NumUniqueLetters:
-        case SearchCondition::PointValue:
-        case SearchCondition::NumAnagrams:
         case SearchCondition::PartOfSpeech:
         case SearchCondition::Definition:
         return DatabasePhase;
 
-        case SearchCondition::Prefix:
-        case SearchCondition::Suffix:
         case SearchCondition::InLexicon:
         case SearchCondition::LimitByProbabilityOrder:
         case SearchCondition::LimitByPlayabilityOrder:
         return PostConditionPhase;
 
+        // Anagram counts and probability orders are kept by the word graph
+        // if it can number its words, which also works for lexicons without
+        // a database
+        case SearchCondition::NumAnagrams:
+        case SearchCondition::ProbabilityOrder: {
+            const LexiconData* data = lexiconData.value(lexicon);
+            if (data && data->graph && data->graph->usesWordTables(condition))
+                return WordGraphPhase;
+            if (AttributeStore::handlesCondition(condition) &&
+                getAttributeStore(lexicon))
+            {
+                return AttributePhase;
+            }
+            return DatabasePhase;
+        }
+
+        // Affixes are joined to each word by the word graph while the word
+        // is being matched, if the graph can do so
+        case SearchCondition::Prefix:
+        case SearchCondition::Suffix: {
+            const LexiconData* data = lexiconData.value(lexicon);
+            if (data && data->graph && data->graph->usesAffixJoin(condition))
+                return WordGraphPhase;
+            return PostConditionPhase;
+        }
+
         case SearchCondition::PatternMatch:
         if (condition.stringValue.startsWith("*") &&
             condition.stringValue.endsWith("*") &&
             !condition.stringValue.contains("["))
         {
+            // Search the infix index instead of the database if the
+            // lexicon has one
+            const LexiconData* data = lexiconData.value(lexicon);
+            if (data && data->graph &&
+                data->graph->usesInfixIndex(condition))
+            {
+                return WordGraphPhase;
+            }
             return DatabasePhase;
         }
         else
@@ -2077,3 +2960,621 @@ WordEngine::getConditionPhase(const SearchCondition& condition) const
         return UnknownPhase;
     }
 }
+
+//---------------------------------------------------------------------------
+//  conditionAllowsPhase
+//
+//! Determine whether a search condition can be matched during a search
+//! phase, given the engines available for a lexicon.
+//
+//! @param lexicon the name of the lexicon
+//! @param condition the search condition
+//! @param phase the search phase
+//! @return true if the condition can be matched during the phase
+//---------------------------------------------------------------------------
+bool
+WordEngine::conditionAllowsPhase(const QString& lexicon, const
+                                 SearchCondition& condition,
+                                 ConditionPhase phase) const
+{
+    const LexiconData* lexData = lexiconData.value(lexicon);
+    if (!lexData)
+        return false;
+
+    const WordGraph* graph = lexData->graph;
+    switch (phase) {
+        case WordGraphPhase:
+        if (!graph)
+            return false;
+        switch (condition.type) {
+            case SearchCondition::PatternMatch:
+            case SearchCondition::AnagramMatch:
+            case SearchCondition::SubanagramMatch:
+            case SearchCondition::ConsistOf:
+            case SearchCondition::Length:
+            case SearchCondition::IncludeLetters:
+            case SearchCondition::NumVowels:
+            case SearchCondition::NumUniqueLetters:
+            case SearchCondition::PointValue:
+            return true;
+
+            case SearchCondition::NumAnagrams:
+            case SearchCondition::ProbabilityOrder:
+            return graph->usesWordTables(condition);
+
+            case SearchCondition::Prefix:
+            case SearchCondition::Suffix:
+            return graph->usesAffixJoin(condition);
+
+            default:
+            return false;
+        }
+
+        case AttributePhase:
+        return AttributeStore::handlesCondition(condition) &&
+            getAttributeStore(lexicon);
+
+        case DatabasePhase:
+        if (!lexData->db || !lexData->db->isOpen())
+            return false;
+        switch (condition.type) {
+            // Letters matched by a wildcard are only shown in lower case
+            // by the word graph
+            case SearchCondition::PatternMatch:
+            return !condition.stringValue.contains('[') &&
+                (condition.negated || !condition.stringValue.contains('?'));
+
+            case SearchCondition::Length:
+            case SearchCondition::IncludeLetters:
+            case SearchCondition::NumVowels:
+            case SearchCondition::NumUniqueLetters:
+            case SearchCondition::PointValue:
+            case SearchCondition::NumAnagrams:
+            case SearchCondition::ProbabilityOrder:
+            case SearchCondition::PlayabilityOrder:
+            case SearchCondition::InWordList:
+            case SearchCondition::PartOfSpeech:
+            case SearchCondition::Definition:
+            return true;
+
+            case SearchCondition::BelongToGroup: {
+                SearchSet searchSet =
+                    Auxil::stringToSearchSet(condition.stringValue);
+                return (searchSet == SetHookWords) ||
+                    (searchSet == SetFrontHooks) ||
+                    (searchSet == SetBackHooks);
+            }
+
+            default:
+            return false;
+        }
+
+        case PostConditionPhase:
+        return (getConditionPhase(lexicon, condition) == PostConditionPhase);
+
+        default:
+        return false;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  collectStats
+//
+//! Collect the statistics used to plan searches of a lexicon.  Called
+//! whenever the words of the lexicon are loaded.
+//
+//! @param lexicon the name of the lexicon
+//---------------------------------------------------------------------------
+void
+WordEngine::collectStats(const QString& lexicon)
+{
+    LexiconData* lexData = lexiconData.value(lexicon);
+    if (!lexData || !lexData->graph)
+        return;
+
+    lexData->stats.numWords = lexData->graph->getNumWords();
+    lexData->stats.lengthCounts = lexData->graph->getLengthCounts();
+}
+
+//---------------------------------------------------------------------------
+//  estimateSelectivity
+//
+//! Estimate the fraction of the words of a lexicon that match a search
+//! condition.  Probability and Playability Order conditions are estimated
+//! from the number of words of each length allowed by the search spec, since
+//! orders are numbered separately for each length; other conditions are
+//! estimated from rough rules of thumb.
+//
+//! @param lexicon the name of the lexicon
+//! @param condition the search condition
+//! @param spec the search spec holding the condition
+//! @return the estimated fraction of words matching the condition
+//---------------------------------------------------------------------------
+double
+WordEngine::estimateSelectivity(const QString& lexicon, const
+                                SearchCondition& condition, const SearchSpec&
+                                spec) const
+{
+    const LexiconData* lexData = lexiconData.value(lexicon);
+    if (!lexData)
+        return 1.0;
+
+    const LexiconStats& stats = lexData->stats;
+    const QVector<int>& lengthCounts = stats.lengthCounts;
+    double numWords = qMax(stats.numWords, 1);
+
+    // Count the words of the lengths allowed by the spec
+    int minLength = 1;
+    int maxLength = MAX_WORD_LEN;
+    foreach (const SearchCondition& c, spec.conditions) {
+        if (c.type == SearchCondition::Length) {
+            minLength = qMax(minLength, c.minValue);
+            maxLength = qMin(maxLength, c.maxValue);
+        }
+    }
+
+    double selectivity = 1.0;
+    int minValue = condition.minValue;
+    int maxValue = condition.maxValue;
+    switch (condition.type) {
+        case SearchCondition::Length: {
+            if (lengthCounts.isEmpty()) {
+                selectivity = double(qMin(maxValue, int(MAX_WORD_LEN)) -
+                                     qMax(minValue, 1) + 1) / MAX_WORD_LEN;
+                break;
+            }
+            double count = 0;
+            for (int i = qMax(minValue, 0);
+                 i <= qMin(maxValue, lengthCounts.size() - 1); ++i)
+            {
+                count += lengthCounts.at(i);
+            }
+            selectivity = count / numWords;
+        }
+        break;
+
+        case SearchCondition::ProbabilityOrder:
+        case SearchCondition::PlayabilityOrder: {
+            if (lengthCounts.isEmpty()) {
+                selectivity = 0.1;
+                break;
+            }
+            double count = 0;
+            double matched = 0;
+            for (int i = minLength;
+                 i <= qMin(maxLength, lengthCounts.size() - 1); ++i)
+            {
+                int lengthCount = lengthCounts.at(i);
+                int low = qMax(minValue, 1);
+                int high = qMin(maxValue, lengthCount);
+                count += lengthCount;
+                if (high >= low)
+                    matched += high - low + 1;
+            }
+            selectivity = count ? (matched / count) : 0.0;
+        }
+        break;
+
+        case SearchCondition::NumVowels:
+        case SearchCondition::NumUniqueLetters:
+        case SearchCondition::PointValue: {
+            int low = 0;
+            int high = 7;
+            if (condition.type == SearchCondition::NumUniqueLetters) {
+                low = 1;
+                high = 12;
+            }
+            else if (condition.type == SearchCondition::PointValue) {
+                low = 1;
+                high = 40;
+            }
+            int span = qMin(maxValue, high) - qMax(minValue, low) + 1;
+            selectivity = double(qMax(span, 0)) / (high - low + 1);
+        }
+        break;
+
+        // Most words have no anagrams besides themselves
+        case SearchCondition::NumAnagrams: {
+            int span = qMin(maxValue, 10) - qMax(minValue, 2) + 1;
+            selectivity = ((minValue <= 1) && (maxValue >= 1) ? 0.75 : 0.0)
+                + (0.25 * qMax(span, 0) / 9);
+        }
+        break;
+
+        case SearchCondition::PatternMatch:
+        case SearchCondition::AnagramMatch:
+        case SearchCondition::SubanagramMatch: {
+            const QString& str = condition.stringValue;
+            int numLetters = 0;
+            bool inClass = false;
+            for (int i = 0; i < str.length(); ++i) {
+                QChar c = str.at(i);
+                if (c == '[')
+                    inClass = true;
+                else if (c == ']')
+                    inClass = false;
+                else if (!inClass && c.isLetter())
+                    ++numLetters;
+            }
+
+            if (condition.type == SearchCondition::PatternMatch) {
+                selectivity = pow(0.12, numLetters);
+                if (!str.contains('*'))
+                    selectivity *= 0.1;
+            }
+            else if (str.contains('*'))
+                selectivity = 0.01;
+            else if (condition.type == SearchCondition::AnagramMatch)
+                selectivity = qMin(1.0, 1e-5 * pow(20.0, str.length() -
+                                                   numLetters));
+            else
+                selectivity = 1e-3;
+        }
+        break;
+
+        case SearchCondition::IncludeLetters:
+        selectivity = pow(0.35, condition.stringValue.length());
+        break;
+
+        case SearchCondition::InWordList:
+        selectivity =
+            condition.stringValue.split(QChar(' ')).size() / numWords;
+        break;
+
+        case SearchCondition::BelongToGroup: {
+            SearchSet searchSet =
+                Auxil::stringToSearchSet(condition.stringValue);
+            selectivity = ((searchSet == SetHookWords) ||
+                           (searchSet == SetFrontHooks) ||
+                           (searchSet == SetBackHooks)) ? 0.3 : 0.1;
+        }
+        break;
+
+        case SearchCondition::ConsistOf:    selectivity = 0.3;  break;
+        case SearchCondition::Prefix:
+        case SearchCondition::Suffix:       selectivity = 0.05; break;
+        case SearchCondition::PartOfSpeech: selectivity = 0.3;  break;
+        case SearchCondition::Definition:   selectivity = 0.02; break;
+        case SearchCondition::InLexicon:    selectivity = 0.9;  break;
+
+        case SearchCondition::LimitByProbabilityOrder:
+        case SearchCondition::LimitByPlayabilityOrder:
+        selectivity = 0.5;
+        break;
+
+        default: break;
+    }
+
+    if (condition.negated)
+        selectivity = 1.0 - selectivity;
+    return qBound(1e-6, selectivity, 1.0);
+}
+
+//---------------------------------------------------------------------------
+//  estimateCost
+//
+//! Estimate the cost of running a step of a search plan.
+//
+//! @param lexicon the name of the lexicon
+//! @param step the step, with its selectivities and output size estimated
+//! @param numInput the estimated number of words passed to the step
+//! @param first whether the step finds the first list of words rather than
+//! narrowing a list
+//! @return the estimated cost
+//---------------------------------------------------------------------------
+double
+WordEngine::estimateCost(const QString& lexicon, const PlanStep& step,
+                         double numInput, bool first) const
+{
+    const LexiconData* lexData = lexiconData.value(lexicon);
+    double numWords = lexData ? qMax(lexData->stats.numWords, 1) : 1;
+    double numOutput = step.numWords;
+    const QList<SearchCondition>& conditions = step.spec.conditions;
+
+    switch (step.phase) {
+        // A traversal only skips the words below a node for conditions on
+        // the letters of a word; others are checked once a word is found
+        case WordGraphPhase: {
+            if (!first)
+                return numInput * GRAPH_CHECK_COST;
+
+            double visited = 1.0;
+            for (int i = 0; i < conditions.size(); ++i) {
+                const SearchCondition& condition = conditions.at(i);
+                double selectivity = step.selectivities.at(i);
+                switch (condition.type) {
+                    case SearchCondition::Length:
+                    case SearchCondition::PatternMatch:
+                    case SearchCondition::AnagramMatch:
+                    case SearchCondition::SubanagramMatch:
+                    if (!condition.negated)
+                        visited *= selectivity;
+                    break;
+
+                    case SearchCondition::IncludeLetters:
+                    case SearchCondition::ConsistOf:
+                    case SearchCondition::NumVowels:
+                    case SearchCondition::NumUniqueLetters:
+                    case SearchCondition::PointValue:
+                    visited *= sqrt(selectivity);
+                    break;
+
+                    default: break;
+                }
+            }
+            return (numWords * qMax(visited, 1e-4) * GRAPH_VISIT_COST) +
+                (numOutput * RESULT_WORD_COST);
+        }
+
+        case AttributePhase:
+        return (numWords / 32 * conditions.size() * ATTRIBUTE_BLOCK_COST) +
+            (first ? numOutput * RESULT_WORD_COST
+                   : numInput * ATTRIBUTE_LOOKUP_COST);
+
+        // A database query reads only the rows found by an index on length
+        // and order, or on word, if the conditions allow it
+        case DatabasePhase: {
+            if (!first) {
+                return DATABASE_QUERY_COST +
+                    (numInput * 2 * DATABASE_ROW_COST);
+            }
+
+            double lengthSelectivity = 1.0;
+            double orderSelectivity = 1.0;
+            double wordSelectivity = 1.0;
+            for (int i = 0; i < conditions.size(); ++i) {
+                const SearchCondition& condition = conditions.at(i);
+                double selectivity = step.selectivities.at(i);
+                switch (condition.type) {
+                    case SearchCondition::Length:
+                    lengthSelectivity *= selectivity;
+                    break;
+
+                    case SearchCondition::ProbabilityOrder:
+                    case SearchCondition::PlayabilityOrder:
+                    orderSelectivity = qMin(orderSelectivity, selectivity);
+                    break;
+
+                    case SearchCondition::InWordList:
+                    if (!condition.negated)
+                        wordSelectivity = qMin(wordSelectivity, selectivity);
+                    break;
+
+                    default: break;
+                }
+            }
+            double scanned = numWords * qMin(wordSelectivity,
+                qMin(lengthSelectivity, 1.0) * orderSelectivity);
+            return DATABASE_QUERY_COST + (scanned * DATABASE_ROW_COST) +
+                (numOutput * RESULT_WORD_COST);
+        }
+
+        case PostConditionPhase:
+        return numInput * POST_CONDITION_COST;
+
+        default:
+        return 0;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  buildPlan
+//
+//! Build the cheapest search plan in which a particular engine finds the
+//! first list of words.  Each condition is matched by that engine if it
+//! can be, and otherwise by the engine it is usually matched by.  The other
+//! engines then narrow the list in the cheapest order, and post conditions
+//! are checked last.
+//
+//! @param lexicon the name of the lexicon
+//! @param optimizedSpec the search spec
+//! @param driver the phase finding the first list of words
+//! @return the plan, or an invalid plan if the engine cannot find the first
+//! list of words
+//---------------------------------------------------------------------------
+WordEngine::SearchPlan
+WordEngine::buildPlan(const QString& lexicon, const SearchSpec&
+                      optimizedSpec, ConditionPhase driver) const
+{
+    // Assign each condition to a phase.  The engine cannot find the first
+    // list of words if a condition it cannot match would be left to it, as
+    // when the lexicon has no database.
+    QMap<ConditionPhase, PlanStep> steps;
+    foreach (const SearchCondition& condition, optimizedSpec.conditions) {
+        ConditionPhase phase = getConditionPhase(lexicon, condition);
+        if (conditionAllowsPhase(lexicon, condition, driver))
+            phase = driver;
+        else if (phase == driver)
+            return SearchPlan();
+        if (phase == UnknownPhase)
+            continue;
+
+        PlanStep& step = steps[phase];
+        step.phase = phase;
+        step.spec.conjunction = optimizedSpec.conjunction;
+        step.spec.conditions.append(condition);
+        step.selectivities.append(
+            estimateSelectivity(lexicon, condition, optimizedSpec));
+    }
+
+    // The word graph finds every word if nothing else can find a first list
+    // of words
+    if (!steps.contains(driver)) {
+        if ((driver != WordGraphPhase) || steps.contains(AttributePhase) ||
+            steps.contains(DatabasePhase))
+        {
+            return SearchPlan();
+        }
+        SearchCondition condition;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = "*";
+        PlanStep& step = steps[WordGraphPhase];
+        step.phase = WordGraphPhase;
+        step.spec.conjunction = optimizedSpec.conjunction;
+        step.spec.conditions.append(condition);
+        step.selectivities.append(1.0);
+    }
+
+    // The word graph can only narrow a list if it does not have to traverse
+    // the graph to show wildcard matches or combine match conditions
+    const WordGraph* graph = lexiconData.value(lexicon)->graph;
+    if ((driver != WordGraphPhase) && steps.contains(WordGraphPhase) &&
+        !graph->canFilterWords(steps.value(WordGraphPhase).spec))
+    {
+        return SearchPlan();
+    }
+
+    QList<PlanStep> filters;
+    QMapIterator<ConditionPhase, PlanStep> it (steps);
+    while (it.hasNext()) {
+        it.next();
+        if ((it.key() != driver) && (it.key() != PostConditionPhase))
+            filters.append(it.value());
+    }
+
+    // Try each order of the steps narrowing the list
+    const LexiconData* lexData = lexiconData.value(lexicon);
+    double numWords = qMax(lexData->stats.numWords, 1);
+    SearchPlan bestPlan;
+    int numOrders = (filters.size() > 1) ? 2 : 1;
+    for (int order = 0; order < numOrders; ++order) {
+        SearchPlan plan;
+        plan.steps.append(steps.value(driver));
+        if (order)
+            plan.steps += QList<PlanStep>() << filters.at(1) << filters.at(0);
+        else
+            plan.steps += filters;
+        if (steps.contains(PostConditionPhase))
+            plan.steps.append(steps.value(PostConditionPhase));
+
+        double numInput = numWords;
+        for (int i = 0; i < plan.steps.size(); ++i) {
+            PlanStep& step = plan.steps[i];
+            double selectivity = 1.0;
+            foreach (double s, step.selectivities)
+                selectivity *= s;
+            step.numWords = numInput * selectivity;
+            step.cost = estimateCost(lexicon, step, numInput, !i);
+            plan.cost += step.cost;
+            numInput = step.numWords;
+        }
+
+        if (!bestPlan.isValid() || (plan.cost < bestPlan.cost))
+            bestPlan = plan;
+    }
+
+    return bestPlan;
+}
+
+//---------------------------------------------------------------------------
+//  planSearch
+//
+//! Plan a search, choosing which engine finds the first list of words by
+//! comparing the estimated costs of the plans driven by each engine.  The
+//! word graph is preferred when costs are equal.
+//
+//! @param lexicon the name of the lexicon
+//! @param optimizedSpec the search spec
+//! @param alternatives returns the plans that were not chosen
+//! @return the cheapest plan, or an invalid plan if the spec has no
+//! conditions
+//---------------------------------------------------------------------------
+WordEngine::SearchPlan
+WordEngine::planSearch(const QString& lexicon, const SearchSpec&
+                       optimizedSpec, QList<SearchPlan>* alternatives) const
+{
+    SearchPlan bestPlan;
+    if (!lexiconData.contains(lexicon) || !lexiconData[lexicon]->graph ||
+        optimizedSpec.conditions.isEmpty())
+    {
+        return bestPlan;
+    }
+
+    // Disjunctions are only matched by the word graph
+    int numDrivers = optimizedSpec.conjunction ? 3 : 1;
+    const ConditionPhase drivers[] =
+        { WordGraphPhase, AttributePhase, DatabasePhase };
+    for (int i = 0; i < numDrivers; ++i) {
+        SearchPlan plan = buildPlan(lexicon, optimizedSpec, drivers[i]);
+        if (!plan.isValid())
+            continue;
+
+        if (!bestPlan.isValid() || (plan.cost < bestPlan.cost)) {
+            if (alternatives && bestPlan.isValid())
+                alternatives->append(bestPlan);
+            bestPlan = plan;
+        }
+        else if (alternatives)
+            alternatives->append(plan);
+    }
+
+    return bestPlan;
+}
+
+//---------------------------------------------------------------------------
+//  explainSearch
+//
+//! Describe the plan that would be used to run a search, with the estimated
+//! number of words and cost of each step, and the estimated costs of the
+//! plans that were not chosen.
+//
+//! @param lexicon the name of the lexicon
+//! @param spec the search specification
+//! @return the description of the plan
+//---------------------------------------------------------------------------
+QString
+WordEngine::explainSearch(const QString& lexicon, const SearchSpec& spec)
+    const
+{
+    SearchSpec optimizedSpec = spec;
+    optimizedSpec.optimize(lexicon);
+
+    QList<SearchPlan> alternatives;
+    SearchPlan plan = planSearch(lexicon, optimizedSpec, &alternatives);
+    if (!plan.isValid())
+        return "No search is needed: no words can match.\n";
+
+    QString str;
+    for (int i = 0; i < plan.steps.size(); ++i) {
+        const PlanStep& step = plan.steps.at(i);
+        str += QString("%1. %2 %3: about %4 words, cost %5\n")
+            .arg(i + 1)
+            .arg(i ? "Narrow the list with the" : "Find words with the")
+            .arg(getPhaseName(step.phase))
+            .arg(step.numWords, 0, 'f', 0)
+            .arg(step.cost, 0, 'f', 0);
+        for (int j = 0; j < step.spec.conditions.size(); ++j) {
+            str += QString("    %1 (matches %2%)\n")
+                .arg(step.spec.conditions.at(j).asString())
+                .arg(step.selectivities.at(j) * 100, 0, 'g', 3);
+        }
+    }
+    str += QString("Estimated cost: %1\n").arg(plan.cost, 0, 'f', 0);
+
+    foreach (const SearchPlan& alternative, alternatives) {
+        str += QString("Rejected: finding words with the %1, cost %2\n")
+            .arg(getPhaseName(alternative.steps.first().phase))
+            .arg(alternative.cost, 0, 'f', 0);
+    }
+    return str;
+}
+
+//---------------------------------------------------------------------------
+//  getPhaseName
+//
+//! Get the name of the engine matching the conditions of a search phase.
+//
+//! @param phase the search phase
+//! @return the name
+//---------------------------------------------------------------------------
+QString
+WordEngine::getPhaseName(ConditionPhase phase)
+{
+    switch (phase) {
+        case WordGraphPhase:     return "word graph";
+        case AttributePhase:     return "attribute store";
+        case DatabasePhase:      return "database";
+        case PostConditionPhase: return "post conditions";
+        default:                 return "unknown phase";
+    }
+}
@@ -25,15 +25,27 @@
 #ifndef ZYZZYVA_WORD_ENGINE_H
 #define ZYZZYVA_WORD_ENGINE_H
 
+#include "AttributeStore.h"
+#include "CancelToken.h"
+#include "QueryHelper.h"
 #include "WordGraph.h"
+#include "WordKey.h"
+#include <QBitArray>
+#include <QCache>
 #include <QMap>
 #include <QMultiMap>
+#include <QMutex>
+#include <QPointer>
 #include <QSet>
 #include <QString>
 #include <QStringList>
 #include <QSqlDatabase>
+#include <QVector>
 #include <stdint.h>
 
+class QThread;
+class SearchThread;
+
 class WordEngine : public QObject
 {
     Q_OBJECT
@@ -75,28 +87,109 @@ class WordEngine : public QObject
         QMap<int, ValueOrder> blankProbabilityOrder;
     };
 
+    // Information about recently used words, indexed by word ID.  Holds a
+    // bounded number of words, evicting those not used since the clock hand
+    // last passed them, and counts the lookups that hit and miss.
+    class WordCache {
+        public:
+        WordCache() : hits(0), misses(0), hand(0) { }
+
+        void clear();
+        bool contains(int id) const {
+            return (id >= 0) && (id < entrySlots.size()) &&
+                (entrySlots.at(id) >= 0);
+        }
+        const WordInfo* find(int id);
+        WordInfo value(int id) const {
+            return contains(id) ? entries.at(entrySlots.at(id)) : WordInfo();
+        }
+        void insert(int id, const WordInfo& info);
+        int size() const { return entries.size(); }
+
+        public:
+        qint64 hits;
+        qint64 misses;
+
+        private:
+        QVector<WordInfo> entries;
+        QVector<qint32> entryIds;
+        QVector<bool> referenced;
+        QVector<qint32> entrySlots;
+        int hand;
+    };
+
+    // Results of recent searches, keyed by the canonical string of their
+    // optimized search specs.  Holds a bounded number of bytes, evicting the
+    // least recently used results, and counts the lookups that hit and miss.
+    class SearchCache {
+        public:
+        SearchCache();
+
+        void clear() { cache.clear(); }
+        bool find(const QString& key, QStringList& words);
+        void insert(const QString& key, const QStringList& words);
+        int getNumBytes() const { return cache.totalCost(); }
+
+        public:
+        qint64 hits;
+        qint64 misses;
+
+        private:
+        QCache<QString, QStringList> cache;
+    };
+
+    // Statistics about the words of a lexicon, collected when the lexicon
+    // is loaded, for estimating how many words a search condition matches
+    class LexiconStats {
+        public:
+        LexiconStats() : numWords(0) { }
+
+        public:
+        int numWords;
+        QVector<int> lengthCounts;
+    };
+
+    // A database connection opened for a lexicon on a thread other than
+    // the engine's own, since a connection can only be used by the thread
+    // that opened it
+    class ThreadDatabase {
+        public:
+        ThreadDatabase() : db(0), queries(0) { }
+
+        public:
+        QSqlDatabase* db;
+        QueryHelper* queries;
+        QString connectionName;
+    };
+
     class LexiconData {
         public:
-        LexiconData() : graph(0), db(0) { }
+        LexiconData() : graph(0), db(0), queries(0), attributes(0),
+                        attributesFailed(false) { }
 
         public:
         QString name;
         QString lexiconFile;
         QMap<QString, QMultiMap<QString, QString> > definitions;
         QMap<int, QStringList> stems;
-        QMap<QString, int> numAnagramsMap;
-        QMap<QString, qint64> playabilityMap;
-        QMap<int, QSet<QString> > stemAlphagrams;
-        mutable QMap<QString, WordInfo> wordCache;
+        QMap<int, QSet<WordKey> > stemAlphagrams;
+
+        mutable WordCache wordCache;
+        mutable SearchCache searchCache;
+        LexiconStats stats;
         WordGraph* graph;
         QSqlDatabase* db;
+        QueryHelper* queries;
         QString dbConnectionName;
+        QMap<QThread*, ThreadDatabase> threadDatabases;
+        mutable AttributeStore* attributes;
+        mutable bool attributesFailed;
     };
 
     public:
     WordEngine(QObject* parent = 0)
-        : QObject(parent) { }
-    ~WordEngine() { }
+        : QObject(parent), mutex(QMutex::Recursive) { }
+    ~WordEngine();
 
     bool connectToDatabase(const QString& lexicon, const QString& filename,
                            QString* errString = 0);
@@ -107,16 +200,26 @@ class WordEngine : public QObject
     bool importDawgFile(const QString& lexicon, const QString& filename, bool
                         reverse = false, QString* errString = 0, quint16*
                         expectedChecksum = 0);
+    bool buildInfixIndex(const QString& lexicon);
     int importStems(const QString& lexicon, const QString& filename,
                     QString* errString = 0);
     bool lexiconIsLoaded(const QString& lexicon) const;
     bool isAcceptable(const QString& lexicon, const QString& word) const;
+    QBitArray areAcceptable(const QString& lexicon, const QStringList& words)
+        const;
     QStringList search(const QString& lexicon, const SearchSpec& spec,
-                       bool allCaps) const;
+                       bool allCaps, SearchThread* searchThread = 0) const;
+    SearchThread* createSearchThread(const QString& lexicon,
+                                     const SearchSpec& spec, bool allCaps);
+    void releaseThreadDatabases() const;
+    QString explainSearch(const QString& lexicon, const SearchSpec& spec)
+        const;
     QStringList wordGraphSearch(const QString& lexicon, const SearchSpec&
-                                spec) const;
+                                spec, const CancelToken* cancelToken = 0)
+                                const;
     QStringList alphagrams(const QStringList& strList) const;
     int getNumWords(const QString& lexicon) const;
+    int countAnagrams(const QString& lexicon, const QString& word) const;
     QString getLexiconFile(const QString& lexicon) const;
     WordInfo getWordInfo(const QString& lexicon, const QString& word) const;
     QString getDefinition(const QString& lexicon, const QString& word,
@@ -149,17 +252,66 @@ class WordEngine : public QObject
     QString getLexiconSymbols(const QString& lexicon, const QString& word) const;
 
     void addToCache(const QString& lexicon, const QStringList& words) const;
+    qint64 getCacheHits(const QString& lexicon) const;
+    qint64 getCacheMisses(const QString& lexicon) const;
+    qint64 getSearchCacheHits(const QString& lexicon) const;
+    qint64 getSearchCacheMisses(const QString& lexicon) const;
+    int getSearchCacheBytes(const QString& lexicon) const;
 
     private:
     enum ConditionPhase {
         UnknownPhase = 0,
         WordGraphPhase,
+        AttributePhase,
         DatabasePhase,
         PostConditionPhase
     };
 
+    // The conditions of a search matched by one engine, either finding the
+    // first list of words or narrowing the list found by the steps before
+    class PlanStep {
+        public:
+        PlanStep() : phase(UnknownPhase), numWords(0), cost(0) { }
+
+        public:
+        ConditionPhase phase;
+        SearchSpec spec;
+        QList<double> selectivities;
+        double numWords;
+        double cost;
+    };
+
+    // The steps of a search in the order they are run, and their estimated
+    // total cost
+    class SearchPlan {
+        public:
+        SearchPlan() : cost(0) { }
+        bool isValid() const { return !steps.isEmpty(); }
+
+        public:
+        QList<PlanStep> steps;
+        double cost;
+    };
+
+    // Collects the letter at one end of each word found by a graph search,
+    // for finding the hooks of a word without creating a list of words
+    class HookLetterVisitor : public WordGraph::WordVisitor {
+        public:
+        HookLetterVisitor(bool f) : front(f) { }
+        bool visitWord(const char* word, int length);
+
+        public:
+        bool front;
+        QList<QChar> letters;
+    };
+
     private:
+    QString getHookLetters(const QString& lexicon, const QString& pattern,
+                           bool front) const;
     void clearCache(const QString& lexicon) const;
+    void clearSearchCaches() const;
+    QList<WordInfo> queryWordInfo(const QString& lexicon,
+                                  const QStringList& words) const;
     bool matchesPostConditions(const QString& lexicon, const QString& word,
                                const QList<SearchCondition>& conditions) const;
     bool isSetMember(const QString& lexicon, const QString& word,
@@ -169,16 +321,51 @@ class WordEngine : public QObject
                                const SearchSpec& spec) const;
     void addDefinition(const QString& lexicon, const QString& word,
                        const QString& definition);
+    const AttributeStore* getAttributeStore(const QString& lexicon) const;
+    QStringList attributeSearch(const QString& lexicon, const SearchSpec&
+                                optimizedSpec, const QStringList* wordList = 0)
+                                const;
     QStringList databaseSearch(const QString& lexicon, const SearchSpec&
-                               optimizedSpec, const QStringList* wordList = 0)
-                               const;
+                               optimizedSpec, const QStringList* wordList = 0,
+                               const CancelToken* cancelToken = 0) const;
     QStringList applyPostConditions(const QString& lexicon, const SearchSpec&
                                     optimizedSpec, const QStringList&
-                                    wordList) const;
-    ConditionPhase getConditionPhase(const SearchCondition& condition) const;
+                                    wordList, const CancelToken* cancelToken
+                                    = 0) const;
+    ThreadDatabase getThreadDatabase(const QString& lexicon) const;
+    ConditionPhase getConditionPhase(const QString& lexicon,
+                                     const SearchCondition& condition) const;
+    bool conditionAllowsPhase(const QString& lexicon, const SearchCondition&
+                              condition, ConditionPhase phase) const;
+    void collectStats(const QString& lexicon);
+    double estimateSelectivity(const QString& lexicon, const SearchCondition&
+                               condition, const SearchSpec& spec) const;
+    double estimateCost(const QString& lexicon, const PlanStep& step,
+                        double numInput, bool first) const;
+    SearchPlan planSearch(const QString& lexicon, const SearchSpec&
+                          optimizedSpec, QList<SearchPlan>* alternatives = 0)
+                          const;
+    SearchPlan buildPlan(const QString& lexicon, const SearchSpec&
+                         optimizedSpec, ConditionPhase driver) const;
+    static QString getPhaseName(ConditionPhase phase);
+    QStringList runPlanStep(const QString& lexicon, const PlanStep& step,
+                            const QStringList* wordList,
+                            const CancelToken* cancelToken) const;
+    static bool stepNarrowsInBatches(const PlanStep& step);
+    static void reportWords(SearchThread* searchThread,
+                            const QStringList& words, bool allCaps);
+    void stopSearchThreads();
 
     private:
     QMap<QString, LexiconData*> lexiconData;
+
+    // Guards the caches and per-thread database connections of every
+    // lexicon while searches run on other threads
+    mutable QMutex mutex;
+
+    // Search threads created by the engine that have not been deleted.
+    // They are stopped before a lexicon is changed or removed.
+    QList<QPointer<SearchThread> > searchThreads;
 };
 
 #endif // ZYZZYVA_WORD_ENGINE_H
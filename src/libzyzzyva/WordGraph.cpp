@@ -23,10 +23,19 @@
 //---------------------------------------------------------------------------
 
 #include "WordGraph.h"
+#include "Auxil.h"
+#include "DawgBuilder.h"
 #include "Defs.h"
+#include "LetterBag.h"
 #include <QFile>
+#include <QHash>
 #include <QList>
+#include <QMutexLocker>
+#include <QPair>
 #include <QRegExp>
+#include <QThreadPool>
+#include <QVector>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <stack>
@@ -43,16 +52,73 @@ const qint32 V_LETTER       = 24;
 const qint32 M_LETTER       = 0xFF;
 const qint32 M_NODE_POINTER = 0x1FFFFFL;
 
+// Byte separating the reversed prefix of a word from the rest of the word in
+// the infix index.  Never a letter of a word.
+const char INFIX_SEPARATOR = '\x01';
+
+// Number of traversal states a search task traverses before splitting the
+// rest of its traversal among other threads
+const int SPLIT_STATES = 20000;
+
+// Number of traversal states a traversal visits between checks of whether
+// its search has been cancelled, minus one
+const int CANCEL_CHECK_MASK = 0xFFF;
+
 using namespace std;
 using namespace Defs;
 
+//---------------------------------------------------------------------------
+//  toLowerLetter
+//
+//! Convert a single-byte DAWG letter to lower case.
+//
+//! @param letter the letter
+//! @return the lower case letter
+//---------------------------------------------------------------------------
+inline char
+toLowerLetter(char letter)
+{
+    return QChar::fromLatin1(letter).toLower().toLatin1();
+}
+
+//---------------------------------------------------------------------------
+//  toUpperLetter
+//
+//! Convert a single-byte DAWG letter to upper case.
+//
+//! @param letter the letter
+//! @return the upper case letter
+//---------------------------------------------------------------------------
+inline char
+toUpperLetter(char letter)
+{
+    return QChar::fromLatin1(letter).toUpper().toLatin1();
+}
+
+//---------------------------------------------------------------------------
+//  countBits
+//
+//! Count the bits set in a 32-bit value.
+//
+//! @param bits the value
+//! @return the number of bits set
+//---------------------------------------------------------------------------
+inline int
+countBits(quint32 bits)
+{
+    bits = bits - ((bits >> 1) & 0x55555555);
+    bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+    return (((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
 //---------------------------------------------------------------------------
 //  WordGraph
 //
 //! Constructor.
 //---------------------------------------------------------------------------
 WordGraph::WordGraph()
-    : dawg(0), rdawg(0), top(0), rtop(0), numWords(0)
+    : dawg(0), rdawg(0), dawgFile(0), rdawgFile(0), gaddag(0),
+      anagramIndexFailed(false), top(0), rtop(0), numWords(0)
 {
     // Test for endianness
     char endianTest[2] = { 1, 0 };
@@ -77,12 +143,9 @@ WordGraph::~WordGraph()
 void
 WordGraph::clear()
 {
-    if (dawg)
-        delete[] dawg;
-    if (rdawg)
-        delete[] rdawg;
-    dawg = 0;
-    rdawg = 0;
+    releaseDawg(false);
+    releaseDawg(true);
+    releaseInfixIndex();
 }
 
 //---------------------------------------------------------------------------
@@ -101,42 +164,63 @@ bool
 WordGraph::importDawgFile(const QString& filename, bool reverse, QString*
                           errString, quint16* expectedChecksum)
 {
-    QFile file (filename);
-    if (!file.open(QIODevice::ReadOnly)) {
+    QFile* file = new QFile(filename);
+    if (!file->open(QIODevice::ReadOnly)) {
         if (errString)
             *errString = "Can't open file '" + filename + "': "
-            + file.errorString();
+            + file->errorString();
+        delete file;
         return false;
     }
 
     qint32 numEdges;
     qint32* p = &numEdges;
     char* cp = (char*) p;
-    file.read(cp, 1 * sizeof(qint32));
+    file->read(cp, 1 * sizeof(qint32));
     if (bigEndian)
         convertEndian(p, 1);
 
-    if (reverse) {
-        rdawg = new qint32[numEdges + 1];
-        rdawg[0] = 0;
-        p = &rdawg[1];
-        cp = (char*) p;
-        file.read(cp, numEdges * sizeof(qint32));
+    qint64 dawgSize = (qint64(numEdges) + 1) * sizeof(qint32);
+    if ((numEdges < 0) || (file->size() < dawgSize)) {
+        if (errString)
+            *errString = "The lexicon file '" + filename + "' is truncated.";
+        delete file;
+        return false;
+    }
+
+    releaseDawg(reverse);
+    if (!reverse)
+        releaseInfixIndex();
+
+    // Map the file read-only so that its pages are shared by every process
+    // using the same lexicon.  The first word of the file holds the edge
+    // count rather than a zero, but the edge at index 0 is never read since
+    // it is the terminal node.  Fall back to copying the file into a heap
+    // array if it cannot be mapped, or on big-endian hosts where the edges
+    // must be converted.
+    const qint32* data = 0;
+    qint32* buffer = 0;
+    if (!bigEndian)
+        data = (const qint32*) file->map(0, dawgSize);
+
+    if (data) {
+        (reverse ? rdawgFile : dawgFile) = file;
     }
     else {
-        dawg = new qint32[numEdges + 1];
-        dawg[0] = 0;
-        p = &dawg[1];
-        cp = (char*) p;
-        file.read(cp, numEdges * sizeof(qint32));
+        buffer = new qint32[numEdges + 1];
+        buffer[0] = 0;
+        cp = (char*) &buffer[1];
+        file->read(cp, numEdges * sizeof(qint32));
+        delete file;
+        data = buffer;
     }
 
     if (expectedChecksum && errString) {
-        char* cp = (char*) p;
+        const char* ccp = (const char*) &data[1];
         //qDebug("file: %s", filename.toUtf8().constData());
         //qDebug("expected checksum: %d", *expectedChecksum);
-        //qDebug("got checksum:      %d", qChecksum(cp, numEdges));
-        if (*expectedChecksum != qChecksum(cp, numEdges)) {
+        //qDebug("got checksum:      %d", qChecksum(ccp, numEdges));
+        if (*expectedChecksum != qChecksum(ccp, numEdges)) {
             *errString =
                 "The lexicon checksum does not match the expected checksum.  "
                 "It is possible the lexicon has been corrupted.";
@@ -144,11 +228,497 @@ WordGraph::importDawgFile(const QString& filename, bool reverse, QString*
     }
 
     if (bigEndian)
-        convertEndian(p, numEdges);
+        convertEndian(&buffer[1], numEdges);
+
+    (reverse ? rdawg : dawg) = data;
+    annotateDawg(reverse, numEdges);
+    if (!reverse)
+        indexDawg(numEdges);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  importWords
+//
+//! Build forward and reverse DAWGs from a list of words, packed the same way
+//! as imported DAWG files so that they are searched the same way.  Words
+//! longer than MAX_WORD_LEN cannot be numbered or searched in a packed
+//! DAWG, so a list containing one is not packed, and should be added to
+//! the old-style graph instead.
+//
+//! @param words the words to import, in any order
+//! @return true if successful, false if the words cannot be packed, in which
+//! case the graph is unchanged
+//---------------------------------------------------------------------------
+bool
+WordGraph::importWords(const QStringList& words)
+{
+    QList<QByteArray> forwardWords;
+    QList<QByteArray> reverseWords;
+    foreach (const QString& word, words) {
+        if (word.isEmpty())
+            continue;
+        if (word.length() > MAX_WORD_LEN)
+            return false;
+        QByteArray letters = word.toLatin1();
+        if (QString::fromLatin1(letters.constData(), letters.length()) != word)
+            return false;
+        int length = letters.length();
+        QByteArray reversed (length, 0);
+        for (int i = 0; i < length; ++i)
+            reversed[i] = letters.at(length - i - 1);
+        forwardWords.append(letters);
+        reverseWords.append(reversed);
+    }
+
+    qSort(forwardWords);
+    qSort(reverseWords);
+
+    QVector<qint32> edges[2];
+    for (int i = 0; i < 2; ++i) {
+        const QList<QByteArray>& dirWords = (i ? reverseWords : forwardWords);
+        DawgBuilder builder;
+        foreach (const QByteArray& word, dirWords)
+            builder.addWord(word);
+        edges[i] = builder.finish();
+        if (edges[i].isEmpty())
+            return false;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        bool reverse = i;
+        qint32 numEdges = edges[i].size() - 1;
+        qint32* buffer = new qint32[numEdges + 1];
+        memcpy(buffer, edges[i].constData(), (numEdges + 1) * sizeof(qint32));
+        edges[i].clear();
+
+        releaseDawg(reverse);
+        if (!reverse)
+            releaseInfixIndex();
+        (reverse ? rdawg : dawg) = buffer;
+        annotateDawg(reverse, numEdges);
+        if (!reverse)
+            indexDawg(numEdges);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  buildInfixIndex
+//
+//! Build an index in which each word of the forward DAWG is entered once for
+//! each of its prefixes, as the prefix spelled backward followed by a
+//! separator and the rest of the word.  A word containing a substring can
+//! then be found by matching the substring spelled backward from the root
+//! of the index, instead of examining every word.  The index takes several
+//! times the memory of the DAWG and some seconds to build, so it is only
+//! built on request, and is released when the forward DAWG is replaced.
+//
+//! @return true if successful, false if there is no forward DAWG or the
+//! index cannot be packed
+//---------------------------------------------------------------------------
+bool
+WordGraph::buildInfixIndex()
+{
+    if (!dawg)
+        return false;
+
+    // Note the letters used by the words
+    QVector<WordKey> words;
+    getAllWords(words);
+    bool usedLetter[256];
+    memset(usedLetter, 0, sizeof(usedLetter));
+    foreach (const WordKey& w, words) {
+        for (int i = 0; i < w.getLength(); ++i)
+            usedLetter[(uchar) w.at(i)] = true;
+    }
+
+    // Generate the entries in groups by their first letter, the last letter
+    // of the prefix, so the entries can be added in order without holding
+    // all of them at once
+    DawgBuilder builder;
+    for (int c = 0; c < 256; ++c) {
+        if (!usedLetter[c])
+            continue;
+
+        QList<QByteArray> entries;
+        foreach (const WordKey& w, words) {
+            int length = w.getLength();
+            for (int i = 1; i <= length; ++i) {
+                if ((uchar) w.at(i - 1) != c)
+                    continue;
+                QByteArray entry;
+                entry.reserve(length + 1);
+                for (int j = i - 1; j >= 0; --j)
+                    entry.append(w.at(j));
+                if (i < length) {
+                    entry.append(INFIX_SEPARATOR);
+                    entry.append(w.getLetters() + i, length - i);
+                }
+                entries.append(entry);
+            }
+        }
+
+        qSort(entries);
+        foreach (const QByteArray& entry, entries)
+            builder.addWord(entry);
+    }
+    words.clear();
+
+    QVector<qint32> edges = builder.finish();
+    if (edges.isEmpty())
+        return false;
+
+    qint32 numEdges = edges.size() - 1;
+    qint32* buffer = new qint32[numEdges + 1];
+    memcpy(buffer, edges.constData(), (numEdges + 1) * sizeof(qint32));
+    edges.clear();
+
+    releaseInfixIndex();
+    gaddag = buffer;
+
+    QVector<quint32> counts (numEdges + 1, 0);
+    gaddagLengths.fill(0, numEdges + 1);
+    if (numEdges >= ROOT_NODE)
+        annotateNode(gaddag, ROOT_NODE, counts.data(), gaddagLengths.data());
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  getAllWords
+//
+//! Collect the words of the forward DAWG in order, so that the position of
+//! each word in the list is its index in the DAWG.  Every word counted by
+//! the DAWG is listed, and a word longer than MAX_WORD_LEN, which only an
+//! imported DAWG file can hold, is listed as an invalid key so the words
+//! after it keep their positions.
+//
+//! @param words returns the words, in upper case
+//---------------------------------------------------------------------------
+void
+WordGraph::getAllWords(QVector<WordKey>& words) const
+{
+    words.clear();
+    if (!dawg)
+        return;
+
+    words.reserve(nodeWordCounts.at(ROOT_NODE));
+    char word[MAX_WORD_LEN];
+    QVector<const qint32*> path;
+    path.append(&dawg[ROOT_NODE]);
+    while (!path.isEmpty()) {
+        const qint32* edge = path.last();
+        int depth = path.size() - 1;
+        if (depth < MAX_WORD_LEN)
+            word[depth] = (char) ((*edge >> V_LETTER) & M_LETTER);
+        if (*edge & M_END_OF_WORD) {
+            words.append((depth < MAX_WORD_LEN) ? WordKey(word, depth + 1)
+                                                : WordKey());
+        }
+
+        qint32 child = *edge & M_NODE_POINTER;
+        if (child) {
+            path.append(&dawg[child]);
+            continue;
+        }
+
+        while (!path.isEmpty() && (*path.last() & M_END_OF_NODE))
+            path.pop_back();
+        if (!path.isEmpty())
+            ++path.last();
+    }
+    Q_ASSERT(words.size() == int(nodeWordCounts.at(ROOT_NODE)));
+}
+
+//---------------------------------------------------------------------------
+//  buildAnagramIndex
+//
+//! Build the index of words by alphagram, if it has not been built.  The
+//! words are sorted by alphagram key, then by ID, so the words sharing an
+//! alphagram form a run of IDs in alphabetical order.  The caller must
+//! hold the table mutex.
+//
+//! @return true if the index is available, false if the graph has no
+//! forward DAWG or a word cannot be packed into an alphagram key
+//---------------------------------------------------------------------------
+bool
+WordGraph::buildAnagramIndex() const
+{
+    if (!anagramIds.isEmpty())
+        return true;
+    if (!dawg || anagramIndexFailed)
+        return false;
+
+    QVector<WordKey> words;
+    getAllWords(words);
+
+    QVector<QPair<AlphagramKey, qint32> > keys;
+    keys.reserve(words.size());
+    for (int i = 0; i < words.size(); ++i) {
+        AlphagramKey key (words.at(i));
+        if (!key.isValid()) {
+            anagramIndexFailed = true;
+            return false;
+        }
+        keys.append(qMakePair(key, qint32(i)));
+    }
+    qSort(keys);
+
+    anagramIds.resize(keys.size());
+    anagramRuns.reserve(keys.size());
+    for (int i = 0; i < keys.size(); ++i) {
+        anagramIds[i] = keys.at(i).second;
+        if (!i || (keys.at(i).first != keys.at(i - 1).first))
+            anagramRuns.insert(keys.at(i).first, AnagramRun(i, 0));
+        ++anagramRuns[keys.at(i).first].count;
+    }
+    return !anagramIds.isEmpty();
+}
+
+//---------------------------------------------------------------------------
+//  getAnagramIds
+//
+//! Look up the words having an alphagram in the anagram index, building
+//! the index the first time it is needed.
+//
+//! @param key the alphagram key
+//! @param ids returns the IDs of the words, in alphabetical order
+//! @return true if the index is available, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::getAnagramIds(const AlphagramKey& key, QVector<qint32>& ids)
+    const
+{
+    ids.clear();
+    QMutexLocker locker (&tableMutex);
+    if (!buildAnagramIndex())
+        return false;
+
+    AnagramRun run = anagramRuns.value(key);
+    ids.resize(run.count);
+    if (run.count) {
+        memcpy(ids.data(), anagramIds.constData() + run.start,
+               run.count * sizeof(qint32));
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  countAnagrams
+//
+//! Count the acceptable anagrams of a word, counting the word itself if it
+//! is acceptable, with a single lookup in the anagram index.
+//
+//! @param word the word
+//! @return the number of anagrams, or -1 if the word or the graph cannot be
+//! indexed by alphagram
+//---------------------------------------------------------------------------
+int
+WordGraph::countAnagrams(const QString& word) const
+{
+    AlphagramKey key ((WordKey(word.toUpper())));
+    QVector<qint32> ids;
+    if (!key.isValid() || !getAnagramIds(key, ids))
+        return -1;
+    return ids.size();
+}
+
+//---------------------------------------------------------------------------
+//  getNumAnagrams
+//
+//! Get the number of anagrams of each word in the graph, counting the word
+//! itself, as stored in the database.  The table is derived from the
+//! anagram index, or computed from the words if the index cannot be built,
+//! the first time it is needed.
+//
+//! @return the anagram counts, indexed by the position of each word in the
+//! forward DAWG
+//---------------------------------------------------------------------------
+const quint16*
+WordGraph::getNumAnagrams() const
+{
+    QMutexLocker locker (&tableMutex);
+    if (!numAnagrams.isEmpty())
+        return numAnagrams.constData();
+
+    if (buildAnagramIndex()) {
+        numAnagrams.resize(anagramIds.size());
+        QHashIterator<AlphagramKey, AnagramRun> it (anagramRuns);
+        while (it.hasNext()) {
+            const AnagramRun& run = it.next().value();
+            quint16 count = qMin(run.count, 0xFFFF);
+            for (int i = 0; i < run.count; ++i)
+                numAnagrams[anagramIds.at(run.start + i)] = count;
+        }
+        return numAnagrams.constData();
+    }
+
+    QVector<WordKey> alphagrams;
+    getAllWords(alphagrams);
+
+    // A word too long for a key only counts itself
+    QHash<WordKey, int> alphagramCounts;
+    for (int i = 0; i < alphagrams.size(); ++i) {
+        alphagrams[i] = alphagrams.at(i).getAlphagram();
+        if (alphagrams.at(i).isValid())
+            ++alphagramCounts[alphagrams.at(i)];
+    }
+
+    numAnagrams.resize(alphagrams.size());
+    for (int i = 0; i < alphagrams.size(); ++i) {
+        numAnagrams[i] = alphagrams.at(i).isValid()
+            ? qMin(alphagramCounts.value(alphagrams.at(i)), 0xFFFF) : 1;
+    }
+    return numAnagrams.constData();
+}
+
+//---------------------------------------------------------------------------
+//  getProbabilityOrders
+//
+//! Get the probability order of each word in the graph among the words of
+//! the same length, and the range of orders shared by equally probable
+//! words, as stored in the database.  The tables are computed the first
+//! time they are needed.
+//
+//! @param numBlanks the number of blanks, from 0 to 2
+//! @return the probability orders, indexed by the position of each word in
+//! the forward DAWG
+//---------------------------------------------------------------------------
+const WordGraph::ProbabilityOrders*
+WordGraph::getProbabilityOrders(int numBlanks) const
+{
+    QMutexLocker locker (&tableMutex);
+    ProbabilityOrders& orders = probabilityOrders[numBlanks];
+    if (orders.order.isEmpty()) {
+        QVector<WordKey> words;
+        getAllWords(words);
+
+        LetterBag letterBag;
+        QVector<RankedWord> rankedWords (words.size());
+        for (int i = 0; i < words.size(); ++i) {
+            const WordKey& word = words.at(i);
+            QString str = word.toString();
+            RankedWord& rankedWord = rankedWords[i];
+            rankedWord.length = word.getLength();
+            rankedWord.combinations =
+                letterBag.getNumCombinations(str, numBlanks);
+            rankedWord.radix = Auxil::getAlphagram(str).toLatin1() +
+                word.toByteArray();
+            rankedWord.index = i;
+        }
+        qSort(rankedWords.begin(), rankedWords.end());
+
+        orders.order.resize(words.size());
+        orders.minOrder.resize(words.size());
+        orders.maxOrder.resize(words.size());
+
+        // Orders start from 1 for each length, and equally probable words
+        // share the range of orders given to all of them
+        int order = 1;
+        int groupStart = 0;
+        for (int i = 0; i < rankedWords.size(); ++i) {
+            const RankedWord& rankedWord = rankedWords.at(i);
+            if (i && (rankedWord.length != rankedWords.at(i - 1).length))
+                order = 1;
+            orders.order[rankedWord.index] = order++;
+
+            bool groupEnd = (i + 1 == rankedWords.size()) ||
+                (rankedWords.at(i + 1).length != rankedWord.length) ||
+                (rankedWords.at(i + 1).combinations !=
+                 rankedWord.combinations);
+            if (!groupEnd)
+                continue;
+
+            quint32 minOrder = orders.order.at(rankedWords.at(groupStart)
+                                               .index);
+            for (int j = groupStart; j <= i; ++j) {
+                int index = rankedWords.at(j).index;
+                orders.minOrder[index] = minOrder;
+                orders.maxOrder[index] = order - 1;
+            }
+            groupStart = i + 1;
+        }
+    }
+    return &orders;
+}
+
+//---------------------------------------------------------------------------
+//  usesInfixIndex
+//
+//! Determine whether a match condition is searched in the infix index.  A
+//! Pattern match beginning and ending with a * char, with none in between
+//! and something other than ? chars, is searched in the infix index if the
+//! index has been built.
+//
+//! @param condition the match condition
+//! @return true if the infix index is used, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::usesInfixIndex(const SearchCondition& condition) const
+{
+    if (!gaddag || (condition.type != SearchCondition::PatternMatch))
+        return false;
 
+    bool wildcard = false;
+    QString unmatched = getMatchPattern(condition, wildcard);
+    int length = unmatched.length();
+    if ((length < 3) || !unmatched.startsWith("*") ||
+        !unmatched.endsWith("*"))
+    {
+        return false;
+    }
+
+    // Every character class in the core must be terminated, so that the
+    // core can be matched in either direction
+    // A core of only ? chars matches at the start of every path, so the
+    // index would not narrow the search
+    QString core = unmatched.mid(1, length - 2);
+    if (core.contains('*') || (core.count('?') == core.length()))
+        return false;
+    for (int i = core.indexOf('['); i >= 0; i = core.indexOf('[', i)) {
+        i = core.indexOf(']', i);
+        if (i < 0)
+            return false;
+    }
     return true;
 }
 
+//---------------------------------------------------------------------------
+//  usesWordTables
+//
+//! Determine whether a condition is matched against the anagram counts and
+//! probability orders of the graph rather than those stored in the
+//! database.  NumAnagrams and ProbabilityOrder conditions are matched by the
+//! graph if it has a forward DAWG to number the words.
+//
+//! @param condition the condition
+//! @return true if the graph matches the condition, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::usesWordTables(const SearchCondition& condition) const
+{
+    return dawg && ((condition.type == SearchCondition::NumAnagrams) ||
+                    (condition.type == SearchCondition::ProbabilityOrder));
+}
+
+//---------------------------------------------------------------------------
+//  usesAffixJoin
+//
+//! Determine whether a Prefix or Suffix condition is matched by joining the
+//! affix to each word in the graph rather than by looking up the joined
+//! words after the search.  Only a graph with DAWGs can join affixes.
+//
+//! @param condition the condition
+//! @return true if the graph matches the condition, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::usesAffixJoin(const SearchCondition& condition) const
+{
+    return dawg && rdawg && !condition.stringValue.isEmpty() &&
+        ((condition.type == SearchCondition::Prefix) ||
+         (condition.type == SearchCondition::Suffix));
+}
+
 //---------------------------------------------------------------------------
 //  addWord
 //
@@ -174,6 +744,7 @@ WordGraph::addWord(const QString& w)
 //! Determine whether the graph contains a word.
 //
 //! @param w the word to search for
+//! @return true if the word is found, false otherwise
 //---------------------------------------------------------------------------
 bool
 WordGraph::containsWord(const QString& w) const
@@ -185,518 +756,2584 @@ WordGraph::containsWord(const QString& w) const
         return containsWordOld(w);
 
     qint32 node = ROOT_NODE;
-    bool eow = false;
+    const qint32* edge = 0;
 
     for (int i = 0; i < w.length(); ++i) {
         if (!node)
             return false;
 
-        QChar letter = w.at(i);
-        for (qint32* edge = &dawg[node]; ; ++edge) {
-            qint32 lc = *edge;
-            lc = lc >> V_LETTER;
-            lc = lc & M_LETTER;
-            char c = (char) lc;
-
-            if (letter == c) {
-                node = (*edge & M_NODE_POINTER);
-                eow = (*edge & M_END_OF_WORD);
-                break;
-            }
-
-            if (*edge & M_END_OF_NODE)
-                return false;
-        }
+        edge = findEdge(node, w.at(i).toLatin1());
+        if (!edge)
+            return false;
+        node = (*edge & M_NODE_POINTER);
     }
 
-    return eow;
+    return (*edge & M_END_OF_WORD);
 }
 
 //---------------------------------------------------------------------------
-//  search
+//  getWordId
 //
-//! Search for acceptable words matching a search specification.
+//! Get the ID of a word, which is its position among the words of the
+//! forward DAWG in the order of their letters.  IDs run densely from 0 to
+//! one less than the number of words, so attributes of the words can be
+//! kept in arrays indexed by ID.  IDs change when the DAWG is replaced.
 //
-//! @param spec the search specification
-//! @return a list of acceptable words
+//! @param w the word, in upper case
+//! @return the ID of the word, or -1 if the word is not in the graph or the
+//! graph has no forward DAWG
 //---------------------------------------------------------------------------
-QStringList
-WordGraph::search(const SearchSpec& spec) const
+int
+WordGraph::getWordId(const QString& w) const
 {
-    QStringList wordList;
-    if (spec.conditions.empty())
-        return wordList;
+    WordKey key (w);
+    if (!dawg || !key.isValid())
+        return -1;
 
-    if (!dawg)
-        return searchOld(spec);
+    qint32 node = ROOT_NODE;
+    const qint32* edge = 0;
+    for (int i = 0; i < key.getLength(); ++i) {
+        if (!node)
+            return -1;
 
-    QList<SearchCondition> posMatchConditions;
-    QList<SearchCondition> negMatchConditions;
-    int maxLength = MAX_WORD_LEN;
-    QString excludeLetters;
-    int numWildcardConditions = 0;
+        edge = findEdge(node, key.at(i));
+        if (!edge)
+            return -1;
+        node = (*edge & M_NODE_POINTER);
+    }
 
-    QListIterator<SearchCondition> it (spec.conditions);
-    while (it.hasNext()) {
-        const SearchCondition& condition = it.next();
+    if (!(*edge & M_END_OF_WORD))
+        return -1;
+    return getWordIndex(key.getLetters(), key.getLength());
+}
 
-        switch (condition.type) {
-            case SearchCondition::PatternMatch:
-            case SearchCondition::AnagramMatch:
-            case SearchCondition::SubanagramMatch:
-            if (condition.negated)
-                negMatchConditions.append(condition);
-            else
-                posMatchConditions.append(condition);
-            if (condition.stringValue.contains("?") ||
-                condition.stringValue.contains("["))
-                ++numWildcardConditions;
-            break;
+//---------------------------------------------------------------------------
+//  getWordById
+//
+//! Get the word with an ID, as returned by getWordId.  The word is found by
+//! skipping the words below each node that come before it.
+//
+//! @param id the ID of the word
+//! @return the word, or an invalid key if no word has the ID or the word is
+//! longer than MAX_WORD_LEN
+//---------------------------------------------------------------------------
+WordKey
+WordGraph::getWordById(int id) const
+{
+    if (!dawg || (id < 0) || (id >= getNumWords()))
+        return WordKey();
+
+    const quint32* counts = nodeWordCounts.constData();
+    char word[MAX_WORD_LEN];
+    int length = 0;
+    const qint32* edge = &dawg[ROOT_NODE];
+    while (length < MAX_WORD_LEN) {
+        qint32 child = *edge & M_NODE_POINTER;
+        int numBelow = (*edge & M_END_OF_WORD) ? 1 : 0;
+        if (child)
+            numBelow += counts[child];
+
+        // Skip the edge if the word is not among the words through it
+        if (id >= numBelow) {
+            id -= numBelow;
+            if (*edge & M_END_OF_NODE)
+                break;
+            ++edge;
+            continue;
+        }
 
-            case SearchCondition::Length:
-            if (condition.maxValue < maxLength)
-                maxLength = condition.maxValue;
+        word[length++] = (char) ((*edge >> V_LETTER) & M_LETTER);
+        if (*edge & M_END_OF_WORD) {
+            if (!id)
+                return WordKey(word, length);
+            --id;
+        }
+        if (!child)
             break;
+        edge = &dawg[child];
+    }
+    return WordKey();
+}
 
-            case SearchCondition::IncludeLetters:
-            if (condition.negated)
-                excludeLetters += condition.stringValue;
-            break;
+//---------------------------------------------------------------------------
+//  containsWords
+//
+//! Determine which of a list of words the graph contains.  Each word is
+//! looked up starting from the end of the prefix it shares with the word
+//! before it, so lists of words with common prefixes, such as a word and
+//! its back hooks, take only a few steps per word.
+//
+//! @param words the words to search for
+//! @return a bit array with a bit set for each word that is found
+//---------------------------------------------------------------------------
+QBitArray
+WordGraph::containsWords(const QStringList& words) const
+{
+    int numLookups = words.size();
+    QBitArray found (numLookups);
 
-            default: break;
-        }
+    if (!dawg) {
+        for (int i = 0; i < numLookups; ++i)
+            found.setBit(i, containsWordOld(words.at(i)));
+        return found;
     }
 
-    // Only replace wildcard matches with lower case letters if there is
-    // exactly one pattern using wildcards
-    // XXX: Commented out because it may be a reasonable default to use the
-    // lower case lettering as matched by the first such condition
-    //bool wildcardLower =(numWildcardConditions == 1);
-    bool wildcardLower = true;
+    // The edges followed by the previous word for each of its letters
+    QVector<const qint32*> path (MAX_WORD_LEN);
+    const QChar* prevLetters = 0;
+    int pathLength = 0;
+
+    for (int i = 0; i < numLookups; ++i) {
+        const QString& word = words.at(i);
+        const QChar* letters = word.unicode();
+        int length = word.length();
+        if (length > path.size())
+            path.resize(length);
+
+        int depth = 0;
+        while ((depth < length) && (depth < pathLength) &&
+               (letters[depth] == prevLetters[depth]))
+        {
+            ++depth;
+        }
 
-    // If no match condition was specified, search for all words matching the
-    // other conditions
-    if (posMatchConditions.empty()) {
-        SearchCondition condition;
-        condition.type = SearchCondition::PatternMatch;
-        condition.stringValue = "*";
-        posMatchConditions.append(condition);
+        for (; depth < length; ++depth) {
+            qint32 node = depth ? (*path.at(depth - 1) & M_NODE_POINTER)
+                                : ROOT_NODE;
+            const qint32* edge =
+                node ? findEdge(node, letters[depth].toLatin1()) : 0;
+            if (!edge)
+                break;
+            path[depth] = edge;
+        }
+
+        if (length && (depth == length) &&
+            (*path.at(length - 1) & M_END_OF_WORD))
+        {
+            found.setBit(i);
+        }
+
+        prevLetters = letters;
+        pathLength = depth;
     }
 
-    map<QString, QString> finalWordSet;
-    map<QString, QString>::iterator sit;
+    return found;
+}
+
+//---------------------------------------------------------------------------
+//  findEdge
+//
+//! Find the edge leaving a node of the forward or reverse DAWG for a
+//! letter.
+//
+//! @param node the node
+//! @param letter the letter
+//! @param reverse whether the node is in the reverse DAWG
+//! @return the edge, or 0 if the node has no edge for the letter
+//---------------------------------------------------------------------------
+const qint32*
+WordGraph::findEdge(qint32 node, char letter, bool reverse) const
+{
+    // Jump straight to the edge if the child index is available, since the
+    // edges of each node are in the same order as the letter bits
+    if (!reverse && !childMasks.isEmpty()) {
+        int index = childLetterIndex[(uchar) letter];
+        if (index < 0)
+            return 0;
+
+        quint32 mask = childMasks.at(node);
+        quint32 bit = 1U << index;
+        if (!(mask & bit))
+            return 0;
+
+        return &dawg[node + countBits(mask & (bit - 1))];
+    }
+
+    const qint32* graph = (reverse ? rdawg : dawg);
+    for (const qint32* edge = &graph[node]; ; ++edge) {
+        if ((char) ((*edge >> V_LETTER) & M_LETTER) == letter)
+            return edge;
+        if (*edge & M_END_OF_NODE)
+            return 0;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  containsJoined
+//
+//! Determine whether the graph contains the word formed by joining two
+//! strings of letters, without creating the joined word.
+//
+//! @param first the letters at the start of the word, in upper case
+//! @param firstLength the number of letters at the start
+//! @param second the letters at the end of the word, in upper case
+//! @param secondLength the number of letters at the end
+//! @return true if the joined word is found, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::containsJoined(const char* first, int firstLength,
+                          const char* second, int secondLength) const
+{
+    int length = firstLength + secondLength;
+    if (!length)
+        return false;
+
+    qint32 node = ROOT_NODE;
+    const qint32* edge = 0;
+    for (int i = 0; i < length; ++i) {
+        if (!node)
+            return false;
+
+        char letter = (i < firstLength) ? first[i] : second[i - firstLength];
+        edge = findEdge(node, letter);
+        if (!edge)
+            return false;
+        node = (*edge & M_NODE_POINTER);
+    }
+
+    return (*edge & M_END_OF_WORD);
+}
+
+//---------------------------------------------------------------------------
+//  advanceJoins
+//
+//! Follow a letter from the nodes reached by the affixes joined to the
+//! start of a word, in the graph being traversed.
+//
+//! @param context the search condition prepared for traversal
+//! @param nodes the nodes reached by the affixes, returning the nodes
+//! reached after the letter
+//! @param letter the letter
+//! @return true if every joined word can continue with the letter, false
+//! otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::advanceJoins(const SearchContext& context, qint32* nodes,
+                        char letter) const
+{
+    for (int i = 0; i < context.numJoins; ++i) {
+        const qint32* edge = nodes[i]
+            ? findEdge(nodes[i], letter, context.reversePattern) : 0;
+        if (!edge)
+            return false;
+        nodes[i] = (*edge & M_NODE_POINTER);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  search
+//
+//! Search for acceptable words matching a search specification.
+//
+//! @param spec the search specification
+//! @param cancelToken a token checked during traversals, which stops the
+//! search if it is cancelled
+//! @return a list of acceptable words, or an empty list if the search is
+//! cancelled
+//---------------------------------------------------------------------------
+QStringList
+WordGraph::search(const SearchSpec& spec, const CancelToken* cancelToken)
+    const
+{
+    QStringList wordList;
+    if (spec.conditions.empty())
+        return wordList;
+
+    if (!dawg)
+        return searchOld(spec);
+
+    // Answer an exact anagram search from the anagram index
+    if (searchAnagramIndex(spec, wordList))
+        return wordList;
+
+    QList<SearchCondition> matchConditions;
+    int minLength = 0;
+    int maxLength = MAX_WORD_LEN;
+    bool excludeLetter[256];
+    getMatchConditions(spec, matchConditions, minLength, maxLength,
+                       excludeLetter);
+
+    WordFilter filter;
+    filter.compile(spec, this);
+
+    // Only replace wildcard matches with lower case letters if there is
+    // exactly one pattern using wildcards
+    // XXX: Commented out because it may be a reasonable default to use the
+    // lower case lettering as matched by the first such condition
+    //bool wildcardLower =(numWildcardConditions == 1);
+    bool wildcardLower = true;
+
+    // Threads are only taken from the shared pool if a traversal turns out
+    // to be large
+    QThreadPool* pool = QThreadPool::globalInstance();
+
+    QVector<Match> finalMatches;
     int conditionNum = 0;
 
     // Search for each condition separately, and take the conjunction or
     // disjunction of the result sets. Search for positive conditions first,
     // followed by negative conditions.
-    QListIterator<SearchCondition> mit (posMatchConditions +
-                                        negMatchConditions);
-    while (mit.hasNext()) {
-        const SearchCondition& condition = mit.next();
-        QString unmatched = condition.stringValue;
+    while (!matchConditions.isEmpty()) {
+        SearchCondition condition = matchConditions.takeFirst();
         bool negated = condition.negated;
 
-        // Use set to eliminate duplicates since patterns with wildcards may
-        // match the same word in more than one way
-        map<QString, QString> wordSet;
-        stack <TraversalState> states;
-        QString word;
-
-        bool wildcard = false;
-        bool reversePattern = false;
-
-        // If Pattern match is unspecified, change it to a single wildcard
-        // character.  Also, remove any redundant wildcards.
-        if (condition.type == SearchCondition::PatternMatch) {
-            if (unmatched.isEmpty())
-                unmatched = "*";
-            else
-                unmatched.replace(QRegExp("\\*+"), "*");
+        SearchContext context;
+        context.filter = &filter;
+        context.minLength = minLength;
+        context.maxLength = maxLength;
+        context.excludeLetter = excludeLetter;
+        context.cancelToken = cancelToken;
+
+        TraversalState state;
+        prepareContext(condition, context, state);
+
+        // Check as many of the other conditions as possible while
+        // traversing for the first one, so the graph is walked once for
+        // all of them
+        if (!conditionNum && spec.conjunction)
+            addChecks(matchConditions, context, state);
+
+        // Traverse the tree looking for matches, splitting the traversal
+        // across threads if it turns out to be large
+        TaskGroup group (pool);
+        SearchTask task (this, &context,
+                         (pool->maxThreadCount() > 1) ? &group : 0);
+        task.states.append(state);
+        task.run();
+        group.wait();
+        if (cancelToken && cancelToken->isCancelled())
+            return wordList;
+
+        // Sort the matches and eliminate duplicates, since patterns with
+        // wildcards may match the same word in more than one way
+        QVector<Match> matches;
+        task.collectMatches(matches);
+        sortMatches(matches);
 
-            if ((unmatched.left(1) == "*") && (unmatched.right(1) != "*")) {
-                unmatched = reverseString(unmatched);
-                reversePattern = true;
-            }
+        // Take conjunction or disjunction with final result set
+        if (!conditionNum) {
+            finalMatches = matches;
         }
 
-        // If Anagram or Subanagram match contains a wildcard, note it and remove
-        // the wildcard character from the match pattern.  Also move character
-        // classes to the end of the string so they will be seen last if
-        // moving sequentially through the string looking for matches.
-        else if ((condition.type == SearchCondition::AnagramMatch) ||
-                 (condition.type == SearchCondition::SubanagramMatch))
-        {
-            wildcard = unmatched.contains('*');
-            if (wildcard)
-                unmatched = unmatched.replace('*', QString());
+        else if (spec.conjunction) {
+            intersectMatches(finalMatches, matches, negated);
+            if (!negated && finalMatches.isEmpty())
+                return wordList;
+        }
 
-            QRegExp re ("\\[[^\\]]*\\][^\\W_\\d]");
-            int pos = 0;
-            while ((pos = re.indexIn(unmatched, pos)) >= 0) {
-                unmatched = unmatched.left(re.pos()) +
-                    unmatched.right(unmatched.length() -
-                                   (re.pos() + re.matchedLength()) + 1) +
-                    unmatched.mid(re.pos(), re.matchedLength() - 1);
-                pos += re.matchedLength();
-            }
+        else {
+            // FIXME: disjunction is broken for negated conditions! Fix this
+            // when disjunction is enabled in the UI.
+            mergeMatches(finalMatches, matches);
         }
 
-        qint32 node = ROOT_NODE;
+        ++conditionNum;
+    }
 
-        // Traverse the tree looking for matches
-        while (node) {
+    // Transform matches into word list and return it
+    for (int i = 0; i < finalMatches.size(); ++i) {
+        const Match& match = finalMatches.at(i);
+        wordList << QString::fromLatin1(wildcardLower ? match.display
+                                                      : match.upper,
+                                        match.length);
+    }
 
-            // Stop if word is at max length
-            if (int(word.length()) < maxLength) {
-                QString origWord = word;
-                QString origUnmatched = unmatched;
+    return wordList;
+}
 
-                QString match;
-                int closeIndex = 0;
+//---------------------------------------------------------------------------
+//  searchAnagramIndex
+//
+//! Search for the words matching a conjunction containing an Anagram match
+//! with no wildcards or character classes, by looking up the anagrams in
+//! the anagram index and checking them against the rest of the
+//! specification, instead of traversing the graph.
+//
+//! @param spec the search specification
+//! @param words returns the words matching the specification, in
+//! alphabetical order
+//! @return true if the search was answered from the index, false if it
+//! must be done by traversing the graph
+//---------------------------------------------------------------------------
+bool
+WordGraph::searchAnagramIndex(const SearchSpec& spec, QStringList& words)
+    const
+{
+    if (!spec.conjunction)
+        return false;
 
-                // Get the next character in the Pattern match.  Allow a
-                // wildcard to match the empty string.
-                if ((condition.type == SearchCondition::PatternMatch) &&
-                    (!unmatched.isEmpty()))
-                {
-                    match = unmatched.at(0);
-                    if (match == "*") {
-                        states.push(TraversalState(node, word,
-                            unmatched.right(unmatched.length() - 1)));
-                    }
-                    else if (match == "[") {
-                        closeIndex = unmatched.indexOf(']', 0);
-                        match = unmatched.mid(1, closeIndex);
-                    }
-                }
+    AlphagramKey key;
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext() && !key.isValid()) {
+        const SearchCondition& condition = it.next();
+        if ((condition.type == SearchCondition::AnagramMatch) &&
+            !condition.negated)
+        {
+            key = AlphagramKey(WordKey(condition.stringValue));
+        }
+    }
 
-                qint32* edge = reversePattern ? &rdawg[node] : &dawg[node];
+    bool filtered = (spec.conditions.size() > 1);
+    QVector<qint32> ids;
+    if (!key.isValid() || (filtered && !canFilterWords(spec)) ||
+        !getAnagramIds(key, ids))
+    {
+        return false;
+    }
 
-                // Traverse next nodes, looking for matches
-                for (; ; ++edge) {
-                    qint32 longLetter = *edge;
-                    longLetter = longLetter >> V_LETTER;
-                    longLetter = longLetter & M_LETTER;
+    QStringList anagrams;
+    for (int i = 0; i < ids.size(); ++i)
+        anagrams.append(getWordById(ids.at(i)).toString());
+    words = filtered ? filterWords(spec, anagrams) : anagrams;
+    return true;
+}
 
-                    QChar letter = (char) longLetter;
+//---------------------------------------------------------------------------
+//  visitWords
+//
+//! Search for acceptable words matching a search specification, passing
+//! each word to a visitor as soon as it is found instead of collecting the
+//! words into a list.  Words are visited in the order they are found rather
+//! than in alphabetical order, and each word is visited once.  The search
+//! stops as soon as the visitor returns false or enough words are found.
+//! Only a search whose match conditions can all be matched in a single
+//! traversal can be streamed this way; other searches are done in full and
+//! their results visited afterward.
+//
+//! @param spec the search specification
+//! @param visitor the visitor to receive the words, or null to only count
+//! the words
+//! @param maxWords the maximum number of words to visit, or -1 for no limit
+//! @return the number of words visited
+//---------------------------------------------------------------------------
+int
+WordGraph::visitWords(const SearchSpec& spec, WordVisitor* visitor,
+                      int maxWords) const
+{
+    if (spec.conditions.empty() || !maxWords)
+        return 0;
 
-                    if (excludeLetters.contains(letter)) {
-                        if (*edge & M_END_OF_NODE)
-                            break;
-                        else
-                            continue;
-                    }
+    QList<SearchCondition> matchConditions;
+    int minLength = 0;
+    int maxLength = MAX_WORD_LEN;
+    bool excludeLetter[256];
+    WordFilter filter;
+    SearchContext context;
+    TraversalState state;
+    if (dawg) {
+        getMatchConditions(spec, matchConditions, minLength, maxLength,
+                           excludeLetter);
+        filter.compile(spec, this);
+        context.filter = &filter;
+        context.minLength = minLength;
+        context.maxLength = maxLength;
+        context.excludeLetter = excludeLetter;
+        context.cancelToken = 0;
+        prepareContext(matchConditions.takeFirst(), context, state);
+        if (spec.conjunction)
+            addChecks(matchConditions, context, state);
+    }
 
-                    unmatched = origUnmatched;
-                    word = origWord;
+    // The results of match conditions that cannot be checked during a
+    // single traversal must be combined before any word is known to match,
+    // so such a search cannot be streamed
+    if (!dawg || !matchConditions.isEmpty()) {
+        QStringList wordList = search(spec);
+        int numWords = 0;
+        QStringListIterator it (wordList);
+        while (it.hasNext() && (numWords != maxWords)) {
+            QByteArray word = it.next().toLatin1();
+            ++numWords;
+            if (visitor && !visitor->visitWord(word.constData(),
+                                               word.length()))
+            {
+                break;
+            }
+        }
+        return numWords;
+    }
 
-                    // Special processing for Pattern match
-                    if (condition.type == SearchCondition::PatternMatch) {
+    MatchStream matches (this, &context, visitor, maxWords);
+    QVector<TraversalState> states;
+    states.append(state);
+    traverse(context, states, matches, -1);
+    return matches.numWords;
+}
 
-                        // A node matches wildcard characters or its own
-                        // letter
-                        bool matchLetter = match.contains(letter);
-                        bool matchNegated = match.contains("^");
-                        QChar c = letter;
-                        if (match.contains ("]") || (match == "?"))
-                            c = c.toLower();
+//---------------------------------------------------------------------------
+//  canFilterWords
+//
+//! Determine whether the words of a list can be checked against a search
+//! specification one at a time by filterWords, with the same results as
+//! searching the graph.  The match conditions must all be checkable without
+//! branching, and no positive match condition may show the letters it
+//! matches with a wildcard in lower case, since a word checked on its own
+//! is not matched letter by letter against the pattern.
+//
+//! @param spec the search specification
+//! @return true if the words can be filtered, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::canFilterWords(const SearchSpec& spec) const
+{
+    if (!dawg || !spec.conjunction)
+        return false;
 
-                        if ((match == "*") || (match == "?") ||
-                            (matchLetter ^ matchNegated))
-                            word += c;
-                        else {
-                            if (*edge & M_END_OF_NODE)
-                                break;
-                            else
-                                continue;
-                        }
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
+        if ((condition.type != SearchCondition::PatternMatch) &&
+            (condition.type != SearchCondition::AnagramMatch) &&
+            (condition.type != SearchCondition::SubanagramMatch))
+        {
+            continue;
+        }
 
-                        qint32 child = *edge & M_NODE_POINTER;
+        if (!condition.negated &&
+            (condition.stringValue.contains('?') ||
+             condition.stringValue.contains('[') ||
+             ((condition.type != SearchCondition::PatternMatch) &&
+              condition.stringValue.contains('*'))))
+        {
+            return false;
+        }
 
-                        // If this node matches, push its child on the stack
-                        // to be traversed later
-                        if (child) {
-                            if (match == "*") {
-                                states.push(TraversalState(child, word,
-                                                           unmatched));
-                            }
+        ConditionCheck check;
+        if (!compileCheck(condition, false, check))
+            return false;
+    }
+    return true;
+}
 
-                            if (closeIndex < unmatched.length() - 1) {
-                                states.push(TraversalState(child, word,
-                                    unmatched.right(unmatched.length() -
-                                    closeIndex - 1)));
-                            }
-                        }
+//---------------------------------------------------------------------------
+//  filterWords
+//
+//! Check each word of a list against a search specification, without
+//! traversing the graph for words that are not in the list.  Useful when
+//! the list is much smaller than the set of words a traversal would visit.
+//! The specification must be one that canFilterWords accepts.
+//
+//! @param spec the search specification
+//! @param words the list of words
+//! @return the words of the list matching the specification and found in
+//! the graph, in the order of the list
+//---------------------------------------------------------------------------
+QStringList
+WordGraph::filterWords(const SearchSpec& spec, const QStringList& words)
+    const
+{
+    QStringList wordList;
+    if (!canFilterWords(spec))
+        return wordList;
 
-                        // If end of word and end of pattern, put the word in
-                        // the list.  If we are searching the reverse list,
-                        // reverse the word first.
-                        QString wordUpper = word.toUpper();
-                        if (reversePattern)
-                            wordUpper = reverseString(wordUpper);
+    WordFilter filter;
+    filter.compile(spec, this);
+    if (filter.impossible)
+        return wordList;
 
-                        if ((*edge & M_END_OF_WORD) &&
-                            ((int(unmatched.length()) == closeIndex + 1) ||
-                            ((int(unmatched.length()) == closeIndex + 2) &&
-                             (QChar(unmatched.at(closeIndex + 1)) == '*'))) &&
-                            matchesSpec(wordUpper, spec) &&
-                            !wordSet.count(wordUpper))
-                        {
-                            wordSet.insert(make_pair(wordUpper,
-                                reversePattern ? reverseString(word)
-                                               : word));
+    QVector<ConditionCheck> checks;
+    int numBytes = 0;
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
+        ConditionCheck check;
+        if (!compileCheck(condition, false, check))
+            continue;
+        check.offset = numBytes;
+        checks.append(check);
+        numBytes += check.size;
+    }
+
+    QVector<quint8> data (qMax(numBytes, 1));
+    QStringListIterator wit (words);
+    while (wit.hasNext()) {
+        const QString& word = wit.next();
+        QString wordUpper = word.toUpper();
+        WordKey key (wordUpper);
+        if (!key.isValid() || (getWordId(wordUpper) < 0))
+            continue;
+
+        const char* letters = key.getLetters();
+        int length = key.getLength();
+        if (!filter.matches(letters, length))
+            continue;
+
+        bool matched = true;
+        for (int i = 0; matched && (i < checks.size()); ++i) {
+            const ConditionCheck& check = checks.at(i);
+            check.start(data.data());
+            for (int j = 0; j < length; ++j) {
+                if (!check.advance(data.data(), letters[j])) {
+                    matched = false;
+                    break;
+                }
+            }
+            if (matched && !check.accepts(data.constData()))
+                matched = false;
+        }
+
+        if (matched)
+            wordList.append(word);
+    }
+
+    return wordList;
+}
+
+//---------------------------------------------------------------------------
+//  getMatchConditions
+//
+//! Collect the match conditions of a search specification to be searched
+//! for separately, along with the limits every word must meet.  Positive
+//! conditions come first, followed by negative conditions.  If there is no
+//! positive match condition, a Pattern match for all words is added.
+//
+//! @param spec the search specification
+//! @param conditions returns the match conditions
+//! @param minLength returns the minimum word length
+//! @param maxLength returns the maximum word length
+//! @param excludeLetter an array of 256 flags, returning the letters
+//! excluded from every word
+//---------------------------------------------------------------------------
+void
+WordGraph::getMatchConditions(const SearchSpec& spec,
+                              QList<SearchCondition>& conditions,
+                              int& minLength, int& maxLength,
+                              bool* excludeLetter) const
+{
+    QList<SearchCondition> posMatchConditions;
+    QList<SearchCondition> negMatchConditions;
+    minLength = 0;
+    maxLength = MAX_WORD_LEN;
+    QString excludeLetters;
+
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
+
+        switch (condition.type) {
+            case SearchCondition::PatternMatch:
+            case SearchCondition::AnagramMatch:
+            case SearchCondition::SubanagramMatch:
+            if (condition.negated)
+                negMatchConditions.append(condition);
+            else
+                posMatchConditions.append(condition);
+            break;
+
+            case SearchCondition::Length:
+            if (condition.minValue > minLength)
+                minLength = condition.minValue;
+            if (condition.maxValue < maxLength)
+                maxLength = condition.maxValue;
+            break;
+
+            case SearchCondition::IncludeLetters:
+            if (condition.negated)
+                excludeLetters += condition.stringValue;
+            break;
+
+            default: break;
+        }
+    }
+
+    // If no match condition was specified, search for all words matching the
+    // other conditions
+    if (posMatchConditions.empty()) {
+        SearchCondition condition;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = "*";
+        posMatchConditions.append(condition);
+    }
+
+    conditions = posMatchConditions + negMatchConditions;
+
+    // Letters excluded from every word can be skipped without examining the
+    // match conditions
+    memset(excludeLetter, 0, 256 * sizeof(bool));
+    for (int i = 0; i < excludeLetters.length(); ++i) {
+        ushort c = excludeLetters.at(i).unicode();
+        if (c < 256)
+            excludeLetter[c] = true;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  getMatchPattern
+//
+//! Get the pattern of a match condition in the form used for traversal.
+//
+//! @param condition the match condition
+//! @param wildcard returns whether an Anagram or Subanagram match allows
+//! letters beyond those of the pattern
+//! @return the pattern
+//---------------------------------------------------------------------------
+QString
+WordGraph::getMatchPattern(const SearchCondition& condition,
+                           bool& wildcard) const
+{
+    QString unmatched = condition.stringValue;
+    wildcard = false;
+
+    // If Pattern match is unspecified, change it to a single wildcard
+    // character.  Also, remove any redundant wildcards.
+    if (condition.type == SearchCondition::PatternMatch) {
+        if (unmatched.isEmpty())
+            unmatched = "*";
+        else
+            unmatched.replace(QRegExp("\\*+"), "*");
+    }
+
+    // If Anagram or Subanagram match contains a wildcard, note it and remove
+    // the wildcard character from the match pattern.  Also move character
+    // classes to the end of the string so they will be seen last if moving
+    // sequentially through the string looking for matches.
+    else if ((condition.type == SearchCondition::AnagramMatch) ||
+             (condition.type == SearchCondition::SubanagramMatch))
+    {
+        wildcard = unmatched.contains('*');
+        if (wildcard)
+            unmatched = unmatched.replace('*', QString());
+
+        QRegExp re ("\\[[^\\]]*\\][^\\W_\\d]");
+        int pos = 0;
+        while ((pos = re.indexIn(unmatched, pos)) >= 0) {
+            unmatched = unmatched.left(re.pos()) +
+                unmatched.right(unmatched.length() -
+                               (re.pos() + re.matchedLength()) + 1) +
+                unmatched.mid(re.pos(), re.matchedLength() - 1);
+            pos += re.matchedLength();
+        }
+    }
+
+    return unmatched;
+}
+
+//---------------------------------------------------------------------------
+//  prepareContext
+//
+//! Prepare a match condition for traversal, along with the traversal state
+//! at the root of the graph.  The filter, length limits and excluded
+//! letters of the context must already be set.
+//
+//! @param condition the match condition
+//! @param context returns the prepared condition
+//! @param state returns the initial traversal state
+//---------------------------------------------------------------------------
+void
+WordGraph::prepareContext(const SearchCondition& condition,
+                          SearchContext& context, TraversalState& state) const
+{
+    bool wildcard = false;
+    bool reversePattern = false;
+    bool infix = usesInfixIndex(condition);
+    QString unmatched = getMatchPattern(condition, wildcard);
+
+    // Search a Pattern match that only has a wildcard at the start in the
+    // reverse graph, so its letters are matched first
+    if ((condition.type == SearchCondition::PatternMatch) && !infix &&
+        (unmatched.left(1) == "*") && (unmatched.right(1) != "*"))
+    {
+        unmatched = reverseString(unmatched);
+        reversePattern = true;
+    }
+
+    // Convert the pattern to the single-byte letters used by the DAWG so it
+    // can be examined without creating any strings
+    QByteArray patternBytes = unmatched.toLatin1();
+    const char* pattern = patternBytes.constData();
+    int patternLength = patternBytes.length();
+
+    // Count the letters, wildcards and character classes that must be
+    // consumed for an Anagram match to be complete
+    int numTokens = 0;
+    for (int i = 0; i < patternLength; ++i, ++numTokens) {
+        if (pattern[i] == '[') {
+            const char* close = (const char*)
+                memchr(pattern + i, ']', patternLength - i);
+            i = close ? close - pattern : patternLength;
+        }
+    }
+
+    context.type = condition.type;
+    context.pattern = patternBytes;
+    context.numTokens = numTokens;
+    context.wildcard = wildcard;
+    context.reversePattern = reversePattern;
+    context.infix = infix;
+
+    // Reduce an Anagram or Subanagram pattern to letter counts if it is
+    // small enough, so each step of the traversal is a table lookup
+    context.useRack =
+        ((condition.type == SearchCondition::AnagramMatch) ||
+         (condition.type == SearchCondition::SubanagramMatch)) &&
+        context.rack.compile(patternBytes);
+
+    // Compile a Pattern match into elements that each match a set of
+    // letters, so the pattern is not examined again during traversal.  An
+    // infix pattern is compiled without its outer * chars, to match paths
+    // through the infix index.
+    if (infix)
+        context.program.compileInfix(patternBytes.mid(1, patternLength - 2));
+    else if (condition.type == SearchCondition::PatternMatch)
+        context.program.compile(patternBytes);
+
+    state.node = ROOT_NODE;
+    state.wordLength = 0;
+    state.frontLength = (reversePattern || infix) ? int(MAX_WORD_LEN) : 0;
+    context.filter->start(state.totals);
+    state.position = 0;
+    state.numConsumed = 0;
+    state.rackRemaining = 0;
+    if (context.useRack) {
+        memcpy(state.rack, context.rack.counts, sizeof(state.rack));
+        state.rackRemaining = context.rack.numTiles;
+    }
+
+    // Walk the graph from the node reached by each affix joined to the
+    // start of the word, a prefix in the forward graph or a suffix in the
+    // reverse graph, in lockstep with the word.  Negated joins and those
+    // at the end of the word are only checked against the words found.
+    context.numJoins = 0;
+    const QVector<WordFilter::AffixJoin>& joins = context.filter->affixJoins;
+    for (int i = 0; !infix && (i < joins.size()) &&
+         (context.numJoins < WordFilter::MAX_JOINED); ++i)
+    {
+        const WordFilter::AffixJoin& join = joins.at(i);
+        if (join.negated || (join.suffix != reversePattern))
+            continue;
+
+        qint32 node = ROOT_NODE;
+        int affixLength = join.affix.length();
+        for (int j = 0; node && (j < affixLength); ++j) {
+            char letter = join.affix.at(reversePattern ? affixLength - j - 1
+                                                       : j);
+            const qint32* edge = findEdge(node, letter, reversePattern);
+            node = edge ? (*edge & M_NODE_POINTER) : TERMINAL_NODE;
+        }
+        state.joinNodes[context.numJoins++] = node;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  addChecks
+//
+//! Check as many match conditions as possible alongside the condition
+//! driving a traversal, so the graph is walked once for all of them.
+//! Conditions that are checked are removed from the list.  Nothing is
+//! checked alongside a search of the infix index.
+//
+//! @param conditions the match conditions, returning those not checked
+//! @param context the prepared condition driving the traversal
+//! @param state the initial traversal state
+//---------------------------------------------------------------------------
+void
+WordGraph::addChecks(QList<SearchCondition>& conditions,
+                     SearchContext& context, TraversalState& state) const
+{
+    // Letters are not found in word order in the infix index
+    if (context.infix)
+        return;
+
+    int offset = 0;
+    QMutableListIterator<SearchCondition> it (conditions);
+    while (it.hasNext()) {
+        ConditionCheck check;
+        if (!compileCheck(it.next(), context.reversePattern, check) ||
+            (offset + check.size > ConditionCheck::MAX_STATE_BYTES))
+        {
+            continue;
+        }
+
+        check.offset = offset;
+        check.start(state.checks);
+        context.checks.append(check);
+        offset += check.size;
+        it.remove();
+    }
+}
+
+//---------------------------------------------------------------------------
+//  compileCheck
+//
+//! Compile a match condition to be checked alongside the condition driving
+//! a traversal.
+//
+//! @param condition the match condition
+//! @param reverse whether the traversal is of the reverse graph
+//! @param check returns the compiled check
+//! @return true if successful, false if the condition cannot be checked
+//! without branching
+//---------------------------------------------------------------------------
+bool
+WordGraph::compileCheck(const SearchCondition& condition, bool reverse,
+                        ConditionCheck& check) const
+{
+    bool wildcard = false;
+    QString unmatched = getMatchPattern(condition, wildcard);
+    if ((condition.type == SearchCondition::PatternMatch) && reverse)
+        unmatched = reverseString(unmatched);
+    QByteArray patternBytes = unmatched.toLatin1();
+
+    check.type = condition.type;
+    check.negated = condition.negated;
+    check.wildcard = wildcard;
+    check.offset = 0;
+
+    if (condition.type == SearchCondition::PatternMatch) {
+        check.program.compile(patternBytes);
+        int numElements = check.program.elements.size();
+        if (!numElements || (numElements > 32))
+            return false;
+
+        for (int i = numElements - 1; i >= 0; --i) {
+            const PatternProgram::Element& element =
+                check.program.elements.at(i);
+            check.closures[i] = 1U << i;
+            if (element.star && (i + 1 < numElements))
+                check.closures[i] |= check.closures[i + 1];
+
+            int minRemaining = qMax(element.minLetters, 1);
+            int maxRemaining = element.fixedLength ? element.minLetters
+                                                   : int(MAX_WORD_LEN);
+            check.lengths[i] = (maxRemaining < minRemaining) ? 0
+                : ((2 << maxRemaining) - 1) & ~((1 << minRemaining) - 1);
+        }
+        check.size = 1 + sizeof(quint32);
+        return true;
+    }
+
+    else if ((condition.type == SearchCondition::AnagramMatch) ||
+             (condition.type == SearchCondition::SubanagramMatch))
+    {
+        if (!check.rack.compile(patternBytes) || check.rack.numClasses ||
+            (check.rack.numTiles > 0xFF))
+        {
+            return false;
+        }
+        check.size = 2 + check.rack.numSlots;
+        return true;
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------
+//  traverse
+//
+//! Traverse the graph from a stack of pending traversal states, passing
+//! each word that matches a search condition to a match sink.  Words are
+//! found in the same order as a traversal of the whole graph would find
+//! them.  If the sink stops the traversal, or the search is cancelled
+//! through the context's cancel token, the stack is emptied.
+//
+//! @param context the search condition prepared for traversal
+//! @param states the stack of pending traversal states, holding the states
+//! not yet traversed when this function returns
+//! @param matches the sink receiving the words found
+//! @param maxStates the maximum number of states to traverse, or -1 to
+//! traverse until the stack is empty
+//---------------------------------------------------------------------------
+void
+WordGraph::traverse(const SearchContext& context,
+                    QVector<TraversalState>& states, MatchSink& matches,
+                    int maxStates) const
+{
+    const char* pattern = context.pattern.constData();
+    int patternLength = context.pattern.length();
+    int numTokens = context.numTokens;
+    bool wildcard = context.wildcard;
+    bool reversePattern = context.reversePattern;
+    int maxLength = context.maxLength;
+    const bool* excludeLetter = context.excludeLetter;
+    bool useRack = context.useRack;
+    const Rack& rack = context.rack;
+    const PatternProgram& program = context.program;
+    int numElements = program.elements.size();
+    const qint32* graph = context.infix ? gaddag
+                        : reversePattern ? rdawg : dawg;
+    const quint16* lengths = context.infix ? gaddagLengths.constData()
+                           : reversePattern ? rnodeLengths.constData()
+                           : nodeLengths.constData();
+    bool checked = !context.checks.isEmpty();
+    int numJoins = context.numJoins;
+    const WordFilter& filter = *context.filter;
+    bool pruning = filter.pruning;
+
+    const CancelToken* cancelToken = context.cancelToken;
+    for (int numStates = 0; !states.isEmpty(); ++numStates) {
+        if (numStates == maxStates)
+            return;
+
+        // Drop the rest of the traversal if the search has been cancelled
+        if (cancelToken && !(numStates & CANCEL_CHECK_MASK) &&
+            cancelToken->isCancelled())
+        {
+            states.clear();
+            return;
+        }
+
+        TraversalState state = states.last();
+        states.pop_back();
+
+        // Skip the node if no word below it has a length that could
+        // complete a match, or that could complete a word joined to an
+        // affix
+        quint16 remaining = lengths[state.node] &
+            getRemainingLengths(context, state);
+        for (int i = 0; remaining && (i < numJoins); ++i)
+            remaining &= lengths[state.joinNodes[i]];
+        if (!remaining)
+            continue;
+
+
+        // The next element of a Pattern match, or null if the pattern
+        // has been used up
+        const PatternProgram::Element* element =
+            (state.position < numElements)
+            ? program.elements.constData() + state.position : 0;
+
+        // Stop if word is at max length or there is nothing left to match
+        if ((state.wordLength < maxLength) &&
+            ((context.type != SearchCondition::PatternMatch) || element))
+        {
+            // Allow a wildcard to match the empty string
+            if (element && element->star) {
+                TraversalState starState = state;
+                ++starState.position;
+                states.append(starState);
+            }
+
+            const qint32* edge = &graph[state.node];
+
+            // Traverse next nodes, looking for matches
+            for (; ; ++edge) {
+                char letter = (char) ((*edge >> V_LETTER) & M_LETTER);
+                qint32 child = *edge & M_NODE_POINTER;
+
+                if (excludeLetter[(uchar) letter]) {
+                    if (*edge & M_END_OF_NODE)
+                        break;
+                    else
+                        continue;
+                }
+
+                TraversalState next = state;
+                next.node = child;
+
+                // Skip the letter if a word joined to an affix cannot
+                // continue with it
+                if (numJoins && !advanceJoins(context, next.joinNodes, letter))
+                {
+                    if (*edge & M_END_OF_NODE)
+                        break;
+                    else
+                        continue;
+                }
+
+                // Skip the letter if a condition checked alongside this one
+                // can no longer match
+                if (checked && !context.advanceChecks(next.checks, letter)) {
+                    if (*edge & M_END_OF_NODE)
+                        break;
+                    else
+                        continue;
+                }
+
+                // Skip the letter if no word continuing with it can pass
+                // the search filter
+                if (pruning && (letter != INFIX_SEPARATOR) &&
+                    !filter.advance(next.totals, state.word, state.wordLength,
+                                    letter))
+                {
+                    if (*edge & M_END_OF_NODE)
+                        break;
+                    else
+                        continue;
+                }
+
+                // Special processing for Pattern match
+                if (context.type == SearchCondition::PatternMatch) {
+
+                    // A node matches wildcard characters or its own
+                    // letter
+                    if (!element->letters.contains(letter)) {
+                        if (*edge & M_END_OF_NODE)
+                            break;
+                        else
+                            continue;
+                    }
+
+                    // The infix separator ends the letters spelled
+                    // backward rather than adding a letter
+                    if (element->separator)
+                        next.frontLength = next.wordLength;
+                    else
+                        next.word[next.wordLength++] =
+                            element->lower ? toLowerLetter(letter) : letter;
+
+                    // If this node matches, push its child on the stack
+                    // to be traversed later
+                    if (child) {
+                        if (element->star)
+                            states.append(next);
+
+                        if (next.position < numElements - 1) {
+                            TraversalState advanced = next;
+                            ++advanced.position;
+                            states.append(advanced);
                         }
                     }
 
-                    // Special processing for Anagram or Subanagram match
-                    else if
-                        ((condition.type == SearchCondition::AnagramMatch) ||
-                         (condition.type == SearchCondition::SubanagramMatch))
+                    // If end of word and end of pattern, put the word in
+                    // the list
+                    if ((*edge & M_END_OF_WORD) && element->accept &&
+                        context.checksAccept(next.checks) &&
+                        !matches.addMatch(next))
                     {
-                        // Find the current letter in the pattern.  First,
-                        // prefer to match the letter itself.  Second, prefer
-                        // to match the letter as part of a character class.
-                        // If the letter matches more than one character
-                        // class, match the first one and push traversal
-                        // states for each of the others that is matched.
-                        // Character classes are guaranteed to be at the end
-                        // of the search string, so once you're in a character
-                        // class, you're always in a character class.
-                        int len = unmatched.length();
-                        bool inGroup = false;
-                        bool found = false;
-                        bool negated = false;
-                        int matchStart = -1;
-                        int matchEnd = -1;
-                        int groupStart = -1;
-                        bool wildcardMatch = false;
-                        for (int i = 0; i < len; ++i) {
-                            QChar c = unmatched.at(i);
+                        states.clear();
+                        return;
+                    }
+                }
+
+                // Special processing for Anagram or Subanagram match
+                // against letter counts.  First, prefer to match the
+                // letter itself.  Second, prefer to match the letter as
+                // part of a character class.  If the letter matches more
+                // than one character class, match the first one and push
+                // traversal states for each of the others that is
+                // matched.  Finally, match a ? char.
+                else if (useRack) {
+                    int slot = rack.letterSlot[(uchar) letter];
+                    bool wildcardMatch = false;
+                    if ((slot == Rack::NO_SLOT) || !state.rack[slot]) {
+                        slot = Rack::NO_SLOT;
+                        wildcardMatch = true;
+                        for (int i = 0; i < rack.numClasses; ++i) {
+                            int classSlot = rack.classSlot[i];
+                            if (!state.rack[classSlot] ||
+                                !rack.classMembers[i].contains(letter))
+                            {
+                                continue;
+                            }
+
+                            if (slot == Rack::NO_SLOT)
+                                slot = classSlot;
+
+                            else if (child) {
+                                TraversalState alternate = next;
+                                alternate.word[alternate.wordLength++] =
+                                    letter;
+                                --alternate.rack[classSlot];
+                                --alternate.rackRemaining;
+                                states.append(alternate);
+                            }
+                        }
+
+                        if ((slot == Rack::NO_SLOT) &&
+                            (rack.blankSlot != Rack::NO_SLOT) &&
+                            state.rack[rack.blankSlot])
+                        {
+                            slot = rack.blankSlot;
+                        }
+                    }
+
+                    // If this letter matched or a wildcard was specified,
+                    // keep traversing after possibly adding the current
+                    // word.
+                    bool found = (slot != Rack::NO_SLOT);
+                    if (found || wildcard) {
+                        next.word[next.wordLength++] = wildcardMatch
+                            ? toLowerLetter(letter) : letter;
+
+                        if (found) {
+                            --next.rack[slot];
+                            --next.rackRemaining;
+                        }
+
+                        if (child && (wildcard || next.rackRemaining))
+                            states.append(next);
+
+                        if ((*edge & M_END_OF_WORD) &&
+                            ((context.type ==
+                              SearchCondition::SubanagramMatch) ||
+                             !next.rackRemaining) &&
+                            context.checksAccept(next.checks) &&
+                            !matches.addMatch(next))
+                        {
+                            states.clear();
+                            return;
+                        }
+                    }
+                }
+
+                // Special processing for Anagram or Subanagram match
+                // against patterns with too many distinct letters or
+                // classes to count
+                else if
+                    ((context.type == SearchCondition::AnagramMatch) ||
+                     (context.type == SearchCondition::SubanagramMatch))
+                {
+                    // Find the current letter in the pattern.  First,
+                    // prefer to match the letter itself.  Second, prefer
+                    // to match the letter as part of a character class.
+                    // If the letter matches more than one character
+                    // class, match the first one and push traversal
+                    // states for each of the others that is matched.
+                    // Consumed parts of the pattern are skipped rather
+                    // than removed.
+                    bool inGroup = false;
+                    bool found = false;
+                    bool negated = false;
+                    int matchStart = -1;
+                    int groupStart = -1;
+                    bool wildcardMatch = false;
+                    for (int i = 0; i < patternLength; ++i) {
+                        char c = pattern[i];
+
+                        if (!inGroup && state.isConsumed(i)) {
+                            if (c == '[') {
+                                const char* close = (const char*)
+                                    memchr(pattern + i, ']',
+                                           patternLength - i);
+                                i = close - pattern;
+                            }
+                            continue;
+                        }
+
+                        if (c == '[') {
+                            inGroup = true;
+                            negated = false;
+                            groupStart = i;
+                        }
+
+                        else if (inGroup) {
+                            if (c == '^')
+                                negated = true;
+
+                            else if (c == ']') {
+                                if (found ^ negated) {
+                                    if (matchStart < 0) {
+                                        matchStart = groupStart;
+                                        wildcardMatch = true;
+                                    }
+
+                                    else if (child) {
+                                        TraversalState alternate = next;
+                                        alternate.word[
+                                            alternate.wordLength++] =
+                                            letter;
+                                        alternate.consume(groupStart);
+                                        states.append(alternate);
+                                    }
+                                }
+                                inGroup = false;
+                                found = false;
+                                negated = false;
+                            }
+
+                            else if (c == letter)
+                                found = true;
+                        }
+
+                        // Matched the character itself
+                        else if (c == letter) {
+                            found = true;
+                            matchStart = i;
+                            break;
+                        }
+                    }
+
+                    // Try to match the current letter against the
+                    // pattern.  If the letter doesn't match exactly,
+                    // match a ? char.
+                    found = (matchStart >= 0);
+                    if (!found) {
+                        for (int i = 0; i < patternLength; ++i) {
+                            if (pattern[i] == '[') {
+                                const char* close = (const char*)
+                                    memchr(pattern + i, ']',
+                                           patternLength - i);
+                                if (!close)
+                                    break;
+                                i = close - pattern;
+                            }
+                            else if ((pattern[i] == '?') &&
+                                     !state.isConsumed(i))
+                            {
+                                matchStart = i;
+                                break;
+                            }
+                        }
+                        found = (matchStart >= 0);
+                        wildcardMatch = true;
+                    }
+
+                    // If this letter matched or a wildcard was specified,
+                    // keep traversing after possibly adding the current
+                    // word.
+                    if (found || wildcard) {
+                        next.word[next.wordLength++] =
+                            (found && !wildcardMatch)
+                            ? letter : toLowerLetter(letter);
+
+                        if (found)
+                            next.consume(matchStart);
+
+                        bool nextUnmatchedEmpty =
+                            (next.numConsumed == numTokens);
+
+                        if (child &&
+                            (wildcard || !nextUnmatchedEmpty))
+                        {
+                            states.append(next);
+                        }
+
+                        if ((*edge & M_END_OF_WORD) &&
+                            ((context.type ==
+                              SearchCondition::SubanagramMatch) ||
+                              nextUnmatchedEmpty) &&
+                            context.checksAccept(next.checks) &&
+                            !matches.addMatch(next))
+                        {
+                            states.clear();
+                            return;
+                        }
+                    }
+                }
+
+                if (*edge & M_END_OF_NODE)
+                    break;
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+//  SearchTask::run
+//
+//! Traverse the graph from the task's pending traversal states.  If the
+//! traversal turns out to be large, split the remaining states among child
+//! tasks and start them in the thread pool.
+//---------------------------------------------------------------------------
+void
+WordGraph::SearchTask::run()
+{
+    graph->traverse(*context, states, matches, group ? SPLIT_STATES : -1);
+    if (!states.isEmpty()) {
+        // States at the top of the stack are traversed first, so give them
+        // to the first child in order for results to be collected in serial
+        // order
+        int numStates = states.size();
+        int numChildren = qMin(numStates, group->pool->maxThreadCount());
+        int end = numStates;
+        for (int i = 1; i <= numChildren; ++i) {
+            int begin = numStates * (numChildren - i) / numChildren;
+            SearchTask* child = new SearchTask(graph, context, group);
+            child->states.reserve(end - begin);
+            for (int j = begin; j < end; ++j)
+                child->states.append(states.at(j));
+            children.append(child);
+            end = begin;
+        }
+        states.clear();
+
+        QListIterator<SearchTask*> it (children);
+        while (it.hasNext())
+            group->start(it.next());
+    }
+
+    // Children were started before this, so the group is not done early
+    if (pooled)
+        group->finish();
+}
+
+//---------------------------------------------------------------------------
+//  TaskGroup::start
+//
+//! Start a task in the thread pool as part of the group.
+//
+//! @param task the task
+//---------------------------------------------------------------------------
+void
+WordGraph::TaskGroup::start(SearchTask* task)
+{
+    mutex.lock();
+    ++numPending;
+    mutex.unlock();
+    task->pooled = true;
+    pool->start(task);
+}
+
+//---------------------------------------------------------------------------
+//  TaskGroup::finish
+//
+//! Note that a task of the group has finished.
+//---------------------------------------------------------------------------
+void
+WordGraph::TaskGroup::finish()
+{
+    QMutexLocker locker (&mutex);
+    if (!--numPending)
+        allDone.wakeAll();
+}
+
+//---------------------------------------------------------------------------
+//  TaskGroup::wait
+//
+//! Wait for every task started in the group to finish, without waiting for
+//! other tasks sharing the thread pool.
+//---------------------------------------------------------------------------
+void
+WordGraph::TaskGroup::wait()
+{
+    QMutexLocker locker (&mutex);
+    while (numPending)
+        allDone.wait(&mutex);
+}
+
+//---------------------------------------------------------------------------
+//  SearchTask::collectMatches
+//
+//! Append the words found by this task and its children to a list, in the
+//! order a serial traversal would have found them.
+//
+//! @param found the list of words found
+//---------------------------------------------------------------------------
+void
+WordGraph::SearchTask::collectMatches(QVector<Match>& found)
+{
+    if (found.isEmpty())
+        found = matches.words;
+    else
+        found += matches.words;
+    matches.words.clear();
+
+    QListIterator<SearchTask*> it (children);
+    while (it.hasNext())
+        it.next()->collectMatches(found);
+}
+
+//---------------------------------------------------------------------------
+//  SearchContext::isShownInfixMatch
+//
+//! Determine whether a word found in the infix index with the core of the
+//! pattern at a position should be shown with that position's letters in
+//! lower case.  The index holds the word once for each position the core
+//! matches, and the one chosen is the one a search of the DAWG finds first:
+//! the earliest after the first letter, or the first letter only if the
+//! core matches nowhere else.
+//
+//! @param word the word, in upper case
+//! @param length the length of the word
+//! @param start the position of the first letter matched by the core
+//! @return true if the word should be shown as found, false if it is shown
+//! as found at another position
+//---------------------------------------------------------------------------
+bool
+WordGraph::SearchContext::isShownInfixMatch(const char* word, int length,
+                                            int start) const
+{
+    int numCore = program.numInfixCore;
+    int end = start ? start : length - numCore + 1;
+    for (int i = 1; i < end; ++i) {
+        if (program.matchesInfixCore(word, i))
+            return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  MatchSet::addMatch
+//
+//! Add a matched word to the list if it passes the search filter.  A word
+//! found again right after itself is skipped.
+//
+//! @param state the traversal state at the end of the word
+//! @return true, to continue the traversal
+//---------------------------------------------------------------------------
+bool
+WordGraph::MatchSet::addMatch(const TraversalState& state)
+{
+    int length = state.wordLength;
+    int frontLength = qMin(state.frontLength, length);
+    Match match;
+    match.length = length;
+    for (int i = 0; i < length; ++i) {
+        match.display[i] = (i < frontLength) ? state.word[frontLength - i - 1]
+                                             : state.word[i];
+        match.upper[i] = toUpperLetter(match.display[i]);
+    }
+
+    int coreStart = frontLength - context->program.numInfixCore;
+    if (context->infix &&
+        !context->isShownInfixMatch(match.upper, length, coreStart))
+    {
+        return true;
+    }
+
+    if (!context->filter->matches(match.upper, length))
+        return true;
+
+    if (words.isEmpty() || !(words.last() == match))
+        words.append(match);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  sortMatches
+//
+//! Sort a list of matches and remove duplicate words.  Of the matches for
+//! the same word, the one found first is kept, so the word keeps the
+//! display form it was first found with.
+//
+//! @param matches the matches
+//---------------------------------------------------------------------------
+void
+WordGraph::sortMatches(QVector<Match>& matches)
+{
+    if (matches.isEmpty())
+        return;
+
+    qStableSort(matches.begin(), matches.end());
+
+    Match* data = matches.data();
+    int numMatches = matches.size();
+    int numKept = 1;
+    for (int i = 1; i < numMatches; ++i) {
+        if (data[i] == data[numKept - 1])
+            continue;
+        if (i != numKept)
+            data[numKept] = data[i];
+        ++numKept;
+    }
+    matches.resize(numKept);
+}
+
+//---------------------------------------------------------------------------
+//  intersectMatches
+//
+//! Keep the matches of a sorted list whose words are also in another sorted
+//! list, or only those whose words are not if negated.  The lists are
+//! walked together, so this takes time linear in their lengths.
+//
+//! @param matches the matches to filter
+//! @param other the matches to compare against
+//! @param negated whether to keep the words not in the other list
+//---------------------------------------------------------------------------
+void
+WordGraph::intersectMatches(QVector<Match>& matches,
+                            const QVector<Match>& other, bool negated)
+{
+    Match* data = matches.data();
+    int numMatches = matches.size();
+    const Match* otherData = other.constData();
+    int otherSize = other.size();
+    int numKept = 0;
+    int j = 0;
+    for (int i = 0; i < numMatches; ++i) {
+        while ((j < otherSize) && (otherData[j] < data[i]))
+            ++j;
+        bool found = (j < otherSize) && (otherData[j] == data[i]);
+        if (found == negated)
+            continue;
+        if (i != numKept)
+            data[numKept] = data[i];
+        ++numKept;
+    }
+    matches.resize(numKept);
+}
+
+//---------------------------------------------------------------------------
+//  mergeMatches
+//
+//! Merge a sorted list of matches into another.  A word in both lists keeps
+//! the display form it has in the list merged into.
+//
+//! @param matches the matches to merge into
+//! @param other the matches to merge
+//---------------------------------------------------------------------------
+void
+WordGraph::mergeMatches(QVector<Match>& matches, const QVector<Match>& other)
+{
+    QVector<Match> merged;
+    merged.reserve(matches.size() + other.size());
+    const Match* data = matches.constData();
+    const Match* otherData = other.constData();
+    int numMatches = matches.size();
+    int otherSize = other.size();
+    int i = 0;
+    int j = 0;
+    while ((i < numMatches) || (j < otherSize)) {
+        if ((j == otherSize) ||
+            ((i < numMatches) && !(otherData[j] < data[i])))
+        {
+            if ((j < otherSize) && (otherData[j] == data[i]))
+                ++j;
+            merged.append(data[i++]);
+        }
+        else {
+            merged.append(otherData[j++]);
+        }
+    }
+    matches = merged;
+}
 
-                            if (c == '[') {
-                                inGroup = true;
-                                negated = false;
-                                groupStart = i;
-                            }
+//---------------------------------------------------------------------------
+//  MatchStream
+//
+//! Constructor.
+//
+//! @param g the graph being searched
+//! @param c the search condition being traversed
+//! @param v the visitor to receive the words, or null to only count them
+//! @param max the maximum number of words to visit, or -1 for no limit
+//---------------------------------------------------------------------------
+WordGraph::MatchStream::MatchStream(const WordGraph* g,
+                                    const SearchContext* c, WordVisitor* v,
+                                    int max)
+    : graph(g), context(c), visitor(v), maxWords(max), numWords(0)
+{
+    found.resize(g->nodeWordCounts.at(ROOT_NODE));
+}
 
-                            else if (inGroup) {
-                                if (c == '^')
-                                    negated = true;
+//---------------------------------------------------------------------------
+//  MatchStream::addMatch
+//
+//! Pass a matched word to the visitor if it passes the search filter and
+//! has not been found before.
+//
+//! @param state the traversal state at the end of the word
+//! @return true to continue the traversal, false to stop it
+//---------------------------------------------------------------------------
+bool
+WordGraph::MatchStream::addMatch(const TraversalState& state)
+{
+    int length = state.wordLength;
+    int frontLength = qMin(state.frontLength, length);
+    char letters[MAX_WORD_LEN];
+    char upper[MAX_WORD_LEN];
+    for (int i = 0; i < length; ++i) {
+        letters[i] = (i < frontLength) ? state.word[frontLength - i - 1]
+                                       : state.word[i];
+        upper[i] = toUpperLetter(letters[i]);
+    }
 
-                                else if (c == ']') {
-                                    if (found ^ negated) {
-                                        qint32 child = *edge & M_NODE_POINTER;
+    int coreStart = frontLength - context->program.numInfixCore;
+    if (context->infix &&
+        !context->isShownInfixMatch(upper, length, coreStart))
+    {
+        return true;
+    }
 
-                                        if (matchEnd < 0) {
-                                            matchStart = groupStart;
-                                            matchEnd = i;
-                                            wildcardMatch = true;
-                                        }
+    int index = graph->getWordIndex(upper, length);
+    if (found.testBit(index))
+        return true;
+    found.setBit(index);
 
-                                        else if (child) {
-                                            states.push(TraversalState(child,
-                                                word + letter,
-                                                unmatched.left(groupStart) +
-                                                unmatched.right(
-                                                unmatched.length() - i - 1)));
-                                        }
-                                    }
-                                    inGroup = false;
-                                    found = false;
-                                    negated = false;
-                                }
+    if (!context->filter->matches(upper, length))
+        return true;
 
-                                else if (c == letter)
-                                    found = true;
-                            }
+    ++numWords;
+    if (visitor && !visitor->visitWord(letters, length))
+        return false;
+    return (numWords != maxWords);
+}
 
-                            // Matched the character itself
-                            else if (c == letter) {
-                                found = true;
-                                matchStart = i;
-                                matchEnd = i;
-                                break;
-                            }
-                        }
+//---------------------------------------------------------------------------
+//  getNumWords
+//
+//! Return the number of words in the graph.
+//
+//! @return the number of words
+//---------------------------------------------------------------------------
+int
+WordGraph::getNumWords() const
+{
+    return (dawg ? nodeWordCounts.at(ROOT_NODE) : numWords);
+}
 
-                        // Try to match the current letter against the
-                        // pattern.  If the letter doesn't match exactly,
-                        // match a ? char.
-                        //int index = unmatched.find(node->letter);
-                        found = (matchStart >= 0);
-                        if (!found) {
-                            matchStart = matchEnd = unmatched.indexOf("?");
-                            found = (matchStart >= 0);
-                            wildcardMatch = true;
-                        }
+//---------------------------------------------------------------------------
+//  getLengthCounts
+//
+//! Count the words of each length in the graph.
+//
+//! @return the number of words of each length, indexed by length, or an
+//! empty list if the graph has no forward DAWG
+//---------------------------------------------------------------------------
+QVector<int>
+WordGraph::getLengthCounts() const
+{
+    QVector<int> counts;
+    if (!dawg)
+        return counts;
+
+    QVector<WordKey> words;
+    getAllWords(words);
+    counts.fill(0, MAX_WORD_LEN + 1);
+    for (int i = 0; i < words.size(); ++i) {
+        if (words.at(i).isValid())
+            ++counts[words.at(i).getLength()];
+    }
+    return counts;
+}
 
-                        // If this letter matched or a wildcard was specified,
-                        // keep traversing after possibly adding the current
-                        // word.
-                        if (found || wildcard) {
-                            word += (found && !wildcardMatch) ? QChar(letter)
-                                : QChar(letter).toLower();
+//---------------------------------------------------------------------------
+//  matchesSpec
+//
+//! Determine whether a word matches a search specification.  Only the
+//! following attributes are checked: Include Letters, Consist Letters/Pct,
+//! Min Length, Num Vowels, Num Unique Letters, Point Value.  All other
+//! attributes are assumed to have been checked in the course of finding the
+//! word to be checked.  Anagram counts and probability orders are only
+//! matched by graphs with a forward DAWG, which do not call this function.
+//---------------------------------------------------------------------------
+bool
+WordGraph::matchesSpec(QString word, const SearchSpec& spec) const
+{
+    QListIterator<SearchCondition> it (spec.conditions);
+    while (it.hasNext()) {
+        const SearchCondition& condition = it.next();
 
-                            if (found)
-                                unmatched.replace(matchStart,
-                                                  matchEnd - matchStart + 1,
-                                                  QString());
+        switch (condition.type) {
+            case SearchCondition::Length:
+            if ((int(word.length()) < condition.minValue) ||
+                (int(word.length()) > condition.maxValue))
+                return false;
+            break;
 
-                            qint32 child = *edge & M_NODE_POINTER;
-                            if (child &&
-                                (wildcard || !unmatched.isEmpty()))
-                            {
-                                states.push(TraversalState(child, word,
-                                                           unmatched));
-                            }
+            case SearchCondition::IncludeLetters: {
+                QString tmpWord = word;
+                int includeLen = condition.stringValue.length();
+                for (int i = 0; i < includeLen; ++i) {
+                    int index = tmpWord.indexOf(condition.stringValue.at(i));
+                    if ((index < 0) ^ condition.negated)
+                        return false;
+                    tmpWord.replace(index, 1, QString());
+                }
+            }
+            break;
 
-                            QString wordUpper = word.toUpper();
-                            if ((*edge & M_END_OF_WORD) &&
-                                ((condition.type ==
-                                  SearchCondition::SubanagramMatch) ||
-                                  unmatched.isEmpty()) &&
-                                  matchesSpec(wordUpper, spec) &&
-                                  !wordSet.count(wordUpper))
-                            {
-                                wordSet.insert(make_pair(wordUpper, word));
-                            }
-                        }
-                    }
+            case SearchCondition::ConsistOf:
+            if ((condition.minValue > 0) || (condition.maxValue < 100)) {
+                int wordLen = word.length();
+                int consist = 0;
+                for (int i = 0; i < wordLen; ++i) {
+                    if (condition.stringValue.contains(word.at(i)))
+                        ++consist;
+                }
+                int consistPct = (consist * 100) / wordLen;
+                if ((consistPct < condition.minValue) ||
+                    (consistPct > condition.maxValue))
+                    return false;
+            }
+            break;
 
-                    if (*edge & M_END_OF_NODE)
-                        break;
+            case SearchCondition::NumVowels:
+            case SearchCondition::NumUniqueLetters:
+            case SearchCondition::PointValue: {
+                int value = 0;
+                if (condition.type == SearchCondition::NumVowels)
+                    value = Auxil::getNumVowels(word);
+                else if (condition.type == SearchCondition::NumUniqueLetters)
+                    value = Auxil::getNumUniqueLetters(word);
+                else {
+                    static LetterBag letterBag;
+                    for (int i = 0; i < word.length(); ++i)
+                        value += letterBag.getLetterValue(word.at(i));
                 }
+                if ((value < condition.minValue) ||
+                    (value > condition.maxValue))
+                    return false;
             }
+            break;
 
-            // Done traversing next nodes, pop a child off the stack
-            node = 0;
-            if (states.size()) {
-                TraversalState state = states.top();
-                node = state.node;
-                unmatched = state.unmatched;
-                word = state.word;
-                states.pop();
+            default: break;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  Rack::compile
+//
+//! Compile an Anagram or Subanagram pattern into letter counts.  Letters,
+//! ? chars and character classes each count against their own slot, and
+//! character classes with the same members share a slot.
+//
+//! @param pattern the pattern, with any * chars removed
+//! @return true if successful, false if the pattern has too many distinct
+//! letters or classes to be counted, or has a letter after a class
+//---------------------------------------------------------------------------
+bool
+WordGraph::Rack::compile(const QByteArray& pattern)
+{
+    numSlots = 0;
+    numClasses = 0;
+    numTiles = 0;
+    blankSlot = NO_SLOT;
+    memset(letterSlot, NO_SLOT, sizeof(letterSlot));
+    memset(counts, 0, sizeof(counts));
+
+    int patternLength = pattern.length();
+    for (int i = 0; i < patternLength; ++i) {
+        char c = pattern.at(i);
+        int slot = NO_SLOT;
+        ++numTiles;
+
+        if (c == '[') {
+            // An unterminated character class can never be consumed, so
+            // it keeps its tile but gets no slot
+            int close = pattern.indexOf(']', i);
+            if (close < 0)
+                break;
+
+            LetterSet members;
+            members.clear();
+            bool negated = false;
+            for (++i; i < close; ++i) {
+                char member = pattern.at(i);
+                if (member == '^')
+                    negated = true;
+                else
+                    members.insert(member);
+            }
+            if (negated)
+                members.invert();
+
+            int classNum = 0;
+            for (; classNum < numClasses; ++classNum) {
+                if (classMembers[classNum] == members)
+                    break;
+            }
+            if (classNum == numClasses) {
+                if (numSlots == MAX_SLOTS)
+                    return false;
+                classMembers[classNum] = members;
+                classSlot[classNum] = numSlots++;
+                ++numClasses;
             }
+            slot = classSlot[classNum];
         }
 
-        // Take conjunction or disjunction with final result set
-        if (!conditionNum) {
-            finalWordSet = wordSet;
+        else if (c == '?') {
+            if (blankSlot == NO_SLOT) {
+                if (numSlots == MAX_SLOTS)
+                    return false;
+                blankSlot = numSlots++;
+            }
+            slot = blankSlot;
+        }
+
+        // A letter following a character class is shown in lower case when
+        // matched after the class, which letter counts cannot reproduce
+        else if (numClasses) {
+            return false;
+        }
+
+        else {
+            uchar u = c;
+            if (letterSlot[u] == NO_SLOT) {
+                if (numSlots == MAX_SLOTS)
+                    return false;
+                letterSlot[u] = numSlots++;
+            }
+            slot = letterSlot[u];
+        }
+
+        if (counts[slot] == 0xFF)
+            return false;
+        ++counts[slot];
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  PatternProgram::compile
+//
+//! Compile a Pattern match into a sequence of elements.  Each * becomes an
+//! element matching any number of letters, and each ? char, character class
+//! or letter becomes an element matching a single letter.
+//
+//! @param pattern the pattern, with redundant * chars removed
+//---------------------------------------------------------------------------
+void
+WordGraph::PatternProgram::compile(const QByteArray& pattern)
+{
+    elements.clear();
+    numInfixCore = 0;
+
+    bool canEnd = true;
+    int patternLength = pattern.length();
+    for (int i = 0; i < patternLength; ++i) {
+        char c = pattern.at(i);
+        Element element;
+        element.letters.clear();
+        element.star = (c == '*');
+        element.lower = (c == '?');
+        element.accept = false;
+        element.separator = false;
+
+        if (element.star || element.lower) {
+            element.letters.invert();
+        }
+
+        else if (c == '[') {
+            // An unterminated character class can never be matched, so no
+            // word can end after it
+            int close = pattern.indexOf(']', i);
+            if (close < 0) {
+                elements.append(element);
+                canEnd = false;
+                break;
+            }
+
+            bool negated = false;
+            for (++i; i < close; ++i) {
+                char member = pattern.at(i);
+                if (member == '^')
+                    negated = true;
+                element.letters.insert(member);
+            }
+            if (negated)
+                element.letters.invert();
+            element.lower = true;
+        }
+
+        // A lone ^ is an empty negated class, and a lone ] is the end of an
+        // empty class
+        else {
+            element.letters.insert(c);
+            if (c == '^')
+                element.letters.invert();
+            element.lower = (c == ']');
+        }
+
+        elements.append(element);
+    }
+
+    // A word can end after the last element, or before a final *
+    int numElements = elements.size();
+    if (canEnd && numElements)
+        elements[numElements - 1].accept = true;
+    if (canEnd && (numElements > 1) && elements[numElements - 1].star)
+        elements[numElements - 2].accept = true;
+
+    // Count the letters needed to match each element and those after it
+    int minLetters = 0;
+    bool fixedLength = true;
+    for (int i = numElements - 1; i >= 0; --i) {
+        Element& element = elements[i];
+        if (element.star)
+            fixedLength = false;
+        else
+            ++minLetters;
+        element.minLetters = minLetters;
+        element.fixedLength = fixedLength;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  PatternProgram::compileInfix
+//
+//! Compile the core of a Pattern match of the form *core* into elements
+//! matching the paths of words through the infix index: the core spelled
+//! backward, a * matching the letters before the core, also spelled
+//! backward, the separator, and a * matching the letters after the core.
+//
+//! @param core the pattern without its outer * chars, with no * chars and
+//! no unterminated character classes
+//---------------------------------------------------------------------------
+void
+WordGraph::PatternProgram::compileInfix(const QByteArray& core)
+{
+    compile(core);
+    int numCore = elements.size();
+    numInfixCore = numCore;
+    for (int i = 0; i < numCore / 2; ++i)
+        qSwap(elements[i], elements[numCore - i - 1]);
+
+    Element star;
+    star.letters.clear();
+    star.letters.invert();
+    star.star = true;
+    star.lower = false;
+    star.separator = false;
+
+    Element separator;
+    separator.letters.clear();
+    separator.letters.insert(INFIX_SEPARATOR);
+    separator.star = false;
+    separator.lower = false;
+    separator.separator = true;
+
+    elements << star << separator << star;
+
+    // A word can end after the whole core is matched, whether or not a
+    // separator follows, but never right after the separator, since the
+    // rest of the word is never empty
+    for (int i = 0; i < elements.size(); ++i) {
+        Element& element = elements[i];
+        if (!element.separator)
+            element.letters.remove(INFIX_SEPARATOR);
+        element.accept = (i >= numCore - 1) && !element.separator;
+        element.minLetters = qMax(numCore - i, 0);
+        element.fixedLength = false;
+    }
+}
+
+//---------------------------------------------------------------------------
+//  PatternProgram::matchesInfixCore
+//
+//! Determine whether the core of an infix pattern matches a word at a
+//! position.
+//
+//! @param word the word, in upper case
+//! @param start the position of the first letter matched by the core
+//! @return true if the core matches, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::PatternProgram::matchesInfixCore(const char* word, int start) const
+{
+    for (int i = 0; i < numInfixCore; ++i) {
+        if (!elements.at(numInfixCore - i - 1).letters.contains(
+                word[start + i]))
+        {
+            return false;
         }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  ConditionCheck::start
+//
+//! Set the state of the check before any letter is matched.
+//
+//! @param data the check states of a traversal state
+//---------------------------------------------------------------------------
+void
+WordGraph::ConditionCheck::start(quint8* data) const
+{
+    quint8* p = data + offset;
+    p[0] = 0;
+    if (type == SearchCondition::PatternMatch) {
+        memcpy(p + 1, &closures[0], sizeof(quint32));
+    }
+    else {
+        p[1] = rack.numTiles;
+        memcpy(p + 2, rack.counts, rack.numSlots);
+    }
+}
+
+//---------------------------------------------------------------------------
+//  ConditionCheck::advance
+//
+//! Advance the state of the check past a letter.
+//
+//! @param data the check states of a traversal state
+//! @param letter the letter
+//! @return false if the check is positive and no word with the letters
+//! matched so far can match, true otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::ConditionCheck::advance(quint8* data, char letter) const
+{
+    quint8* p = data + offset;
+    if (p[0] & DEAD) {
+        p[0] = DEAD;
+        return negated;
+    }
 
-        else if (spec.conjunction) {
-            map<QString, QString> conjunctionSet;
-            for (sit = wordSet.begin(); sit != wordSet.end(); ++sit) {
-                map<QString, QString>::iterator found =
-                    finalWordSet.find(sit->first);
-                if (found != finalWordSet.end()) {
-                    if (negated)
-                        finalWordSet.erase(found);
-                    else
-                        conjunctionSet.insert(*found);
-                }
-            }
-            if (!negated) {
-                if (conjunctionSet.empty())
-                    return wordList;
-                finalWordSet = conjunctionSet;
-            }
+    bool accepting = false;
+    if (type == SearchCondition::PatternMatch) {
+        quint32 positions;
+        memcpy(&positions, p + 1, sizeof(quint32));
+
+        int numElements = program.elements.size();
+        quint32 nextPositions = 0;
+        quint32 bits = positions;
+        for (int i = 0; bits; ++i, bits >>= 1) {
+            if (!(bits & 1))
+                continue;
+            const PatternProgram::Element& element = program.elements.at(i);
+            if (!element.letters.contains(letter))
+                continue;
+            if (element.accept)
+                accepting = true;
+            if (element.star)
+                nextPositions |= closures[i];
+            else if (i + 1 < numElements)
+                nextPositions |= closures[i + 1];
         }
 
-        else {
-            // FIXME: disjunction is broken for negated conditions! Fix this
-            // when disjunction is enabled in the UI.
-            for (sit = wordSet.begin(); sit != wordSet.end(); ++sit) {
-                finalWordSet.insert(*sit);
-            }
-        }
+        memcpy(p + 1, &nextPositions, sizeof(quint32));
+        p[0] = (accepting ? ACCEPTING : 0) | (nextPositions ? 0 : DEAD);
+        return accepting || nextPositions || negated;
+    }
 
-        ++conditionNum;
+    // Prefer to match the letter itself, then a ? char, as the traversal
+    // does for a rack without character classes
+    quint8* counts = p + 2;
+    int slot = rack.letterSlot[(uchar) letter];
+    if ((slot == Rack::NO_SLOT) || !counts[slot]) {
+        slot = ((rack.blankSlot != Rack::NO_SLOT) && counts[rack.blankSlot])
+            ? rack.blankSlot : Rack::NO_SLOT;
     }
 
-    // Transform word set into word list and return it
-    for (sit = finalWordSet.begin(); sit != finalWordSet.end(); ++sit) {
-        wordList << (wildcardLower ? sit->second : sit->first);
+    if (slot != Rack::NO_SLOT) {
+        --counts[slot];
+        --p[1];
+    }
+    else if (!wildcard) {
+        p[0] = DEAD;
+        return negated;
     }
 
-    return wordList;
+    accepting = (type == SearchCondition::SubanagramMatch) || !p[1];
+    p[0] = accepting ? ACCEPTING : 0;
+    return true;
 }
 
 //---------------------------------------------------------------------------
-//  getNumWords
+//  ConditionCheck::getRemainingLengths
 //
-//! Return the number of words in the graph.
+//! Determine the numbers of letters that could follow the letters matched
+//! so far in a word matching the check.
 //
-//! @return the number of words
+//! @param data the check states of a traversal state
+//! @return a mask with a bit set for each number of letters
 //---------------------------------------------------------------------------
-int
-WordGraph::getNumWords() const
+quint16
+WordGraph::ConditionCheck::getRemainingLengths(const quint8* data) const
 {
-    return (dawg ? getNumWords(ROOT_NODE) : numWords);
+    if (negated)
+        return 0xFFFF;
+
+    const quint8* p = data + offset;
+    if (p[0] & DEAD)
+        return 0;
+
+    if (type == SearchCondition::PatternMatch) {
+        quint32 positions;
+        memcpy(&positions, p + 1, sizeof(quint32));
+        quint16 mask = 0;
+        quint32 bits = positions;
+        for (int i = 0; bits; ++i, bits >>= 1) {
+            if (bits & 1)
+                mask |= lengths[i];
+        }
+        return mask;
+    }
+
+    int numTiles = p[1];
+    int minRemaining = (type == SearchCondition::AnagramMatch)
+        ? qMax(numTiles, 1) : 1;
+    int maxRemaining = wildcard ? int(MAX_WORD_LEN) : numTiles;
+    if (maxRemaining < minRemaining)
+        return 0;
+    return ((2 << maxRemaining) - 1) & ~((1 << minRemaining) - 1);
 }
 
 //---------------------------------------------------------------------------
-//  matchesSpec
+//  WordFilter::compile
 //
-//! Determine whether a word matches a search specification.  Only the
-//! following attributes are checked: Include Letters, Consist Letters/Pct,
-//! Min Length, Min Anagrams, Max Anagrams, Min Probability, Max Probability.
-//! All other attributes are assumed to have been checked in the course of
-//! finding the word to be checked.
+//! Compile the conditions of a search specification that are checked
+//! against each word found rather than matched during a traversal.
+//
+//! @param spec the search specification
+//! @param g the graph being searched, holding the tables of anagram counts
+//! and probability orders
 //---------------------------------------------------------------------------
-bool
-WordGraph::matchesSpec(QString word, const SearchSpec& spec) const
+void
+WordGraph::WordFilter::compile(const SearchSpec& spec, const WordGraph* g)
 {
+    impossible = false;
+    minLength = 0;
+    maxLength = MAX_WORD_LEN;
+    minPoints = 0;
+    maxPoints = 10 * MAX_WORD_LEN;
+    minVowels = 0;
+    maxVowels = MAX_WORD_LEN;
+    minUniqueLetters = 0;
+    maxUniqueLetters = MAX_WORD_LEN;
+    includeLetters.clear();
+    memset(includeCounts, 0, sizeof(includeCounts));
+    excludeLetters.clear();
+    consistConditions.clear();
+    minAnagrams = 0;
+    maxAnagrams = 0xFFFF;
+    numAnagrams = 0;
+    orderConditions.clear();
+    affixJoins.clear();
+    graph = g;
+    bool usePoints = false;
+    bool useAnagrams = false;
+
     QListIterator<SearchCondition> it (spec.conditions);
     while (it.hasNext()) {
         const SearchCondition& condition = it.next();
 
         switch (condition.type) {
             case SearchCondition::Length:
-            if ((int(word.length()) < condition.minValue) ||
-                (int(word.length()) > condition.maxValue))
-                return false;
+            minLength = qMax(minLength, condition.minValue);
+            maxLength = qMin(maxLength, condition.maxValue);
             break;
 
+            // Each letter of the condition must be matched by a different
+            // letter of the word, or by no letter if negated.  A letter
+            // that cannot be in the graph can never be matched.
             case SearchCondition::IncludeLetters: {
-                QString tmpWord = word;
-                int includeLen = condition.stringValue.length();
-                for (int i = 0; i < includeLen; ++i) {
-                    int index = tmpWord.indexOf(condition.stringValue.at(i));
-                    if ((index < 0) ^ condition.negated)
-                        return false;
-                    tmpWord.replace(index, 1, QString());
+                int counts[256];
+                memset(counts, 0, sizeof(counts));
+                const QString& letters = condition.stringValue;
+                for (int i = 0; i < letters.length(); ++i) {
+                    ushort c = letters.at(i).unicode();
+                    if (condition.negated) {
+                        if (c < 256)
+                            excludeLetters.insert(char(c));
+                    }
+                    else if (c < 256)
+                        ++counts[c];
+                    else
+                        impossible = true;
+                }
+
+                for (int c = 0; c < 256; ++c) {
+                    if (counts[c] <= includeCounts[c])
+                        continue;
+                    if (!includeCounts[c])
+                        includeLetters.append(char(c));
+                    includeCounts[c] = counts[c];
                 }
             }
             break;
 
             case SearchCondition::ConsistOf:
             if ((condition.minValue > 0) || (condition.maxValue < 100)) {
-                int wordLen = word.length();
-                int consist = 0;
-                for (int i = 0; i < wordLen; ++i) {
-                    if (condition.stringValue.contains(word.at(i)))
-                        ++consist;
+                ConsistCondition consist;
+                consist.letters.clear();
+                const QString& letters = condition.stringValue;
+                for (int i = 0; i < letters.length(); ++i) {
+                    ushort c = letters.at(i).unicode();
+                    if (c < 256)
+                        consist.letters.insert(char(c));
                 }
-                int consistPct = (consist * 100) / wordLen;
-                if ((consistPct < condition.minValue) ||
-                    (consistPct > condition.maxValue))
-                    return false;
+                consist.minPercent = condition.minValue;
+                consist.maxPercent = condition.maxValue;
+                consistConditions.append(consist);
+            }
+            break;
+
+            case SearchCondition::PointValue:
+            minPoints = qMax(minPoints, condition.minValue);
+            maxPoints = qMin(maxPoints, condition.maxValue);
+            usePoints = true;
+            break;
+
+            case SearchCondition::NumVowels:
+            minVowels = qMax(minVowels, condition.minValue);
+            maxVowels = qMin(maxVowels, condition.maxValue);
+            break;
+
+            case SearchCondition::NumUniqueLetters:
+            minUniqueLetters = qMax(minUniqueLetters, condition.minValue);
+            maxUniqueLetters = qMin(maxUniqueLetters, condition.maxValue);
+            break;
+
+            case SearchCondition::NumAnagrams:
+            minAnagrams = qMax(minAnagrams, condition.minValue);
+            maxAnagrams = qMin(maxAnagrams, condition.maxValue);
+            useAnagrams = true;
+            break;
+
+            // A lax condition also passes a word if any equally probable
+            // word is within the range of orders
+            case SearchCondition::ProbabilityOrder: {
+                OrderCondition order;
+                order.orders = graph->getProbabilityOrders(
+                    qBound(0, condition.intValue, 2));
+                order.minOrder = condition.minValue;
+                order.maxOrder = condition.maxValue;
+                order.lax = condition.boolValue;
+                orderConditions.append(order);
             }
             break;
 
-            // XXX: Implement these!
-            //case SearchCondition::NumAnagrams:
-            //case SearchCondition::Probability:
+            case SearchCondition::Prefix:
+            case SearchCondition::Suffix:
+            if (graph->usesAffixJoin(condition)) {
+                AffixJoin join;
+                join.affix = condition.stringValue.toUpper().toLatin1();
+                join.suffix = (condition.type == SearchCondition::Suffix);
+                join.negated = condition.negated;
+                affixJoins.append(join);
+            }
+            break;
 
             default: break;
         }
     }
 
+    if (useAnagrams)
+        numAnagrams = graph->getNumAnagrams();
+
+    // Point values are those stored in the database, taken from the default
+    // letter bag
+    static LetterBag letterBag;
+    maxLetterPoints = 0;
+    for (int c = 0; c < 256; ++c) {
+        letterPoints[c] =
+            usePoints ? letterBag.getLetterValue(QChar::fromLatin1(c)) : 0;
+        maxLetterPoints = qMax(maxLetterPoints, letterPoints[c]);
+        vowel[c] = Auxil::isVowel(QChar::fromLatin1(c));
+        lowerLetters[c] = toLowerLetter(char(c));
+    }
+
+    // Required letters are tracked by slot while a word is being matched
+    int numRequired = 0;
+    memset(includeSlot, NO_SLOT, sizeof(includeSlot));
+    for (int i = 0; i < includeLetters.length(); ++i) {
+        uchar c = includeLetters.at(i);
+        numRequired += includeCounts[c];
+        if (i < MAX_WORD_LEN)
+            includeSlot[c] = i;
+    }
+
+    if ((numRequired > MAX_WORD_LEN) || (minPoints > maxPoints) ||
+        (minVowels > maxVowels) || (minUniqueLetters > maxUniqueLetters) ||
+        (minAnagrams > maxAnagrams))
+    {
+        impossible = true;
+    }
+
+    pruning = usePoints || (minVowels > 0) || (maxVowels < MAX_WORD_LEN) ||
+        (minUniqueLetters > 0) || (maxUniqueLetters < MAX_WORD_LEN) ||
+        !includeLetters.isEmpty() || !consistConditions.isEmpty();
+}
+
+//---------------------------------------------------------------------------
+//  WordFilter::matches
+//
+//! Determine whether a word passes the compiled conditions.
+//
+//! @param word the letters of the word in upper case
+//! @param length the length of the word
+//! @return true if the word passes, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::WordFilter::matches(const char* word, int length) const
+{
+    if (impossible || (length < minLength) || (length > maxLength))
+        return false;
+
+    for (int i = 0; i < length; ++i) {
+        if (excludeLetters.contains(word[i]))
+            return false;
+    }
+
+    for (int i = 0; i < includeLetters.length(); ++i) {
+        char letter = includeLetters.at(i);
+        int count = 0;
+        for (int j = 0; j < length; ++j) {
+            if (word[j] == letter)
+                ++count;
+        }
+        if (count < includeCounts[(uchar) letter])
+            return false;
+    }
+
+    for (int i = 0; i < consistConditions.size(); ++i) {
+        const ConsistCondition& consist = consistConditions.at(i);
+        int count = 0;
+        for (int j = 0; j < length; ++j) {
+            if (consist.letters.contains(word[j]))
+                ++count;
+        }
+        int percent = (count * 100) / length;
+        if ((percent < consist.minPercent) || (percent > consist.maxPercent))
+            return false;
+    }
+
+    int points = 0;
+    int numVowels = 0;
+    int numUniqueLetters = 0;
+    LetterSet seen;
+    seen.clear();
+    for (int i = 0; i < length; ++i) {
+        points += letterPoints[(uchar) word[i]];
+        if (vowel[(uchar) word[i]])
+            ++numVowels;
+        if (!seen.contains(word[i])) {
+            seen.insert(word[i]);
+            ++numUniqueLetters;
+        }
+    }
+
+    if ((points < minPoints) || (points > maxPoints) ||
+        (numVowels < minVowels) || (numVowels > maxVowels) ||
+        (numUniqueLetters < minUniqueLetters) ||
+        (numUniqueLetters > maxUniqueLetters))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < affixJoins.size(); ++i) {
+        const AffixJoin& join = affixJoins.at(i);
+        const char* affix = join.affix.constData();
+        int affixLength = join.affix.length();
+        bool found = join.suffix
+            ? graph->containsJoined(word, length, affix, affixLength)
+            : graph->containsJoined(affix, affixLength, word, length);
+        if (found == join.negated)
+            return false;
+    }
+
+    if (!numAnagrams && orderConditions.isEmpty())
+        return true;
+
+    // Anagram counts and probability orders are looked up by the position
+    // of the word in the graph
+    int index = graph->getWordIndex(word, length);
+    if (numAnagrams && ((numAnagrams[index] < minAnagrams) ||
+                        (numAnagrams[index] > maxAnagrams)))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < orderConditions.size(); ++i) {
+        const OrderCondition& condition = orderConditions.at(i);
+        const ProbabilityOrders* orders = condition.orders;
+        int lowOrder = condition.lax ? orders->minOrder.at(index)
+                                     : orders->order.at(index);
+        int highOrder = condition.lax ? orders->maxOrder.at(index)
+                                      : orders->order.at(index);
+        if ((highOrder < condition.minOrder) ||
+            (lowOrder > condition.maxOrder))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//  WordFilter::start
+//
+//! Set the totals of a traversal state before any letter is matched.
+//
+//! @param totals the totals
+//---------------------------------------------------------------------------
+void
+WordGraph::WordFilter::start(Totals& totals) const
+{
+    totals.points = 0;
+    totals.numVowels = 0;
+    totals.numUniqueLetters = 0;
+    totals.numMissing = 0;
+    memset(totals.missing, 0, sizeof(totals.missing));
+    memset(totals.consistCounts, 0, sizeof(totals.consistCounts));
+
+    int numSlots = qMin(includeLetters.length(), int(MAX_WORD_LEN));
+    for (int i = 0; i < numSlots; ++i) {
+        totals.missing[i] = includeCounts[(uchar) includeLetters.at(i)];
+        totals.numMissing += totals.missing[i];
+    }
+}
+
+//---------------------------------------------------------------------------
+//  WordFilter::advance
+//
+//! Add a matched letter to the totals of a traversal state, and determine
+//! whether any word continuing with the letter could still pass.  Limits
+//! that more letters can still meet are left to getMinRemaining.
+//
+//! @param totals the totals
+//! @param word the letters matched before this one, in any order, lower
+//! case where matched by a wildcard
+//! @param length the number of letters matched before this one
+//! @param letter the letter in upper case
+//! @return true if a word could still pass, false otherwise
+//---------------------------------------------------------------------------
+bool
+WordGraph::WordFilter::advance(Totals& totals, const char* word, int length,
+                               char letter) const
+{
+    uchar c = letter;
+    totals.points += letterPoints[c];
+    if (vowel[c])
+        ++totals.numVowels;
+
+    if ((minUniqueLetters > 0) || (maxUniqueLetters < MAX_WORD_LEN)) {
+        char lower = lowerLetters[c];
+        int i = 0;
+        while ((i < length) && (word[i] != letter) && (word[i] != lower))
+            ++i;
+        if (i == length)
+            ++totals.numUniqueLetters;
+    }
+
+    int slot = includeSlot[c];
+    if ((slot != NO_SLOT) && totals.missing[slot]) {
+        --totals.missing[slot];
+        --totals.numMissing;
+    }
+
+    if ((totals.points > maxPoints) || (totals.numVowels > maxVowels) ||
+        (totals.numUniqueLetters > maxUniqueLetters))
+    {
+        return false;
+    }
+
+    // A percentage can only be met if the longest word allowed could meet
+    // it, with every letter still to come on the side that helps
+    int numConsist = qMin(consistConditions.size(), int(MAX_CONSIST_TOTALS));
+    for (int i = 0; i < numConsist; ++i) {
+        const ConsistCondition& consist = consistConditions.at(i);
+        if (consist.letters.contains(letter))
+            ++totals.consistCounts[i];
+        int count = totals.consistCounts[i];
+        if ((count * 100 >= (consist.maxPercent + 1) * maxLength) ||
+            ((length + 1 - count) * 100 >
+             (100 - consist.minPercent) * maxLength))
+        {
+            return false;
+        }
+    }
+
     return true;
 }
 
+//---------------------------------------------------------------------------
+//  WordFilter::getMinRemaining
+//
+//! Determine the number of letters that must still be matched for a word to
+//! meet the lower limits of the filter.
+//
+//! @param totals the totals of the letters matched so far
+//! @return the minimum number of letters remaining
+//---------------------------------------------------------------------------
+int
+WordGraph::WordFilter::getMinRemaining(const Totals& totals) const
+{
+    int minRemaining = totals.numMissing;
+    minRemaining = qMax(minRemaining, minVowels - totals.numVowels);
+    minRemaining = qMax(minRemaining,
+                        minUniqueLetters - totals.numUniqueLetters);
+
+    int pointsNeeded = minPoints - totals.points;
+    if (pointsNeeded > 0) {
+        if (!maxLetterPoints)
+            return MAX_WORD_LEN + 1;
+        minRemaining = qMax(minRemaining,
+            (pointsNeeded + maxLetterPoints - 1) / maxLetterPoints);
+    }
+    return minRemaining;
+}
+
 //---------------------------------------------------------------------------
 //  convertEndian
 //
@@ -722,6 +3359,125 @@ WordGraph::convertEndian(qint32* data, qint32 count)
     return count;
 }
 
+//---------------------------------------------------------------------------
+//  releaseDawg
+//
+//! Release the forward or reverse DAWG, unmapping its file if it was mapped
+//! into memory, or freeing its heap array otherwise.
+//
+//! @param reverse whether to release the reverse DAWG
+//---------------------------------------------------------------------------
+void
+WordGraph::releaseDawg(bool reverse)
+{
+    const qint32*& data = (reverse ? rdawg : dawg);
+    QFile*& file = (reverse ? rdawgFile : dawgFile);
+
+    if (file) {
+        file->unmap((uchar*) data);
+        delete file;
+    }
+    else if (data) {
+        delete[] data;
+    }
+
+    data = 0;
+    file = 0;
+
+    (reverse ? rnodeWordCounts : nodeWordCounts).clear();
+    (reverse ? rnodeLengths : nodeLengths).clear();
+    if (!reverse) {
+        childMasks.clear();
+        QMutexLocker locker (&tableMutex);
+        numAnagrams.clear();
+        anagramIds.clear();
+        anagramRuns.clear();
+        anagramIndexFailed = false;
+        for (int i = 0; i < 3; ++i)
+            probabilityOrders[i] = ProbabilityOrders();
+    }
+}
+
+//---------------------------------------------------------------------------
+//  releaseInfixIndex
+//
+//! Release the infix index, if it has been built.
+//---------------------------------------------------------------------------
+void
+WordGraph::releaseInfixIndex()
+{
+    delete[] gaddag;
+    gaddag = 0;
+    gaddagLengths.clear();
+}
+
+//---------------------------------------------------------------------------
+//  indexDawg
+//
+//! Build an index of the letters leaving each node of the forward DAWG, so
+//! an edge can be found without scanning the node.  The index is only
+//! built if the graph uses at most 32 distinct letters and the edges of
+//! every node are in letter order.  Must be called after annotateDawg, which
+//! marks the nodes reachable from the root.
+//
+//! @param numEdges the number of edges in the DAWG
+//---------------------------------------------------------------------------
+void
+WordGraph::indexDawg(qint32 numEdges)
+{
+    childMasks.clear();
+    for (int i = 0; i < 256; ++i)
+        childLetterIndex[i] = -1;
+
+    // Find the letters used by the graph, and make sure the edges of each
+    // node are in letter order
+    bool used[256];
+    memset(used, 0, sizeof(used));
+    for (qint32 node = ROOT_NODE; node <= numEdges; ++node) {
+        if (!nodeLengths.at(node))
+            continue;
+
+        int prevLetter = -1;
+        for (const qint32* edge = &dawg[node]; ; ++edge) {
+            int letter = (*edge >> V_LETTER) & M_LETTER;
+            if (letter <= prevLetter)
+                return;
+            used[letter] = true;
+            prevLetter = letter;
+            if (*edge & M_END_OF_NODE)
+                break;
+        }
+    }
+
+    int numLetters = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (used[i])
+            ++numLetters;
+    }
+    if (numLetters > 32)
+        return;
+
+    numLetters = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (used[i])
+            childLetterIndex[i] = numLetters++;
+    }
+
+    childMasks.fill(0, numEdges + 1);
+    for (qint32 node = ROOT_NODE; node <= numEdges; ++node) {
+        if (!nodeLengths.at(node))
+            continue;
+
+        quint32 mask = 0;
+        for (const qint32* edge = &dawg[node]; ; ++edge) {
+            mask |= 1U << childLetterIndex[(*edge >> V_LETTER) & M_LETTER];
+            if (*edge & M_END_OF_NODE)
+                break;
+        }
+        childMasks[node] = mask;
+    }
+}
+
 //---------------------------------------------------------------------------
 //  addWordOld
 //
@@ -1212,26 +3968,168 @@ WordGraph::searchOld(const SearchSpec& spec) const
 }
 
 //---------------------------------------------------------------------------
-//  getNumWords
+//  annotateDawg
 //
-//! Return the number of words under a node in the graph.
+//! Compute the number of words and the lengths of words below each node of
+//! the forward or reverse DAWG.
 //
-//! @return the number of words
+//! @param reverse whether to annotate the reverse DAWG
+//! @param numEdges the number of edges in the DAWG
 //---------------------------------------------------------------------------
-int
-WordGraph::getNumWords(qint32 node) const
+void
+WordGraph::annotateDawg(bool reverse, qint32 numEdges)
+{
+    QVector<quint32>& counts = (reverse ? rnodeWordCounts : nodeWordCounts);
+    QVector<quint16>& lengths = (reverse ? rnodeLengths : nodeLengths);
+
+    counts.fill(0, numEdges + 1);
+    lengths.fill(0, numEdges + 1);
+    if (numEdges >= ROOT_NODE) {
+        annotateNode(reverse ? rdawg : dawg, ROOT_NODE, counts.data(),
+                     lengths.data());
+    }
+}
+
+//---------------------------------------------------------------------------
+//  annotateNode
+//
+//! Compute the number of words and the lengths of words below a node, and
+//! below each node beneath it that has not already been annotated.  Bit N
+//! of a length mask is set if a word ends N letters below the node, with
+//! bit 15 standing for 15 letters or more.
+//
+//! @param graph the DAWG edges
+//! @param node the node
+//! @param counts the word counts, indexed by node
+//! @param lengths the length masks, indexed by node
+//---------------------------------------------------------------------------
+void
+WordGraph::annotateNode(const qint32* graph, qint32 node, quint32* counts,
+                        quint16* lengths) const
 {
-    int count = 0;
-    for (qint32* edge = &dawg[node]; ; ++edge) {
-        if ((*edge & M_END_OF_WORD) != 0)
+    quint32 count = 0;
+    quint16 mask = 0;
+    for (const qint32* edge = &graph[node]; ; ++edge) {
+        if (*edge & M_END_OF_WORD) {
             ++count;
-        node = *edge & M_NODE_POINTER;
-        if (node)
-            count += getNumWords(node);
+            mask |= 1 << 1;
+        }
+
+        qint32 child = *edge & M_NODE_POINTER;
+        if (child) {
+            // Every node has a word below it, so an empty mask means the
+            // child has not been annotated yet
+            if (!lengths[child])
+                annotateNode(graph, child, counts, lengths);
+            count += counts[child];
+
+            // The separator of the infix index is not a letter of the word
+            if (((*edge >> V_LETTER) & M_LETTER) == INFIX_SEPARATOR)
+                mask |= lengths[child];
+            else
+                mask |= (lengths[child] << 1) | (lengths[child] & 0x8000);
+        }
+
         if (*edge & M_END_OF_NODE)
             break;
     }
-    return count;
+
+    counts[node] = count;
+    lengths[node] = mask;
+}
+
+//---------------------------------------------------------------------------
+//  getRemainingLengths
+//
+//! Determine the numbers of letters that could follow a traversal state to
+//! complete a match, given the search length limits and what remains of
+//! the pattern.
+//
+//! @param context the search condition prepared for traversal
+//! @param state the traversal state
+//! @return a length mask with bit N set if a match could be completed with
+//! N more letters
+//---------------------------------------------------------------------------
+quint16
+WordGraph::getRemainingLengths(const SearchContext& context,
+                               const TraversalState& state) const
+{
+    int minRemaining = qMax(context.minLength - state.wordLength, 1);
+    int maxRemaining = context.maxLength - state.wordLength;
+    if (context.filter->pruning) {
+        minRemaining = qMax(minRemaining,
+                            context.filter->getMinRemaining(state.totals));
+    }
+
+    switch (context.type) {
+        case SearchCondition::PatternMatch:
+        if (state.position < context.program.elements.size()) {
+            const PatternProgram::Element& element =
+                context.program.elements.at(state.position);
+            minRemaining = qMax(minRemaining, element.minLetters);
+            if (element.fixedLength)
+                maxRemaining = qMin(maxRemaining, element.minLetters);
+        }
+        break;
+
+        case SearchCondition::AnagramMatch:
+        case SearchCondition::SubanagramMatch: {
+            int numTiles = context.useRack ? state.rackRemaining
+                : context.numTokens - state.numConsumed;
+            if (context.type == SearchCondition::AnagramMatch)
+                minRemaining = qMax(minRemaining, numTiles);
+            if (!context.wildcard)
+                maxRemaining = qMin(maxRemaining, numTiles);
+        }
+        break;
+
+        default: break;
+    }
+
+    if (maxRemaining < minRemaining)
+        return 0;
+
+    quint16 mask = ((2 << maxRemaining) - 1) & ~((1 << minRemaining) - 1);
+    for (int i = 0; mask && (i < context.checks.size()); ++i)
+        mask &= context.checks.at(i).getRemainingLengths(state.checks);
+    return mask;
+}
+
+//---------------------------------------------------------------------------
+//  getWordIndex
+//
+//! Find the position of a word among the words of the forward DAWG, in the
+//! order of their letters.  The word must be in the DAWG.
+//
+//! @param word the letters of the word in upper case
+//! @param length the length of the word
+//! @return the index of the word
+//---------------------------------------------------------------------------
+int
+WordGraph::getWordIndex(const char* word, int length) const
+{
+    const qint32* graph = dawg;
+    const quint32* counts = nodeWordCounts.constData();
+
+    // Count the words ending at or passing through each earlier edge, and
+    // the words ending along the way
+    int index = 0;
+    const qint32* edge = &graph[ROOT_NODE];
+    for (int i = 0; i < length; ++i) {
+        if (i) {
+            if (*edge & M_END_OF_WORD)
+                ++index;
+            edge = &graph[*edge & M_NODE_POINTER];
+        }
+
+        char letter = word[i];
+        for (; (char) ((*edge >> V_LETTER) & M_LETTER) != letter; ++edge) {
+            if (*edge & M_END_OF_WORD)
+                ++index;
+            index += counts[*edge & M_NODE_POINTER];
+        }
+    }
+    return index;
 }
 
 //---------------------------------------------------------------------------
@@ -25,24 +25,65 @@
 #ifndef ZYZZYVA_WORD_GRAPH_H
 #define ZYZZYVA_WORD_GRAPH_H
 
+#include "AlphagramKey.h"
+#include "CancelToken.h"
 #include "SearchSpec.h"
+#include "WordKey.h"
+#include <QBitArray>
+#include <QByteArray>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
 #include <QString>
 #include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
 
 class WordGraph
 {
     public:
+    // Receives the words found by a search as soon as they are found.  Each
+    // word is passed as single-byte letters in upper case, except letters
+    // matched by wildcards, which are in lower case.
+    class WordVisitor {
+      public:
+        virtual ~WordVisitor() { }
+
+        // Return false to stop the search
+        virtual bool visitWord(const char* word, int length) = 0;
+    };
+
     WordGraph();
     ~WordGraph();
 
     void clear();
     bool importDawgFile(const QString& filename, bool reverse, QString*
                         errString, quint16* expectedChecksum);
+    bool importWords(const QStringList& words);
+    bool buildInfixIndex();
+    bool hasInfixIndex() const { return gaddag != 0; }
+    bool usesInfixIndex(const SearchCondition& condition) const;
+    bool usesWordTables(const SearchCondition& condition) const;
+    bool usesAffixJoin(const SearchCondition& condition) const;
     void addWord(const QString& w);
     bool containsWord(const QString& w) const;
-    QStringList search(const SearchSpec& spec) const;
+    QBitArray containsWords(const QStringList& words) const;
+    QStringList search(const SearchSpec& spec,
+                       const CancelToken* cancelToken = 0) const;
+    int visitWords(const SearchSpec& spec, WordVisitor* visitor,
+                   int maxWords = -1) const;
+    bool canFilterWords(const SearchSpec& spec) const;
+    QStringList filterWords(const SearchSpec& spec, const QStringList& words)
+        const;
     int getNumWords() const;
+    QVector<int> getLengthCounts() const;
+    bool hasWordIds() const { return dawg != 0; }
+    int getWordId(const QString& w) const;
+    WordKey getWordById(int id) const;
+    int getNumAnagrams(int id) const { return getNumAnagrams()[id]; }
+    int countAnagrams(const QString& word) const;
 
     private:
     class Node {
@@ -56,13 +97,423 @@ class WordGraph
         Node* child;
     };
 
+    // The probability order of each word among the words of the same length,
+    // and the range of orders shared by equally probable words, indexed by
+    // the position of the word in the forward DAWG.  Ties are ordered by
+    // alphagram, then by word, as in the database.
+    class ProbabilityOrders {
+      public:
+        QVector<quint32> order;
+        QVector<quint32> minOrder;
+        QVector<quint32> maxOrder;
+    };
+
+    // A run of word IDs sharing an alphagram in the anagram index
+    class AnagramRun {
+      public:
+        AnagramRun(qint32 s = 0, qint32 c = 0) : start(s), count(c) { }
+        qint32 start;
+        qint32 count;
+    };
+
+    // A word ranked by length, then by descending probability, then by
+    // alphagram and word, for computing probability orders
+    class RankedWord {
+      public:
+        bool operator<(const RankedWord& rhs) const {
+            if (length != rhs.length)
+                return length < rhs.length;
+            if (combinations != rhs.combinations)
+                return combinations > rhs.combinations;
+            int n = qMin(radix.length(), rhs.radix.length());
+            for (int i = 0; i < n; ++i) {
+                if (radix.at(i) != rhs.radix.at(i))
+                    return (uchar) radix.at(i) < (uchar) rhs.radix.at(i);
+            }
+            return radix.length() < rhs.radix.length();
+        }
+
+        int length;
+        double combinations;
+        QByteArray radix;
+        int index;
+    };
+
+    // A set of single-byte DAWG letters, one bit per possible letter
+    class LetterSet {
+      public:
+        void clear() {
+            for (int i = 0; i < 8; ++i)
+                bits[i] = 0;
+        }
+        void invert() {
+            for (int i = 0; i < 8; ++i)
+                bits[i] = ~bits[i];
+        }
+        void insert(char letter) {
+            uchar c = letter;
+            bits[c >> 5] |= 1U << (c & 31);
+        }
+        void remove(char letter) {
+            uchar c = letter;
+            bits[c >> 5] &= ~(1U << (c & 31));
+        }
+        bool contains(char letter) const {
+            uchar c = letter;
+            return bits[c >> 5] & (1U << (c & 31));
+        }
+        bool operator==(const LetterSet& rhs) const {
+            for (int i = 0; i < 8; ++i) {
+                if (bits[i] != rhs.bits[i])
+                    return false;
+            }
+            return true;
+        }
+
+        quint32 bits[8];
+    };
+
+    // An Anagram or Subanagram pattern compiled into a multiset of letters.
+    // Literal letters, character classes and blanks each own a slot in the
+    // count vector carried by each traversal state, so matching a letter
+    // costs a table lookup instead of a scan of the pattern.
+    class Rack {
+      public:
+        enum { MAX_SLOTS = 32, NO_SLOT = 0xFF };
+
+        bool compile(const QByteArray& pattern);
+
+        int numSlots;
+        int numClasses;
+        int numTiles;
+        int blankSlot;
+        quint8 letterSlot[256];
+        quint8 classSlot[MAX_SLOTS];
+        LetterSet classMembers[MAX_SLOTS];
+        quint8 counts[MAX_SLOTS];
+    };
+
+    // A Pattern match compiled into a sequence of elements, each a * or a
+    // set of letters matching a single position, so matching a letter costs
+    // a bit test instead of a scan of the pattern.
+    class PatternProgram {
+      public:
+        class Element {
+          public:
+            LetterSet letters;
+            bool star;
+            bool lower;
+            bool accept;
+            bool separator;
+
+            // Letters needed to match this element and those after it, and
+            // whether no * follows to allow more
+            int minLetters;
+            bool fixedLength;
+        };
+
+        void compile(const QByteArray& pattern);
+        void compileInfix(const QByteArray& core);
+        bool matchesInfixCore(const char* word, int start) const;
+
+        QVector<Element> elements;
+        int numInfixCore;
+    };
+
+    // A match condition checked alongside the condition driving a
+    // traversal, so that several conditions are matched in one walk of the
+    // graph.  A Pattern match is tracked as the set of pattern elements
+    // that may match the next letter, and an Anagram or Subanagram match
+    // without character classes as letter counts, so neither ever needs to
+    // branch.  The state of each check is kept in a few bytes of the
+    // traversal state, starting at its offset.
+    class ConditionCheck {
+      public:
+        enum { MAX_STATE_BYTES = 24, ACCEPTING = 1, DEAD = 2 };
+
+        void start(quint8* data) const;
+        bool advance(quint8* data, char letter) const;
+        bool accepts(const quint8* data) const {
+            return bool(data[offset] & ACCEPTING) ^ negated;
+        }
+        quint16 getRemainingLengths(const quint8* data) const;
+
+        SearchCondition::SearchType type;
+        bool negated;
+        bool wildcard;
+        int offset;
+        int size;
+        Rack rack;
+        PatternProgram program;
+
+        // Elements reachable from each pattern element without matching a
+        // letter, and the numbers of letters that can follow each element
+        quint32 closures[32];
+        quint16 lengths[32];
+    };
+
+    // The conditions of a search spec checked against each word found,
+    // compiled so that a word can be checked without creating any strings.
+    // Conditions on totals of the letters of a word are also tracked while
+    // the word is being matched, so a traversal can skip the words below a
+    // node once none of them can pass.
+    class WordFilter {
+      public:
+        enum { MAX_CONSIST_TOTALS = 4, MAX_JOINED = 4, NO_SLOT = 0xFF };
+
+        class ConsistCondition {
+          public:
+            LetterSet letters;
+            int minPercent;
+            int maxPercent;
+        };
+
+        class OrderCondition {
+          public:
+            const ProbabilityOrders* orders;
+            int minOrder;
+            int maxOrder;
+            bool lax;
+        };
+
+        // A Prefix or Suffix condition, passed by a word if the affix
+        // joined to the word is also a word
+        class AffixJoin {
+          public:
+            QByteArray affix;
+            bool suffix;
+            bool negated;
+        };
+
+        // Totals of the letters matched so far, carried by each traversal
+        // state.  Kept small, since states are copied for every edge.
+        class Totals {
+          public:
+            quint16 points;
+            quint8 numVowels;
+            quint8 numUniqueLetters;
+            quint8 numMissing;
+            quint8 missing[Defs::MAX_WORD_LEN];
+            quint8 consistCounts[MAX_CONSIST_TOTALS];
+        };
+
+        void compile(const SearchSpec& spec, const WordGraph* g);
+        bool matches(const char* word, int length) const;
+        void start(Totals& totals) const;
+        bool advance(Totals& totals, const char* word, int length,
+                     char letter) const;
+        int getMinRemaining(const Totals& totals) const;
+
+        bool impossible;
+        bool pruning;
+        int minLength;
+        int maxLength;
+        int minPoints;
+        int maxPoints;
+        int maxLetterPoints;
+        int minVowels;
+        int maxVowels;
+        int minUniqueLetters;
+        int maxUniqueLetters;
+        QByteArray includeLetters;
+        int includeCounts[256];
+        quint8 includeSlot[256];
+        LetterSet excludeLetters;
+        QVector<ConsistCondition> consistConditions;
+        int minAnagrams;
+        int maxAnagrams;
+        const quint16* numAnagrams;
+        QVector<OrderCondition> orderConditions;
+        QVector<AffixJoin> affixJoins;
+        const WordGraph* graph;
+        int letterPoints[256];
+        bool vowel[256];
+        char lowerLetters[256];
+    };
+
+    // Traversal state for the DAWG search.  Holds no heap data, so states
+    // can be copied and stacked without allocation.  The word is stored as
+    // single-byte letters, lower case where matched by a wildcard.  Pattern
+    // matches track the index of the next unmatched pattern element.  The
+    // letters at the start of the word, up to the front length, are stored
+    // spelled backward, as they are found in the reverse graph or the infix
+    // index.
+    // Anagram matches track the letters remaining in the rack, or the
+    // positions of consumed pattern elements if the rack is too large to be
+    // compiled.  Affixes joined to the start of the word track the node
+    // reached by the affix and the letters matched so far.
     class TraversalState {
       public:
-        TraversalState(qint32 n, const QString& w, const QString& u)
-            : node(n), word(w), unmatched(u) { }
+        bool isConsumed(int pos) const {
+            for (int i = 0; i < numConsumed; ++i) {
+                if (consumed[i] == pos)
+                    return true;
+            }
+            return false;
+        }
+        void consume(int pos) { consumed[numConsumed++] = pos; }
+
         qint32 node;
-        QString word;
-        QString unmatched;
+        int wordLength;
+        int frontLength;
+        int position;
+        int numConsumed;
+        int rackRemaining;
+        char word[Defs::MAX_WORD_LEN];
+        int consumed[Defs::MAX_WORD_LEN];
+        quint8 rack[Rack::MAX_SLOTS];
+        quint8 checks[ConditionCheck::MAX_STATE_BYTES];
+        qint32 joinNodes[WordFilter::MAX_JOINED];
+        WordFilter::Totals totals;
+    };
+
+    // A search condition prepared for traversal.  Shared read-only by all
+    // tasks searching for the condition.
+    class SearchContext {
+      public:
+        const WordFilter* filter;
+        SearchCondition::SearchType type;
+        QByteArray pattern;
+        int numTokens;
+        bool wildcard;
+        bool reversePattern;
+        bool infix;
+        int minLength;
+        int maxLength;
+        const bool* excludeLetter;
+        bool useRack;
+        Rack rack;
+        PatternProgram program;
+        QVector<ConditionCheck> checks;
+        int numJoins;
+        const CancelToken* cancelToken;
+
+        // Advance the checks past a letter, returning false if a positive
+        // check can no longer match
+        bool advanceChecks(quint8* data, char letter) const {
+            for (int i = 0; i < checks.size(); ++i) {
+                if (!checks.at(i).advance(data, letter))
+                    return false;
+            }
+            return true;
+        }
+
+        // Whether every check accepts the word matched so far
+        bool checksAccept(const quint8* data) const {
+            for (int i = 0; i < checks.size(); ++i) {
+                if (!checks.at(i).accepts(data))
+                    return false;
+            }
+            return true;
+        }
+
+        bool isShownInfixMatch(const char* word, int length, int start)
+            const;
+    };
+
+    // A word found by a search, in upper case and as displayed.  Holds no
+    // heap data, so result lists can be built and sorted without
+    // allocating per word.  Matches are ordered by their upper case words.
+    class Match {
+      public:
+        bool operator<(const Match& rhs) const {
+            int n = qMin(length, rhs.length);
+            for (int i = 0; i < n; ++i) {
+                if (upper[i] != rhs.upper[i])
+                    return (uchar) upper[i] < (uchar) rhs.upper[i];
+            }
+            return length < rhs.length;
+        }
+        bool operator==(const Match& rhs) const {
+            if (length != rhs.length)
+                return false;
+            for (int i = 0; i < length; ++i) {
+                if (upper[i] != rhs.upper[i])
+                    return false;
+            }
+            return true;
+        }
+
+        quint8 length;
+        char upper[Defs::MAX_WORD_LEN];
+        char display[Defs::MAX_WORD_LEN];
+    };
+
+    // Receives the words matched during a traversal
+    class MatchSink {
+      public:
+        virtual ~MatchSink() { }
+
+        // Return false to stop the traversal
+        virtual bool addMatch(const TraversalState& state) = 0;
+    };
+
+    // Collects matches into a list in the order they are found, which may
+    // hold the same word more than once
+    class MatchSet : public MatchSink {
+      public:
+        MatchSet(const SearchContext* c) : context(c) { }
+        bool addMatch(const TraversalState& state);
+
+        const SearchContext* context;
+        QVector<Match> words;
+    };
+
+    // Passes each distinct match to a word visitor as it is found, or only
+    // counts the matches if there is no visitor.  Matches are told apart by
+    // their position in the graph, so nothing is allocated per match.
+    class MatchStream : public MatchSink {
+      public:
+        MatchStream(const WordGraph* g, const SearchContext* c,
+                    WordVisitor* v, int max);
+        bool addMatch(const TraversalState& state);
+
+        const WordGraph* graph;
+        const SearchContext* context;
+        WordVisitor* visitor;
+        int maxWords;
+        int numWords;
+        QBitArray found;
+    };
+
+    class SearchTask;
+
+    // The tasks started in a thread pool for one traversal, so a search can
+    // wait for its own tasks without waiting for those of other searches
+    // sharing the pool
+    class TaskGroup {
+      public:
+        TaskGroup(QThreadPool* p) : pool(p), numPending(0) { }
+        void start(SearchTask* task);
+        void finish();
+        void wait();
+
+        QThreadPool* pool;
+        QMutex mutex;
+        QWaitCondition allDone;
+        int numPending;
+    };
+
+    // A part of the traversal for a search condition.  A task that turns out
+    // to be large hands the rest of its traversal to child tasks, whose
+    // results follow its own.  A task without a group always traverses
+    // serially.
+    class SearchTask : public QRunnable {
+      public:
+        SearchTask(const WordGraph* g, const SearchContext* c, TaskGroup* t)
+            : graph(g), context(c), group(t), pooled(false), matches(c)
+            { setAutoDelete(false); }
+        ~SearchTask() { qDeleteAll(children); }
+        void run();
+        void collectMatches(QVector<Match>& found);
+
+        const WordGraph* graph;
+        const SearchContext* context;
+        TaskGroup* group;
+        bool pooled;
+        QVector<TraversalState> states;
+        MatchSet matches;
+        QList<SearchTask*> children;
     };
 
     class TraversalStateOld {
@@ -76,16 +527,97 @@ class WordGraph
 
     private:
     bool matchesSpec(QString word, const SearchSpec& spec) const;
+    const qint32* findEdge(qint32 node, char letter,
+                           bool reverse = false) const;
+    bool containsJoined(const char* first, int firstLength,
+                        const char* second, int secondLength) const;
+    bool advanceJoins(const SearchContext& context, qint32* nodes,
+                      char letter) const;
+    void getMatchConditions(const SearchSpec& spec,
+                            QList<SearchCondition>& conditions,
+                            int& minLength, int& maxLength,
+                            bool* excludeLetter) const;
+    QString getMatchPattern(const SearchCondition& condition,
+                            bool& wildcard) const;
+    void prepareContext(const SearchCondition& condition,
+                        SearchContext& context, TraversalState& state) const;
+    void addChecks(QList<SearchCondition>& conditions,
+                   SearchContext& context, TraversalState& state) const;
+    bool compileCheck(const SearchCondition& condition, bool reverse,
+                      ConditionCheck& check) const;
+    void traverse(const SearchContext& context,
+                  QVector<TraversalState>& states, MatchSink& matches,
+                  int maxStates) const;
+    int getWordIndex(const char* word, int length) const;
+    void getAllWords(QVector<WordKey>& words) const;
+    bool buildAnagramIndex() const;
+    bool getAnagramIds(const AlphagramKey& key, QVector<qint32>& ids) const;
+    bool searchAnagramIndex(const SearchSpec& spec, QStringList& words)
+        const;
+    const quint16* getNumAnagrams() const;
+    const ProbabilityOrders* getProbabilityOrders(int numBlanks) const;
+    static void sortMatches(QVector<Match>& matches);
+    static void intersectMatches(QVector<Match>& matches,
+                                 const QVector<Match>& other, bool negated);
+    static void mergeMatches(QVector<Match>& matches,
+                             const QVector<Match>& other);
     QString reverseString(const QString& s) const;
     qint32 convertEndian(qint32* data, qint32 count);
+    void releaseDawg(bool reverse);
+    void releaseInfixIndex();
+    void annotateDawg(bool reverse, qint32 numEdges);
+    void indexDawg(qint32 numEdges);
+    void annotateNode(const qint32* graph, qint32 node, quint32* counts,
+                      quint16* lengths) const;
+    quint16 getRemainingLengths(const SearchContext& context,
+                                const TraversalState& state) const;
 
     void addWordOld(const QString& w, bool reverse);
     bool containsWordOld(const QString& w) const;
     QStringList searchOld(const SearchSpec& spec) const;
-    int getNumWords(qint32 node) const;
 
-    qint32* dawg;
-    qint32* rdawg;
+    const qint32* dawg;
+    const qint32* rdawg;
+
+    // Files backing memory-mapped DAWGs, or null if the DAWG was copied into
+    // a heap array
+    QFile* dawgFile;
+    QFile* rdawgFile;
+
+    // Number of words and mask of word lengths below each node, indexed by
+    // the node's first edge
+    QVector<quint32> nodeWordCounts;
+    QVector<quint32> rnodeWordCounts;
+    QVector<quint16> nodeLengths;
+    QVector<quint16> rnodeLengths;
+
+    // Index of every word entered once for each of its prefixes, as the
+    // prefix spelled backward followed by a separator and the rest of the
+    // word, so a word can be found from any substring of it.  Null unless
+    // built on request.
+    const qint32* gaddag;
+    QVector<quint16> gaddagLengths;
+
+    // Number of anagrams of each word, indexed by the position of the word
+    // in the forward DAWG, and probability orders for 0, 1 and 2 blanks.
+    // Computed the first time a search needs them.
+    mutable QVector<quint16> numAnagrams;
+    mutable ProbabilityOrders probabilityOrders[3];
+
+    // IDs of the words of the forward DAWG grouped by alphagram, and the run
+    // of IDs sharing each alphagram, so the anagrams of a word are found
+    // with a single lookup.  Built the first time it is needed, unless a
+    // word has letters that cannot be packed into an alphagram key.
+    mutable QVector<qint32> anagramIds;
+    mutable QHash<AlphagramKey, AnagramRun> anagramRuns;
+    mutable bool anagramIndexFailed;
+    mutable QMutex tableMutex;
+
+    // Letters leaving each node of the forward DAWG as a bit mask, indexed
+    // by the node's first edge, and the bit used for each letter.  Empty if
+    // the DAWG cannot be indexed.
+    QVector<quint32> childMasks;
+    int childLetterIndex[256];
 
     bool bigEndian;
 
@@ -0,0 +1,132 @@
+//---------------------------------------------------------------------------
+// WordKey.h
+//
+// A fixed-width word value type for use inside the engine.
+//
+// Copyright 2004-2012 Boshvark Software, LLC.
+//
+// This file is part of Zyzzyva.
+//
+// Zyzzyva is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Zyzzyva is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//---------------------------------------------------------------------------
+
+#ifndef ZYZZYVA_WORD_KEY_H
+#define ZYZZYVA_WORD_KEY_H
+
+#include "Defs.h"
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <cstring>
+
+// A word of up to MAX_WORD_LEN single-byte letters, held inline with its
+// length in 16 bytes.  Holds no heap data, so words can be copied, sorted,
+// hashed and turned into alphagrams without allocating.  A word that is too
+// long or has letters outside Latin-1 cannot be held, and makes an invalid
+// key.  QStrings are only created when a key is converted back for display.
+class WordKey
+{
+    public:
+    WordKey() : length(0) { memset(letters, 0, sizeof(letters)); }
+    WordKey(const char* word, int len) : length(0) {
+        memset(letters, 0, sizeof(letters));
+        if ((len <= 0) || (len > Defs::MAX_WORD_LEN))
+            return;
+        memcpy(letters, word, len);
+        length = len;
+    }
+    explicit WordKey(const QString& word) : length(0) {
+        memset(letters, 0, sizeof(letters));
+        int len = word.length();
+        if (!len || (len > Defs::MAX_WORD_LEN))
+            return;
+        const QChar* chars = word.unicode();
+        for (int i = 0; i < len; ++i) {
+            ushort c = chars[i].unicode();
+            if (!c || (c > 0xFF))
+                return;
+            letters[i] = (char) c;
+        }
+        length = len;
+    }
+
+    bool isValid() const { return length != 0; }
+    int getLength() const { return length; }
+    const char* getLetters() const { return letters; }
+    char at(int i) const { return letters[i]; }
+
+    QString toString() const {
+        return QString::fromLatin1(letters, length);
+    }
+    QByteArray toByteArray() const { return QByteArray(letters, length); }
+
+    // The letters of the word in byte order.  Two words are anagrams if
+    // their alphagram keys are equal.  The letters are not in the
+    // locale-aware order of Auxil::getAlphagram, so the key is for comparing
+    // and grouping words rather than for display.
+    WordKey getAlphagram() const {
+        WordKey key = *this;
+        for (int i = 1; i < length; ++i) {
+            char c = key.letters[i];
+            int j = i;
+            for (; (j > 0) && ((uchar) key.letters[j - 1] > (uchar) c); --j)
+                key.letters[j] = key.letters[j - 1];
+            key.letters[j] = c;
+        }
+        return key;
+    }
+
+    WordKey getReversed() const {
+        WordKey key = *this;
+        for (int i = 0; i < length; ++i)
+            key.letters[i] = letters[length - i - 1];
+        return key;
+    }
+
+    // The word with the letter at a position removed
+    WordKey withoutLetter(int pos) const {
+        WordKey key = *this;
+        memmove(key.letters + pos, key.letters + pos + 1,
+                length - pos - 1);
+        key.letters[--key.length] = 0;
+        return key;
+    }
+
+    bool operator==(const WordKey& rhs) const {
+        return (length == rhs.length) &&
+            !memcmp(letters, rhs.letters, length);
+    }
+    bool operator!=(const WordKey& rhs) const { return !(*this == rhs); }
+    bool operator<(const WordKey& rhs) const {
+        int cmp = memcmp(letters, rhs.letters, qMin(length, rhs.length));
+        return cmp ? (cmp < 0) : (length < rhs.length);
+    }
+
+    private:
+    quint8 length;
+    char letters[Defs::MAX_WORD_LEN];
+};
+
+inline uint
+qHash(const WordKey& key)
+{
+    uint hash = key.getLength();
+    const char* letters = key.getLetters();
+    for (int i = 0; i < key.getLength(); ++i)
+        hash = (hash * 31) + (uchar) letters[i];
+    return hash;
+}
+
+#endif // ZYZZYVA_WORD_KEY_H
@@ -43,6 +43,7 @@ win32 {
 SOURCES = \
     AboutDialog.cpp \
     AnalyzeQuizDialog.cpp \
+    AttributeStore.cpp \
     Auxil.cpp \
     CardboxAddDialog.cpp \
     CardboxForm.cpp \
@@ -51,6 +52,7 @@ SOURCES = \
     CardboxRescheduleDialog.cpp \
     CreateDatabaseThread.cpp \
     DatabaseRebuildDialog.cpp \
+    DawgBuilder.cpp \
     DefineForm.cpp \
     DefinitionBox.cpp \
     DefinitionDialog.cpp \
@@ -67,6 +69,7 @@ SOURCES = \
     MainSettings.cpp \
     MainWindow.cpp \
     NewQuizDialog.cpp \
+    QueryHelper.cpp \
     QuizCanvas.cpp \
     QuizEngine.cpp \
     QuizForm.cpp \
@@ -81,6 +84,7 @@ SOURCES = \
     SearchConditionForm.cpp \
     SearchSpec.cpp \
     SearchSpecForm.cpp \
+    SearchThread.cpp \
     SettingsDialog.cpp \
     WordEngine.cpp \
     WordEntryDialog.cpp \
@@ -129,6 +133,7 @@ HEADERS = \
     SearchForm.h \
     SearchConditionForm.h \
     SearchSpecForm.h \
+    SearchThread.h \
     SettingsDialog.h \
     WordEngine.h \
     WordEntryDialog.h \
@@ -25,9 +25,18 @@
 #include <QtTest/QtTest>
 
 #include "WordEngine.h"
+#include "WordGraph.h"
+#include "AlphagramKey.h"
+#include "AttributeStore.h"
+#include "LetterBag.h"
 #include "MainSettings.h"
+#include "SearchSpec.h"
 #include "Auxil.h"
 #include "Defs.h"
+#include <QSqlQuery>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QThreadPool>
 
 class WordEngineTest : public QObject
 {
@@ -38,6 +47,19 @@ class WordEngineTest : public QObject
     private slots:
     void testSearch_data();
     void testSearch();
+    void testImportWords();
+    void testImportLongWords();
+    void testPooledSearch();
+    void testWordIds();
+    void testContainsWords();
+    void testInfixIndex();
+    void testLetterTotals();
+    void testAffixJoins();
+    void testWordCache();
+    void testAttributeStore();
+    void testSearchPlans();
+    void testCanonicalString();
+    void testAlphagramKey();
 
     private:
     void tryImport();
@@ -50,6 +72,118 @@ class WordEngineTest : public QObject
 
 QString TEST_LEXICON = Defs::LEXICON_OWL2;
 
+//---------------------------------------------------------------------------
+//  getTestWords
+//
+//! Get a small list of words, with words sharing prefixes and a set of
+//! anagrams.
+//
+//! @return the words, in upper case and in no particular order
+//---------------------------------------------------------------------------
+QStringList
+getTestWords()
+{
+    QStringList words;
+    words << "CATSUP" << "A" << "AB" << "ABS" << "CAT" << "CATS" << "DOG"
+          << "DOGS" << "STAR" << "RATS" << "ARTS" << "TARS" << "TSAR"
+          << "ZYZZYVA" << "UNCOPYRIGHTABLE";
+    return words;
+}
+
+//---------------------------------------------------------------------------
+//  getGeneratedWords
+//
+//! Get every word up to a length that can be spelled from a set of letters,
+//! for lexicons large enough to split a search across threads.
+//
+//! @param letters the letters
+//! @param maxLength the maximum length of the words
+//! @return the words, in alphabetical order
+//---------------------------------------------------------------------------
+QStringList
+getGeneratedWords(const QString& letters, int maxLength)
+{
+    QStringList words;
+    QStringList shorter;
+    shorter << QString();
+    for (int length = 1; length <= maxLength; ++length) {
+        QStringList current;
+        foreach (const QString& prefix, shorter) {
+            for (int i = 0; i < letters.length(); ++i)
+                current << prefix + letters.at(i);
+        }
+        words += current;
+        shorter = current;
+    }
+    qSort(words);
+    return words;
+}
+
+//---------------------------------------------------------------------------
+//  matchesTotals
+//
+//! Determine whether a word matches a condition on the letters it holds,
+//! checked one condition at a time for comparing against searches.
+//
+//! @param word the word, in upper case
+//! @param condition a Length, Include Letters, Consist Of, Point Value,
+//! Number of Vowels or Number of Unique Letters condition
+//! @return true if the word matches, false otherwise
+//---------------------------------------------------------------------------
+bool
+matchesTotals(const QString& word, const SearchCondition& condition)
+{
+    int value = 0;
+    switch (condition.type) {
+        case SearchCondition::Length:
+        value = word.length();
+        break;
+
+        case SearchCondition::IncludeLetters: {
+            QString remaining = word;
+            foreach (QChar c, condition.stringValue) {
+                int i = remaining.indexOf(c);
+                if (condition.negated && (i >= 0))
+                    return false;
+                if (!condition.negated && (i < 0))
+                    return false;
+                if (i >= 0)
+                    remaining.remove(i, 1);
+            }
+        }
+        return true;
+
+        case SearchCondition::ConsistOf: {
+            int consist = 0;
+            foreach (QChar c, word) {
+                if (condition.stringValue.contains(c))
+                    ++consist;
+            }
+            value = (consist * 100) / word.length();
+        }
+        break;
+
+        case SearchCondition::PointValue: {
+            LetterBag bag;
+            foreach (QChar c, word)
+                value += bag.getLetterValue(c);
+        }
+        break;
+
+        case SearchCondition::NumVowels:
+        value = Auxil::getNumVowels(word);
+        break;
+
+        case SearchCondition::NumUniqueLetters:
+        value = Auxil::getNumUniqueLetters(word);
+        break;
+
+        default: break;
+    }
+
+    return (value >= condition.minValue) && (value <= condition.maxValue);
+}
+
 //---------------------------------------------------------------------------
 //  tryImport
 //
@@ -61,22 +195,26 @@ WordEngineTest::tryImport()
     if (prepared)
         return;
 
-    bool ok = engine.importDawgFile(Auxil::getWordsDir() +
-                                    "/north-american/owl2.dwg",
-                                    Defs::LEXICON_CUSTOM, false);
+    bool ok = engine.importDawgFile(TEST_LEXICON, Auxil::getWordsDir() +
+                                    "/North-American/OWL2.dwg", false);
     if (!ok)
         return;
 
-    ok = engine.importDawgFile(Auxil::getWordsDir() +
-                               "/north-american/owl2-r.dwg",
-                               Defs::LEXICON_CUSTOM, true);
+    ok = engine.importDawgFile(TEST_LEXICON, Auxil::getWordsDir() +
+                               "/North-American/OWL2-R.dwg", true);
+    if (!ok)
+        return;
+
+    // Searches for words new in OWL2 look up words in the older lexicon
+    ok = engine.importDawgFile(Defs::LEXICON_OWL, Auxil::getWordsDir() +
+                               "/North-American/OWL.dwg", false);
     if (!ok)
         return;
 
     engine.importStems(TEST_LEXICON, Auxil::getWordsDir() +
-                       "/north-american/6-letter-stems.txt");
+                       "/North-American/6-letter-stems.txt");
     engine.importStems(TEST_LEXICON, Auxil::getWordsDir() +
-                       "/north-american/7-letter-stems.txt");
+                       "/North-American/7-letter-stems.txt");
 
     MainSettings::setLetterDistribution("A:9 B:2 C:2 D:4 E:12 F:2 G:3 H:2 "
                                         "I:9 J:1 K:1 L:4 M:2 N:6 O:8 P:2 "
@@ -166,6 +304,1012 @@ WordEngineTest::testSearch()
     QCOMPARE(foundResults, expectedResults);
 }
 
+//---------------------------------------------------------------------------
+//  testImportWords
+//
+//! Test that a word graph packed in process accepts the same words as the
+//! old-style graph built one word at a time.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testImportWords()
+{
+    QStringList words = getTestWords();
+    QStringList nonWords;
+    nonWords << "C" << "CA" << "CATSU" << "CATSUPS" << "DO" << "STARS"
+             << "RAST" << "UNCOPYRIGHTABL";
+
+    WordGraph packed;
+    QVERIFY(packed.importWords(words));
+    QVERIFY(packed.hasWordIds());
+
+    WordGraph old;
+    foreach (const QString& word, words)
+        old.addWord(word);
+
+    foreach (const QString& word, words + nonWords)
+        QCOMPARE(packed.containsWord(word), old.containsWord(word));
+    QCOMPARE(packed.getNumWords(), old.getNumWords());
+}
+
+//---------------------------------------------------------------------------
+//  testImportLongWords
+//
+//! Test that words longer than MAX_WORD_LEN are not packed, and that a text
+//! lexicon containing them still accepts every word.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testImportLongWords()
+{
+    QStringList words = getTestWords();
+    words << "OVERINTELLECTUALIZE" << "ANTIDISESTABLISHMENTARIANISM";
+
+    WordGraph packed;
+    QVERIFY(!packed.importWords(words));
+    QVERIFY(!packed.hasWordIds());
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QTextStream out (&file);
+    foreach (const QString& word, words)
+        out << word << "\n";
+    out.flush();
+
+    QString lexicon = "LongWords";
+    WordEngine wordEngine;
+    QCOMPARE(wordEngine.importTextFile(lexicon, file.fileName(), false),
+             words.size());
+
+    foreach (const QString& word, words)
+        QVERIFY(wordEngine.isAcceptable(lexicon, word));
+
+    QStringList nonWords;
+    nonWords << "OVERINTELLECTUALIZ" << "ANTIDISESTABLISHMENT" << "CATSU";
+    foreach (const QString& word, nonWords)
+        QVERIFY(!wordEngine.isAcceptable(lexicon, word));
+}
+
+//---------------------------------------------------------------------------
+//  testPooledSearch
+//
+//! Test that a search split across the thread pool finds the same words in
+//! the same order as a serial search.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testPooledSearch()
+{
+    QStringList words = getGeneratedWords("ABCDEFGH", 5);
+    WordGraph graph;
+    QVERIFY(graph.importWords(words));
+
+    QList<SearchCondition> conditions;
+    SearchCondition condition;
+    condition.type = SearchCondition::PatternMatch;
+    condition.stringValue = "*A*";
+    conditions << condition;
+    condition.type = SearchCondition::SubanagramMatch;
+    condition.stringValue = "AABBCDEF";
+    conditions << condition;
+
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int maxThreads = pool->maxThreadCount();
+    foreach (const SearchCondition& c, conditions) {
+        SearchSpec spec;
+        spec.conditions << c;
+
+        pool->setMaxThreadCount(1);
+        QStringList serial = graph.search(spec);
+        pool->setMaxThreadCount(4);
+        QStringList pooled = graph.search(spec);
+        pool->setMaxThreadCount(maxThreads);
+
+        QVERIFY(!serial.isEmpty());
+        QCOMPARE(pooled, serial);
+    }
+
+    QStringList expected;
+    foreach (const QString& word, words) {
+        if (word.contains('A'))
+            expected << word;
+    }
+    SearchSpec spec;
+    spec.conditions << conditions.first();
+    QCOMPARE(graph.search(spec), expected);
+}
+
+//---------------------------------------------------------------------------
+//  testContainsWords
+//
+//! Test that looking up a list of words at once gives the same results as
+//! looking up each word, for words sharing prefixes and for no words.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testContainsWords()
+{
+    WordGraph graph;
+    QVERIFY(graph.importWords(getTestWords()));
+
+    QStringList lookups;
+    lookups << "CAT" << "CATS" << "CA" << "CATSUP" << "CATSUPS" << "CAT"
+            << "A" << "AB" << "ABS" << "ABSENT" << "DO" << "DOG" << "DOGS"
+            << "C";
+    QBitArray found = graph.containsWords(lookups);
+    QCOMPARE(found.size(), lookups.size());
+    for (int i = 0; i < lookups.size(); ++i)
+        QCOMPARE(found.testBit(i), graph.containsWord(lookups.at(i)));
+
+    QCOMPARE(graph.containsWords(QStringList()).size(), 0);
+}
+
+//---------------------------------------------------------------------------
+//  testWordIds
+//
+//! Test that word IDs number the words of a graph from 0 in alphabetical
+//! order, and that getWordId and getWordById are inverses.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testWordIds()
+{
+    QStringList words = getTestWords();
+    WordGraph graph;
+    QVERIFY(graph.importWords(words));
+    QCOMPARE(graph.getNumWords(), words.size());
+
+    QStringList found;
+    for (int id = 0; id < graph.getNumWords(); ++id) {
+        WordKey word = graph.getWordById(id);
+        QVERIFY(word.isValid());
+        QCOMPARE(graph.getWordId(word.toString()), id);
+        found << word.toString();
+    }
+
+    QStringList expected = words;
+    qSort(expected);
+    QCOMPARE(found, expected);
+
+    QCOMPARE(graph.getWordId("CATSU"), -1);
+    QCOMPARE(graph.getWordId("CATSUPS"), -1);
+    QVERIFY(!graph.getWordById(-1).isValid());
+    QVERIFY(!graph.getWordById(graph.getNumWords()).isValid());
+}
+
+//---------------------------------------------------------------------------
+//  testInfixIndex
+//
+//! Test that substring patterns searched in the infix index find the same
+//! words as searches of the DAWG, and that other patterns are not searched
+//! in the index.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testInfixIndex()
+{
+    QStringList words = getGeneratedWords("ABCDE", 5);
+    WordGraph graph;
+    QVERIFY(graph.importWords(words));
+
+    QStringList patterns;
+    patterns << "*CAB*" << "*A?E*" << "*[BD]EA*" << "*EEEEE*" << "*A*";
+    QStringList unindexed;
+    unindexed << "CAB*" << "*CAB" << "*C*B*" << "*??*" << "*[BD*";
+
+    QList<QStringList> expected;
+    foreach (const QString& pattern, patterns + unindexed) {
+        SearchSpec spec;
+        SearchCondition condition;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = pattern;
+        spec.conditions << condition;
+        expected << graph.search(spec);
+    }
+
+    QStringList cabWords;
+    foreach (const QString& word, words) {
+        if (word.contains("CAB"))
+            cabWords << word;
+    }
+    QVERIFY(!cabWords.isEmpty());
+    QCOMPARE(expected.first(), cabWords);
+
+    QVERIFY(!graph.hasInfixIndex());
+    QVERIFY(graph.buildInfixIndex());
+    QVERIFY(graph.hasInfixIndex());
+
+    int i = 0;
+    foreach (const QString& pattern, patterns + unindexed) {
+        SearchSpec spec;
+        SearchCondition condition;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = pattern;
+        spec.conditions << condition;
+        QCOMPARE(graph.usesInfixIndex(condition), i < patterns.size());
+        QCOMPARE(graph.search(spec), expected.at(i));
+        ++i;
+    }
+
+    // Narrow the words found in the index by another condition
+    SearchSpec spec;
+    SearchCondition condition;
+    condition.type = SearchCondition::PatternMatch;
+    condition.stringValue = "*CAB*";
+    spec.conditions << condition;
+    condition.type = SearchCondition::Length;
+    condition.minValue = 4;
+    condition.maxValue = 4;
+    spec.conditions << condition;
+    QStringList cabFours;
+    foreach (const QString& word, cabWords) {
+        if (word.length() == 4)
+            cabFours << word;
+    }
+    QCOMPARE(graph.search(spec), cabFours);
+
+    // Compare searches of a real lexicon
+    WordGraph lexiconGraph;
+    QVERIFY(lexiconGraph.importDawgFile(Auxil::getWordsDir() +
+                                        "/North-American/OWL2.dwg", false,
+                                        0, 0));
+    patterns.clear();
+    patterns << "*ZZ*" << "*Q?A*" << "*[AEIOU]X[AEIOU]*" << "*ESS*";
+    expected.clear();
+    foreach (const QString& pattern, patterns) {
+        SearchSpec patternSpec;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = pattern;
+        patternSpec.conditions << condition;
+        expected << lexiconGraph.search(patternSpec);
+    }
+
+    QVERIFY(lexiconGraph.buildInfixIndex());
+    for (int i = 0; i < patterns.size(); ++i) {
+        SearchSpec patternSpec;
+        condition.type = SearchCondition::PatternMatch;
+        condition.stringValue = patterns.at(i);
+        patternSpec.conditions << condition;
+        QVERIFY(lexiconGraph.usesInfixIndex(condition));
+        QVERIFY(!expected.at(i).isEmpty());
+        QCOMPARE(lexiconGraph.search(patternSpec), expected.at(i));
+    }
+}
+
+//---------------------------------------------------------------------------
+//  testLetterTotals
+//
+//! Test that searches pruned by the totals of the letters matched so far,
+//! for Length, Include Letters, Consist Of, Point Value and letter count
+//! conditions, find the same words as checking every word.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testLetterTotals()
+{
+    WordGraph graph;
+    QVERIFY(graph.importDawgFile(Auxil::getWordsDir() +
+                                 "/North-American/OWL2.dwg", false, 0, 0));
+
+    SearchCondition pattern;
+    pattern.type = SearchCondition::PatternMatch;
+    pattern.stringValue = "*";
+    SearchCondition subanagram;
+    subanagram.type = SearchCondition::SubanagramMatch;
+    subanagram.stringValue = "AEIOURSTQZZ";
+
+    SearchSpec allSpec;
+    allSpec.conditions << pattern;
+    QStringList allWords = graph.search(allSpec);
+    SearchSpec rackSpec;
+    rackSpec.conditions << subanagram;
+    QStringList rackWords = graph.search(rackSpec);
+    QVERIFY(!allWords.isEmpty());
+    QVERIFY(!rackWords.isEmpty());
+
+    SearchCondition length;
+    length.type = SearchCondition::Length;
+    length.minValue = 4;
+    length.maxValue = 7;
+    SearchCondition include;
+    include.type = SearchCondition::IncludeLetters;
+    include.stringValue = "QZ";
+    SearchCondition includeTwice;
+    includeTwice.type = SearchCondition::IncludeLetters;
+    includeTwice.stringValue = "ZZ";
+    SearchCondition exclude;
+    exclude.type = SearchCondition::IncludeLetters;
+    exclude.stringValue = "AEIOU";
+    exclude.negated = true;
+    SearchCondition consist;
+    consist.type = SearchCondition::ConsistOf;
+    consist.stringValue = "AEIOU";
+    consist.minValue = 50;
+    consist.maxValue = 100;
+    SearchCondition points;
+    points.type = SearchCondition::PointValue;
+    points.minValue = 25;
+    points.maxValue = 30;
+    SearchCondition vowels;
+    vowels.type = SearchCondition::NumVowels;
+    vowels.minValue = 0;
+    vowels.maxValue = 1;
+    SearchCondition unique;
+    unique.type = SearchCondition::NumUniqueLetters;
+    unique.minValue = 7;
+    unique.maxValue = 7;
+
+    QList<QList<SearchCondition> > tests;
+    tests << (QList<SearchCondition>() << length << include)
+          << (QList<SearchCondition>() << includeTwice << consist)
+          << (QList<SearchCondition>() << length << consist)
+          << (QList<SearchCondition>() << exclude << length)
+          << (QList<SearchCondition>() << points)
+          << (QList<SearchCondition>() << points << vowels << length)
+          << (QList<SearchCondition>() << unique << include);
+
+    for (int rack = 0; rack < 2; ++rack) {
+        foreach (const QList<SearchCondition>& conditions, tests) {
+            SearchSpec spec;
+            spec.conditions << (rack ? subanagram : pattern) << conditions;
+
+            QStringList expected;
+            foreach (const QString& word, rack ? rackWords : allWords) {
+                bool matches = true;
+                foreach (const SearchCondition& condition, conditions)
+                    matches = matches && matchesTotals(word, condition);
+                if (matches)
+                    expected << word;
+            }
+
+            QCOMPARE(graph.search(spec), expected);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+//  testAffixJoins
+//
+//! Test that Prefix and Suffix conditions joined to the traversal find the
+//! same words as looking up each joined word, in searches of either DAWG
+//! and with more joins than are walked alongside the traversal.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testAffixJoins()
+{
+    WordGraph graph;
+    QVERIFY(graph.importDawgFile(Auxil::getWordsDir() +
+                                 "/North-American/OWL2.dwg", false, 0, 0));
+    QVERIFY(graph.importDawgFile(Auxil::getWordsDir() +
+                                 "/North-American/OWL2-R.dwg", true, 0, 0));
+
+    QList<SearchCondition> drivers;
+    SearchCondition driver;
+    driver.type = SearchCondition::PatternMatch;
+    driver.stringValue = "????";
+    drivers << driver;
+    driver.stringValue = "*ING";
+    drivers << driver;
+    driver.type = SearchCondition::AnagramMatch;
+    driver.stringValue = "AEINST";
+    drivers << driver;
+
+    SearchCondition prefix;
+    prefix.type = SearchCondition::Prefix;
+    prefix.stringValue = "RE";
+    SearchCondition suffix;
+    suffix.type = SearchCondition::Suffix;
+    suffix.stringValue = "S";
+    SearchCondition negatedSuffix = suffix;
+    negatedSuffix.stringValue = "ED";
+    negatedSuffix.negated = true;
+    SearchCondition aPrefix = prefix;
+    aPrefix.stringValue = "A";
+    SearchCondition unPrefix = prefix;
+    unPrefix.stringValue = "UN";
+    unPrefix.negated = true;
+    QVERIFY(graph.usesAffixJoin(prefix));
+    QVERIFY(graph.usesAffixJoin(negatedSuffix));
+
+    QList<QList<SearchCondition> > tests;
+    tests << (QList<SearchCondition>() << prefix)
+          << (QList<SearchCondition>() << suffix)
+          << (QList<SearchCondition>() << aPrefix)
+          << (QList<SearchCondition>() << prefix << suffix)
+          << (QList<SearchCondition>() << negatedSuffix << unPrefix)
+          << (QList<SearchCondition>() << prefix << aPrefix << suffix
+              << negatedSuffix << unPrefix << prefix);
+
+    int numFound = 0;
+    foreach (const SearchCondition& c, drivers) {
+        SearchSpec driverSpec;
+        driverSpec.conditions << c;
+        QStringList driverWords = graph.search(driverSpec);
+        QVERIFY(!driverWords.isEmpty());
+
+        foreach (const QList<SearchCondition>& conditions, tests) {
+            SearchSpec spec = driverSpec;
+            spec.conditions << conditions;
+
+            QStringList expected;
+            foreach (const QString& word, driverWords) {
+                bool matches = true;
+                foreach (const SearchCondition& condition, conditions) {
+                    QString joined =
+                        (condition.type == SearchCondition::Prefix)
+                        ? condition.stringValue + word.toUpper()
+                        : word.toUpper() + condition.stringValue;
+                    if (graph.containsWord(joined) == condition.negated)
+                        matches = false;
+                }
+                if (matches)
+                    expected << word;
+            }
+
+            QCOMPARE(graph.search(spec), expected);
+            numFound += expected.size();
+        }
+    }
+    QVERIFY(numFound > 0);
+}
+
+//---------------------------------------------------------------------------
+//  testWordCache
+//
+//! Test that a full word cache evicts the words not used since the clock
+//! hand last passed them, and counts its hits and misses.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testWordCache()
+{
+    WordEngine::WordCache cache;
+    WordEngine::WordInfo info;
+
+    // Fill the cache until adding a word evicts the first word
+    int id = 0;
+    while (cache.size() == id) {
+        info.word = QString::number(id);
+        cache.insert(id, info);
+        ++id;
+    }
+    int capacity = cache.size();
+    QCOMPARE(id, capacity + 1);
+    QVERIFY(!cache.contains(0));
+    QVERIFY(cache.contains(1));
+    QVERIFY(cache.contains(capacity));
+    QCOMPARE(cache.value(capacity).word, QString::number(capacity));
+
+    // A word used since the hand last passed is spared once
+    QVERIFY(cache.find(2));
+    QCOMPARE(cache.find(2)->word, QString("2"));
+    info.word = "new1";
+    cache.insert(capacity + 1, info);
+    QVERIFY(!cache.contains(1));
+    info.word = "new2";
+    cache.insert(capacity + 2, info);
+    QVERIFY(cache.contains(2));
+    QVERIFY(!cache.contains(3));
+    QCOMPARE(cache.size(), capacity);
+    QCOMPARE(cache.value(capacity + 2).word, QString("new2"));
+
+    // Words added again replace their information without evicting
+    info.word = "changed";
+    cache.insert(capacity + 2, info);
+    QCOMPARE(cache.value(capacity + 2).word, QString("changed"));
+    QVERIFY(cache.contains(4));
+
+    QVERIFY(!cache.find(1));
+    QVERIFY(!cache.find(-1));
+    QCOMPARE(cache.hits, qint64(2));
+    QCOMPARE(cache.misses, qint64(2));
+
+    cache.clear();
+    QCOMPARE(cache.size(), 0);
+    QVERIFY(!cache.contains(2));
+    QCOMPARE(cache.hits, qint64(2));
+}
+
+//---------------------------------------------------------------------------
+//  testAttributeStore
+//
+//! Test that attribute scans keep the words with values in range, across
+//! blocks of 32 words, and that lax order conditions keep words sharing
+//! their value with a word in range.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testAttributeStore()
+{
+    QStringList words = getGeneratedWords("ABC", 4);
+    WordGraph graph;
+    QVERIFY(graph.importWords(words));
+    int numWords = graph.getNumWords();
+
+    // Give every word attributes computed from its ID, with groups of four
+    // words sharing each order value
+    QString connectionName = "AttributeStoreTest";
+    AttributeStore store;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE",
+                                                    connectionName);
+        db.setDatabaseName(":memory:");
+        QVERIFY(db.open());
+
+        QSqlQuery query (db);
+        QVERIFY(query.exec("CREATE TABLE words (word text, length integer, "
+            "num_vowels integer, num_unique_letters integer, "
+            "point_value integer, num_anagrams integer, "
+            "probability_order0 integer, min_probability_order0 integer, "
+            "max_probability_order0 integer, "
+            "probability_order1 integer, min_probability_order1 integer, "
+            "max_probability_order1 integer, "
+            "probability_order2 integer, min_probability_order2 integer, "
+            "max_probability_order2 integer, "
+            "playability_order integer, min_playability_order integer, "
+            "max_playability_order integer)"));
+
+        QVERIFY(query.prepare("INSERT INTO words VALUES (?, ?, ?, ?, ?, ?, "
+                              "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
+        for (int id = -1; id < numWords; ++id) {
+            // A word not in the graph is skipped
+            QString word = (id < 0) ? QString("ZZZ")
+                                    : graph.getWordById(id).toString();
+            query.addBindValue(word);
+            query.addBindValue(word.length());
+            query.addBindValue(word.count('A'));
+            query.addBindValue(Auxil::getNumUniqueLetters(word));
+            query.addBindValue(id % 50);
+            query.addBindValue(1 + (id % 3));
+            for (int i = 0; i < 4; ++i) {
+                query.addBindValue(id + 1);
+                query.addBindValue(((id / 4) * 4) + 1);
+                query.addBindValue(((id / 4) * 4) + 4);
+            }
+            QVERIFY(query.exec());
+        }
+
+        QVERIFY(store.load(db, &graph));
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    QCOMPARE(store.getNumWords(), numWords);
+
+    QVector<quint32> allBits;
+    store.getAllWords(allBits);
+    QCOMPARE(allBits.size(), (numWords + 31) / 32);
+    for (int id = 0; id < allBits.size() * 32; ++id)
+        QCOMPARE(AttributeStore::containsWord(allBits, id), id < numWords);
+
+    SearchCondition condition;
+    QList<SearchCondition> conditions;
+    condition.type = SearchCondition::Length;
+    condition.minValue = 2;
+    condition.maxValue = 3;
+    conditions << condition;
+    condition.type = SearchCondition::NumVowels;
+    condition.minValue = 1;
+    condition.maxValue = 1;
+    conditions << condition;
+    condition.type = SearchCondition::PointValue;
+    condition.minValue = 10;
+    condition.maxValue = 20;
+    conditions << condition;
+    condition.minValue = -5;
+    condition.maxValue = 3;
+    conditions << condition;
+    condition.minValue = 20;
+    condition.maxValue = 10;
+    conditions << condition;
+    condition.minValue = -5;
+    condition.maxValue = -1;
+    conditions << condition;
+    condition.type = SearchCondition::NumAnagrams;
+    condition.minValue = 2;
+    condition.maxValue = 3;
+    conditions << condition;
+    condition.type = SearchCondition::PlayabilityOrder;
+    condition.minValue = 6;
+    condition.maxValue = 10;
+    condition.boolValue = false;
+    conditions << condition;
+    condition.boolValue = true;
+    conditions << condition;
+    condition.type = SearchCondition::ProbabilityOrder;
+    condition.intValue = 1;
+    condition.minValue = 40;
+    condition.maxValue = 70;
+    conditions << condition;
+    condition.minValue = 70;
+    condition.maxValue = 40;
+    conditions << condition;
+
+    foreach (const SearchCondition& c, conditions) {
+        QVERIFY(AttributeStore::handlesCondition(c));
+        QVector<quint32> bits = allBits;
+        store.matchCondition(c, bits);
+
+        int numFound = 0;
+        for (int id = 0; id < numWords; ++id) {
+            QString word = graph.getWordById(id).toString();
+            int value = 0;
+            int minValue = ((id / 4) * 4) + 1;
+            int maxValue = ((id / 4) * 4) + 4;
+            switch (c.type) {
+                case SearchCondition::Length:
+                value = word.length();
+                break;
+
+                case SearchCondition::NumVowels:
+                value = word.count('A');
+                break;
+
+                case SearchCondition::PointValue:
+                value = id % 50;
+                break;
+
+                case SearchCondition::NumAnagrams:
+                value = 1 + (id % 3);
+                break;
+
+                default:
+                value = id + 1;
+                break;
+            }
+
+            bool expected = (value >= c.minValue) && (value <= c.maxValue);
+            if (c.boolValue) {
+                expected = (c.minValue <= c.maxValue) &&
+                    (maxValue >= c.minValue) && (minValue <= c.maxValue);
+            }
+            QCOMPARE(AttributeStore::containsWord(bits, id), expected);
+            if (expected)
+                ++numFound;
+        }
+        QVERIFY((numFound > 0) || (c.maxValue < qMax(c.minValue, 0)));
+    }
+}
+
+//---------------------------------------------------------------------------
+//  testSearchPlans
+//
+//! Test that searches find the same words whichever engine the planner
+//! chooses to find the first list of words, and that the plan describes the
+//! chosen engine and the rejected ones.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testSearchPlans()
+{
+    QStringList words = getGeneratedWords("ABCE", 3);
+    QTemporaryFile lexiconFile;
+    QVERIFY(lexiconFile.open());
+    QTextStream out (&lexiconFile);
+    foreach (const QString& word, words)
+        out << word << "\n";
+    out.flush();
+
+    // Number the words of each length alphabetically for Playability Order
+    // conditions
+    QMap<QString, int> orders;
+    QMap<int, int> numOfLength;
+    foreach (const QString& word, words)
+        orders[word] = ++numOfLength[word.length()];
+
+    QTemporaryFile dbFile;
+    QVERIFY(dbFile.open());
+    QString connectionName = "SearchPlansTest";
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE",
+                                                    connectionName);
+        db.setDatabaseName(dbFile.fileName());
+        QVERIFY(db.open());
+
+        QSqlQuery query (db);
+        QVERIFY(query.exec("CREATE TABLE words (word text, length integer, "
+            "num_vowels integer, num_unique_letters integer, "
+            "point_value integer, num_anagrams integer, "
+            "probability_order0 integer, min_probability_order0 integer, "
+            "max_probability_order0 integer, "
+            "probability_order1 integer, min_probability_order1 integer, "
+            "max_probability_order1 integer, "
+            "probability_order2 integer, min_probability_order2 integer, "
+            "max_probability_order2 integer, "
+            "playability_order integer, min_playability_order integer, "
+            "max_playability_order integer, definition text, "
+            "is_front_hook integer, is_back_hook integer)"));
+
+        QVERIFY(query.prepare("INSERT INTO words VALUES (?, ?, ?, ?, ?, ?, "
+                              "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+                              "?)"));
+        foreach (const QString& word, words) {
+            query.addBindValue(word);
+            query.addBindValue(word.length());
+            query.addBindValue(Auxil::getNumVowels(word));
+            query.addBindValue(Auxil::getNumUniqueLetters(word));
+            query.addBindValue(0);
+            query.addBindValue(1);
+            for (int i = 0; i < 4; ++i) {
+                query.addBindValue(orders.value(word));
+                query.addBindValue(orders.value(word));
+                query.addBindValue(orders.value(word));
+            }
+            query.addBindValue(QString());
+            query.addBindValue(0);
+            query.addBindValue(0);
+            QVERIFY(query.exec());
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    // One engine only has the word graph, the other also has the database
+    // and the attribute store loaded from it
+    QString lexicon = "SearchPlans";
+    WordEngine graphEngine;
+    QCOMPARE(graphEngine.importTextFile(lexicon, lexiconFile.fileName(),
+                                        false), words.size());
+    WordEngine dbEngine;
+    QCOMPARE(dbEngine.importTextFile(lexicon, lexiconFile.fileName(),
+                                     false), words.size());
+    QVERIFY(dbEngine.connectToDatabase(lexicon, dbFile.fileName()));
+
+    QList<SearchSpec> specs;
+    QStringList drivers;
+    QList<bool> graphMatches;
+    SearchSpec spec;
+    SearchCondition condition;
+
+    // Only the word graph shows the letters matched by wildcards
+    condition.type = SearchCondition::PatternMatch;
+    condition.stringValue = "AB?";
+    spec.conditions << condition;
+    specs << spec;
+    drivers << "word graph";
+    graphMatches << true;
+
+    // Lengths and totals are scanned faster in the attribute store
+    spec.conditions.clear();
+    condition = SearchCondition();
+    condition.type = SearchCondition::Length;
+    condition.minValue = 3;
+    condition.maxValue = 3;
+    spec.conditions << condition;
+    condition.type = SearchCondition::NumVowels;
+    condition.minValue = 2;
+    condition.maxValue = 3;
+    spec.conditions << condition;
+    specs << spec;
+    drivers << "attribute store";
+    graphMatches << true;
+
+    // Only the attribute store and the database match orders
+    spec.conditions.clear();
+    condition = SearchCondition();
+    condition.type = SearchCondition::Length;
+    condition.minValue = 2;
+    condition.maxValue = 2;
+    spec.conditions << condition;
+    condition.type = SearchCondition::PlayabilityOrder;
+    condition.minValue = 3;
+    condition.maxValue = 6;
+    spec.conditions << condition;
+    specs << spec;
+    drivers << "attribute store";
+    graphMatches << false;
+
+    // Only the database matches word lists
+    spec.conditions.clear();
+    condition = SearchCondition();
+    condition.type = SearchCondition::InWordList;
+    condition.stringValue = "CAB ACE BEE ZZZ EA";
+    spec.conditions << condition;
+    condition.type = SearchCondition::PatternMatch;
+    condition.stringValue = "*E";
+    spec.conditions << condition;
+    specs << spec;
+    drivers << "database";
+    graphMatches << false;
+
+    for (int i = 0; i < specs.size(); ++i) {
+        const SearchSpec& s = specs.at(i);
+        QStringList expected;
+        foreach (const QString& word, words) {
+            bool matches = true;
+            foreach (const SearchCondition& c, s.conditions) {
+                int value = 0;
+                switch (c.type) {
+                    case SearchCondition::PatternMatch:
+                    matches = matches &&
+                        QRegExp(QString(c.stringValue).replace("?", ".")
+                                .replace("*", ".*")).exactMatch(word);
+                    continue;
+
+                    case SearchCondition::InWordList:
+                    matches = matches &&
+                        c.stringValue.split(QChar(' ')).contains(word);
+                    continue;
+
+                    case SearchCondition::Length:
+                    value = word.length();
+                    break;
+
+                    case SearchCondition::NumVowels:
+                    value = Auxil::getNumVowels(word);
+                    break;
+
+                    case SearchCondition::PlayabilityOrder:
+                    value = orders.value(word);
+                    break;
+
+                    default: break;
+                }
+                matches = matches && (value >= c.minValue) &&
+                    (value <= c.maxValue);
+            }
+            if (matches)
+                expected << word;
+        }
+        QVERIFY(!expected.isEmpty());
+
+        QString explanation = dbEngine.explainSearch(lexicon, s);
+        QVERIFY(explanation.startsWith("1. Find words with the " +
+                                       drivers.at(i) + ":"));
+        QVERIFY(explanation.contains("\nEstimated cost: "));
+
+        QStringList found = dbEngine.search(lexicon, s, true);
+        qSort(found);
+        QCOMPARE(found, expected);
+
+        // Without a database the word graph finds the first list of words
+        // for any spec it can match, and no other engine is planned.  Specs
+        // the word graph cannot match find no words.
+        if (!graphMatches.at(i)) {
+            QVERIFY(graphEngine.search(lexicon, s, true).isEmpty());
+            continue;
+        }
+        explanation = graphEngine.explainSearch(lexicon, s);
+        QVERIFY(explanation.startsWith("1. Find words with the word "
+                                       "graph:"));
+        QVERIFY(!explanation.contains("Rejected:"));
+
+        found = graphEngine.search(lexicon, s, true);
+        qSort(found);
+        QCOMPARE(found, expected);
+    }
+
+    // Plans driven by every engine are costed when each can match every
+    // condition
+    QString explanation = dbEngine.explainSearch(lexicon, specs.at(1));
+    QVERIFY(explanation.contains("Rejected: finding words with the word "
+                                 "graph, cost "));
+    QVERIFY(explanation.contains("Rejected: finding words with the "
+                                 "database, cost "));
+
+    QCOMPARE(dbEngine.explainSearch(lexicon, SearchSpec()),
+             QString("No search is needed: no words can match.\n"));
+    dbEngine.disconnectFromDatabase(lexicon);
+}
+
+//---------------------------------------------------------------------------
+//  testCanonicalString
+//
+//! Test that search specs differing only in the order of their conditions
+//! have the same canonical string, unless the order matters because the
+//! spec limits its results by order, or because the first match condition
+//! decides which letters are shown in lower case.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testCanonicalString()
+{
+    SearchCondition pattern;
+    pattern.type = SearchCondition::PatternMatch;
+    pattern.stringValue = "C*";
+
+    SearchCondition length;
+    length.type = SearchCondition::Length;
+    length.minValue = 3;
+    length.maxValue = 5;
+
+    SearchCondition limit;
+    limit.type = SearchCondition::LimitByProbabilityOrder;
+    limit.minValue = 1;
+    limit.maxValue = 100;
+
+    SearchSpec spec;
+    spec.conditions << pattern << length;
+    SearchSpec reordered;
+    reordered.conditions << length << pattern;
+    QCOMPARE(spec.asCanonicalString(), reordered.asCanonicalString());
+
+    SearchSpec changed = spec;
+    changed.conditions[1].maxValue = 6;
+    QVERIFY(spec.asCanonicalString() != changed.asCanonicalString());
+
+    changed = spec;
+    changed.conditions[0].negated = true;
+    QVERIFY(spec.asCanonicalString() != changed.asCanonicalString());
+
+    changed = spec;
+    changed.conjunction = false;
+    QVERIFY(spec.asCanonicalString() != changed.asCanonicalString());
+
+    SearchSpec limited;
+    limited.conditions << pattern << limit << length;
+    SearchSpec limitedCopy = limited;
+    QCOMPARE(limited.asCanonicalString(), limitedCopy.asCanonicalString());
+    SearchSpec limitedReordered;
+    limitedReordered.conditions << limit << pattern << length;
+    QVERIFY(limited.asCanonicalString() !=
+            limitedReordered.asCanonicalString());
+
+    SearchCondition anagram;
+    anagram.type = SearchCondition::AnagramMatch;
+    anagram.stringValue = "CA?";
+    SearchCondition wildPattern;
+    wildPattern.type = SearchCondition::PatternMatch;
+    wildPattern.stringValue = "??T";
+
+    WordGraph graph;
+    QVERIFY(graph.importWords(getTestWords()));
+    SearchSpec anagramFirst;
+    anagramFirst.conditions << anagram << length << wildPattern;
+    SearchSpec patternFirst;
+    patternFirst.conditions << wildPattern << length << anagram;
+    QCOMPARE(graph.search(anagramFirst), QStringList() << "CAt");
+    QCOMPARE(graph.search(patternFirst), QStringList() << "caT");
+    QVERIFY(anagramFirst.asCanonicalString() !=
+            patternFirst.asCanonicalString());
+
+    SearchSpec lengthFirst;
+    lengthFirst.conditions << length << anagram << wildPattern;
+    QCOMPARE(anagramFirst.asCanonicalString(),
+             lengthFirst.asCanonicalString());
+}
+
+//---------------------------------------------------------------------------
+//  testAlphagramKey
+//
+//! Test alphagram keys of words filling the first 64-bit word of the key
+//! and spilling into the second, and exact anagram lookups in the index.
+//---------------------------------------------------------------------------
+void
+WordEngineTest::testAlphagramKey()
+{
+    AlphagramKey twelve (WordKey(QString("ABCDEFGHIJKL")));
+    AlphagramKey twelveReversed (WordKey(QString("LKJIHGFEDCBA")));
+    QVERIFY(twelve.isValid());
+    QVERIFY(twelve == twelveReversed);
+    QCOMPARE(qHash(twelve), qHash(twelveReversed));
+    QCOMPARE(twelve.getLow(), quint64(0));
+
+    AlphagramKey thirteen (WordKey(QString("ABCDEFGHIJKLM")));
+    AlphagramKey thirteenShuffled (WordKey(QString("MABCDEFGHIJKL")));
+    QVERIFY(thirteen.isValid());
+    QVERIFY(thirteen == thirteenShuffled);
+    QVERIFY(thirteen.getLow() != 0);
+    QVERIFY(thirteen != twelve);
+
+    // Words differing only in the letter packed into the second word
+    AlphagramKey thirteenOther (WordKey(QString("ABCDEFGHIJKLN")));
+    QVERIFY(thirteen != thirteenOther);
+    QCOMPARE(thirteen.getHigh(), thirteenOther.getHigh());
+
+    // Words differing only in the last letter packed into the first word
+    AlphagramKey twelveOther (WordKey(QString("ABCDEFGHIJKM")));
+    QVERIFY(twelve != twelveOther);
+
+    QVERIFY(!AlphagramKey(WordKey(QString("AB?"))).isValid());
+    QVERIFY(!AlphagramKey(WordKey(QString("abc"))).isValid());
+    QVERIFY(!AlphagramKey().isValid());
+
+    WordGraph graph;
+    QVERIFY(graph.importWords(getTestWords()));
+    QCOMPARE(graph.countAnagrams("RATS"), 5);
+    QCOMPARE(graph.countAnagrams("ELBATHGIRYPOCNU"), 1);
+    QCOMPARE(graph.countAnagrams("DGOO"), 0);
+    QCOMPARE(graph.getNumAnagrams(graph.getWordId("TSAR")), 5);
+
+    SearchCondition condition;
+    condition.type = SearchCondition::AnagramMatch;
+    condition.stringValue = "RATS";
+    SearchSpec spec;
+    spec.conditions << condition;
+    QStringList expected;
+    expected << "ARTS" << "RATS" << "STAR" << "TARS" << "TSAR";
+    QCOMPARE(graph.search(spec), expected);
+}
+
 // Create a main function for a standalone executable
 QTEST_MAIN(WordEngineTest);
 #include "WordEngineTest.moc"